@@ -488,7 +488,7 @@ void draw_dab_pixels_BlendMode_LockAlpha_Paint (uint16_t * mask,
   }
 };
 
-void get_color_pixels_legacy (
+int get_color_pixels_legacy (
     uint16_t * mask,
     uint16_t * rgba,
     float * sum_weight,
@@ -507,9 +507,10 @@ void get_color_pixels_legacy (
     uint32_t g = 0;
     uint32_t b = 0;
     uint32_t a = 0;
+    int sampled = 0;
 
     while (1) {
-        for (; mask[0]; mask++, rgba+=4) {
+        for (; mask[0]; mask++, rgba+=4, sampled++) {
             uint32_t opa = mask[0];
             weight += opa;
             r      += opa*rgba[0]/(1<<15);
@@ -529,6 +530,7 @@ void get_color_pixels_legacy (
     *sum_g += g;
     *sum_b += b;
     *sum_a += a;
+    return sampled;
 };
 
 // Sum up the color/alpha components inside the masked region.
@@ -543,22 +545,21 @@ void get_color_pixels_legacy (
 // with the exception of the guaranteed ones. Range: 0.0..1.0.
 // The random sample rate can be set to 0, in which case no random
 // sampling will occur.
-void get_color_pixels_accumulate (uint16_t * mask,
-                                  uint16_t * rgba,
-                                  float * sum_weight,
-                                  float * sum_r,
-                                  float * sum_g,
-                                  float * sum_b,
-                                  float * sum_a,
-                                  float paint,
-                                  uint16_t sample_interval,
-                                  float random_sample_rate
-                                  ) {
+int get_color_pixels_accumulate (uint16_t * mask,
+                                 uint16_t * rgba,
+                                 float * sum_weight,
+                                 float * sum_r,
+                                 float * sum_g,
+                                 float * sum_b,
+                                 float * sum_a,
+                                 float paint,
+                                 uint16_t sample_interval,
+                                 float random_sample_rate
+                                 ) {
   // Fall back to legacy sampling if using static 0 paint setting
   // Indicated by passing a negative paint factor (normal range 0..1)
   if (paint < 0.0) {
-      get_color_pixels_legacy(mask, rgba, sum_weight, sum_r, sum_g, sum_b, sum_a);
-      return;
+      return get_color_pixels_legacy(mask, rgba, sum_weight, sum_r, sum_g, sum_b, sum_a);
   }
 
   // Sample the canvas as additive and subtractive
@@ -577,6 +578,7 @@ void get_color_pixels_accumulate (uint16_t * mask,
   // Ideally, the selection of pixels to be sampled should
   // be determined before this function is called.
   uint16_t interval_counter = 0;
+  int sampled = 0;
   const int random_sample_threshold = (int)(random_sample_rate * RAND_MAX);
 
   while (1) {
@@ -584,6 +586,7 @@ void get_color_pixels_accumulate (uint16_t * mask,
       // Sample every n pixels, and a percentage of the rest.
       // At least one pixel (the first) will always be sampled.
       if (interval_counter == 0 || rand() < random_sample_threshold) {
+        sampled++;
 
         float a = (float)mask[0] * rgba[3] / (1 << 30);
         float alpha_sums = a + *sum_a;
@@ -623,4 +626,5 @@ void get_color_pixels_accumulate (uint16_t * mask,
   *sum_r = spec_rgb[0] * paint + (1.0 - paint) * avg_rgb[0];
   *sum_g = spec_rgb[1] * paint + (1.0 - paint) * avg_rgb[1];
   *sum_b = spec_rgb[2] * paint + (1.0 - paint) * avg_rgb[2];
+  return sampled;
 };
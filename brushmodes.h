@@ -59,17 +59,17 @@ void draw_dab_pixels_BlendMode_LockAlpha_Paint (uint16_t * mask,
                                           uint16_t color_b,
                                           uint16_t opacity);
 
-void get_color_pixels_accumulate (uint16_t * mask,
-                                  uint16_t * rgba,
-                                  float * sum_weight,
-                                  float * sum_r,
-                                  float * sum_g,
-                                  float * sum_b,
-                                  float * sum_a,
-                                  float paint,
-                                  uint16_t sample_interval,
-                                  float random_sample_rate
-                                  );
+int get_color_pixels_accumulate (uint16_t * mask,
+                                 uint16_t * rgba,
+                                 float * sum_weight,
+                                 float * sum_r,
+                                 float * sum_g,
+                                 float * sum_b,
+                                 float * sum_a,
+                                 float paint,
+                                 uint16_t sample_interval,
+                                 float random_sample_rate
+                                 );
 
 
 
@@ -1,4 +1,5 @@
 #include <jni.h>
+#include <android/bitmap.h>
 #include <stdlib.h>
 #include <string.h>
 #include <pthread.h>
@@ -47,12 +48,47 @@ static float g_color_r = 1.0f, g_color_g = 0.0f, g_color_b = 0.0f;
 static int g_in_atomic = 0;
 // Mutex to serialize access to g_surface/g_brush across threads (worker vs GL renderer)
 static pthread_mutex_t g_mutex = PTHREAD_MUTEX_INITIALIZER;
+// Bounding box of the pixels changed since the last getDirtyRect, empty when width is 0
+static MyPaintRectangle g_dirty = {0, 0, 0, 0};
+
+static void mark_dirty(MyPaintRectangle *rect) {
+    if (rect->width <= 0 || rect->height <= 0) return;
+    if (g_dirty.width <= 0) {
+        g_dirty = *rect;
+    } else {
+        mypaint_rectangle_expand_to_include_rect(&g_dirty, rect);
+    }
+}
+
+static void mark_all_dirty() {
+    MyPaintRectangle all = {0, 0, g_w, g_h};
+    g_dirty = all;
+}
+
+// End the surface transaction, adding the area it changed to g_dirty
+static void end_atomic_tracking_dirty() {
+    MyPaintRectangle rect;
+    MyPaintRectangles rois = {1, &rect};
+    mypaint_surface_end_atomic((MyPaintSurface*)g_surface, &rois);
+    if (rois.num_rectangles > 0) mark_dirty(&rect);
+}
+
+// Interactive canvases render dabs on background threads while strokes are still coming in;
+// end_atomic (endStroke/flush) then only waits for the remaining tiles.
+static MyPaintFixedTiledSurface *new_interactive_surface(int w, int h) {
+    MyPaintFixedTiledSurface *surface = mypaint_fixed_tiled_surface_new(w, h);
+    if (surface && !mypaint_tiled_surface_set_async((MyPaintTiledSurface*)surface, TRUE)) {
+        LOGI("Asynchronous tile processing unavailable, rendering in end_atomic");
+    }
+    return surface;
+}
 
 static void free_canvas() {
     if (g_brush) { mypaint_brush_unref(g_brush); g_brush = NULL; }
     if (g_surface) { mypaint_surface_unref((MyPaintSurface*)g_surface); g_surface = NULL; }
     g_w = g_h = 0;
     g_in_atomic = 0;
+    g_dirty.width = g_dirty.height = 0;
 }
 
 JNIEXPORT jbyteArray JNICALL
@@ -116,7 +152,7 @@ Java_com_example_mypaint_MyPaintBridge_initCanvas(JNIEnv* env, jobject thiz, jin
     pthread_mutex_lock(&g_mutex);
     free_canvas();
     g_w = width; g_h = height;
-    g_surface = mypaint_fixed_tiled_surface_new(g_w, g_h);
+    g_surface = new_interactive_surface(g_w, g_h);
     g_brush = mypaint_brush_new();
     mypaint_brush_from_defaults(g_brush);
     // Example color: red
@@ -124,6 +160,7 @@ Java_com_example_mypaint_MyPaintBridge_initCanvas(JNIEnv* env, jobject thiz, jin
     mypaint_brush_set_base_value(g_brush, MYPAINT_BRUSH_SETTING_COLOR_S, 1.0f);
     mypaint_brush_set_base_value(g_brush, MYPAINT_BRUSH_SETTING_COLOR_V, 1.0f);
     g_in_atomic = 0;
+    mark_all_dirty();
     pthread_mutex_unlock(&g_mutex);
 }
 
@@ -132,8 +169,9 @@ Java_com_example_mypaint_MyPaintBridge_clearCanvas(JNIEnv* env, jobject thiz) {
     if (g_w <= 0 || g_h <= 0) return;
     pthread_mutex_lock(&g_mutex);
     if (g_surface) { mypaint_surface_unref((MyPaintSurface*)g_surface); }
-    g_surface = mypaint_fixed_tiled_surface_new(g_w, g_h);
+    g_surface = new_interactive_surface(g_w, g_h);
     g_in_atomic = 0;
+    mark_all_dirty();
     pthread_mutex_unlock(&g_mutex);
 }
 
@@ -212,29 +250,66 @@ Java_com_example_mypaint_MyPaintBridge_beginStroke(JNIEnv* env, jobject thiz) {
     pthread_mutex_unlock(&g_mutex);
 }
 
+// Values per event in the arrays passed to strokeToEvents: x, y, pressure, dtime, xtilt, ytilt
+#define STROKE_EVENT_FLOATS 6
+
+static void set_brush_event(MyPaintBrushEvent *event, float x, float y, float pressure, float dtime,
+                            float xtilt, float ytilt) {
+    // Normalize tilts if they are NaN (Kotlin may pass Float.NaN)
+    if (xtilt != xtilt) xtilt = 0.0f; // NaN check
+    if (ytilt != ytilt) ytilt = 0.0f; // NaN check
+    event->x = x;
+    event->y = y;
+    event->pressure = pressure;
+    event->xtilt = xtilt;
+    event->ytilt = ytilt;
+    event->dtime = dtime;
+    event->viewzoom = 1.0f;
+    event->viewrotation = 0.0f;
+    event->barrel_rotation = 0.0f;
+}
+
 JNIEXPORT void JNICALL
 Java_com_example_mypaint_MyPaintBridge_strokeTo(JNIEnv* env, jobject thiz, jfloat x, jfloat y, jfloat pressure, jfloat dtime, jfloat xtilt, jfloat ytilt) {
     pthread_mutex_lock(&g_mutex);
     if (!g_brush || !g_surface) { pthread_mutex_unlock(&g_mutex); return; }
-    // Normalize tilts if they are NaN (Kotlin may pass Float.NaN)
-    if (xtilt != xtilt) xtilt = 0.0f; // NaN check
-    if (ytilt != ytilt) ytilt = 0.0f; // NaN check
     // Use brush engine stroke_to so preset (.myb) settings take effect
-    float viewzoom = 1.0f, viewrotation = 0.0f, barrel_rotation = 0.0f;
-    gboolean linear = FALSE;
-    mypaint_brush_stroke_to(g_brush, (MyPaintSurface*)g_surface,
-                            x, y,
-                            pressure, xtilt, ytilt, dtime,
-                            viewzoom, viewrotation, barrel_rotation,
-                            linear);
+    MyPaintBrushEvent event;
+    set_brush_event(&event, x, y, pressure, dtime, xtilt, ytilt);
+    mypaint_brush_stroke_to_events(g_brush, (MyPaintSurface*)g_surface, &event, 1, FALSE, NULL);
     pthread_mutex_unlock(&g_mutex);
 }
 
+// Several motion events in one call, packed as STROKE_EVENT_FLOATS floats each.
+// Saves a JNI transition and a lock per event for high-rate input.
+JNIEXPORT void JNICALL
+Java_com_example_mypaint_MyPaintBridge_strokeToEvents(JNIEnv* env, jobject thiz, jfloatArray events, jint count) {
+    if (!events || count <= 0) return;
+    if ((*env)->GetArrayLength(env, events) < count * STROKE_EVENT_FLOATS) return;
+
+    MyPaintBrushEvent *brush_events = (MyPaintBrushEvent*)malloc(sizeof(MyPaintBrushEvent) * count);
+    if (!brush_events) return;
+    jfloat *values = (*env)->GetFloatArrayElements(env, events, NULL);
+    if (!values) { free(brush_events); return; }
+    for (int i = 0; i < count; i++) {
+        const jfloat *v = values + i * STROKE_EVENT_FLOATS;
+        set_brush_event(&brush_events[i], v[0], v[1], v[2], v[3], v[4], v[5]);
+    }
+    (*env)->ReleaseFloatArrayElements(env, events, values, JNI_ABORT);
+
+    pthread_mutex_lock(&g_mutex);
+    if (g_brush && g_surface) {
+        mypaint_brush_stroke_to_events(g_brush, (MyPaintSurface*)g_surface, brush_events, count, FALSE, NULL);
+    }
+    pthread_mutex_unlock(&g_mutex);
+    free(brush_events);
+}
+
 JNIEXPORT void JNICALL
 Java_com_example_mypaint_MyPaintBridge_endStroke(JNIEnv* env, jobject thiz) {
     pthread_mutex_lock(&g_mutex);
     if (!g_brush || !g_surface) { pthread_mutex_unlock(&g_mutex); return; }
-    mypaint_surface_end_atomic((MyPaintSurface*)g_surface, NULL);
+    end_atomic_tracking_dirty();
     g_in_atomic = 0;
     // Reset brush engine state to ensure a clean start, per mypaint-brush.c guidance
     mypaint_brush_reset(g_brush);
@@ -268,11 +343,93 @@ JNIEXPORT void JNICALL
 Java_com_example_mypaint_MyPaintBridge_flush(JNIEnv* env, jobject thiz) {
     pthread_mutex_lock(&g_mutex);
     if (g_surface && g_in_atomic) {
-        mypaint_surface_end_atomic((MyPaintSurface*)g_surface, NULL);
+        end_atomic_tracking_dirty();
         mypaint_surface_begin_atomic((MyPaintSurface*)g_surface);
         // Note: Do NOT call mypaint_brush_new_stroke or reset here; we are mid-stroke.
     }
     pthread_mutex_unlock(&g_mutex);
 }
 
+// Store the bounding box (x, y, w, h) of the pixels changed since the previous call in `out`
+// and reset it. Work queued by an ongoing stroke is flushed first. Returns false if nothing changed.
+JNIEXPORT jboolean JNICALL
+Java_com_example_mypaint_MyPaintBridge_getDirtyRect(JNIEnv* env, jobject thiz, jintArray out) {
+    if (!out || (*env)->GetArrayLength(env, out) < 4) return JNI_FALSE;
+    pthread_mutex_lock(&g_mutex);
+    if (g_surface && g_in_atomic) {
+        end_atomic_tracking_dirty();
+        mypaint_surface_begin_atomic((MyPaintSurface*)g_surface);
+    }
+    MyPaintRectangle dirty = g_dirty;
+    g_dirty.width = g_dirty.height = 0;
+    pthread_mutex_unlock(&g_mutex);
+
+    if (dirty.width <= 0 || dirty.height <= 0) return JNI_FALSE;
+    jint xywh[4] = {dirty.x, dirty.y, dirty.width, dirty.height};
+    (*env)->SetIntArrayRegion(env, out, 0, 4, xywh);
+    return JNI_TRUE;
+}
 
+// Convert the canvas region (x, y, w, h) into `dst`, which holds the whole canvas with rows
+// `dstStride` bytes apart; pixels outside of the region are left alone. `format` is one of
+// MyPaintRgba8Format, see MyPaintBridge.FORMAT_*. The cost is proportional to the region.
+JNIEXPORT jboolean JNICALL
+Java_com_example_mypaint_MyPaintBridge_readRgbaRegion(JNIEnv* env, jobject thiz, jint x, jint y, jint w, jint h,
+                                                      jbyteArray dst, jint dstStride, jint format) {
+    if (!dst || format < MYPAINT_RGBA8_FORMAT_RGBA_PREMULTIPLIED || format > MYPAINT_RGBA8_FORMAT_BGRA_STRAIGHT) {
+        return JNI_FALSE;
+    }
+    pthread_mutex_lock(&g_mutex);
+    if (!g_surface || dstStride < g_w * 4 ||
+        (size_t)(*env)->GetArrayLength(env, dst) < (size_t)(g_h - 1) * dstStride + (size_t)g_w * 4) {
+        pthread_mutex_unlock(&g_mutex);
+        return JNI_FALSE;
+    }
+    // Clip here so that the destination offset is always inside of the array
+    int x0 = x > 0 ? x : 0, y0 = y > 0 ? y : 0;
+    int x1 = x + w < g_w ? x + w : g_w, y1 = y + h < g_h ? y + h : g_h;
+    if (x0 < x1 && y0 < y1) {
+        // Critical access avoids copying the whole canvas for a small region
+        unsigned char *pixels = (unsigned char*)(*env)->GetPrimitiveArrayCritical(env, dst, NULL);
+        if (!pixels) { pthread_mutex_unlock(&g_mutex); return JNI_FALSE; }
+        mypaint_fixed_tiled_surface_read_rgba8_region(g_surface, x0, y0, x1 - x0, y1 - y0,
+                                                      pixels + (size_t)y0 * dstStride + (size_t)x0 * 4,
+                                                      (size_t)dstStride, (MyPaintRgba8Format)format);
+        (*env)->ReleasePrimitiveArrayCritical(env, dst, pixels, 0);
+    }
+    pthread_mutex_unlock(&g_mutex);
+    return JNI_TRUE;
+}
+
+// Like readRgbaRegion, but writes straight into the pixels of an RGBA_8888 `bitmap` at
+// least as large as the canvas, so that nothing outside of the region is copied either.
+JNIEXPORT jboolean JNICALL
+Java_com_example_mypaint_MyPaintBridge_readRgbaRegionToBitmap(JNIEnv* env, jobject thiz, jint x, jint y, jint w, jint h,
+                                                              jobject bitmap, jint format) {
+    AndroidBitmapInfo info;
+    if (!bitmap || format < MYPAINT_RGBA8_FORMAT_RGBA_PREMULTIPLIED || format > MYPAINT_RGBA8_FORMAT_BGRA_STRAIGHT ||
+        AndroidBitmap_getInfo(env, bitmap, &info) != ANDROID_BITMAP_RESULT_SUCCESS ||
+        info.format != ANDROID_BITMAP_FORMAT_RGBA_8888) {
+        return JNI_FALSE;
+    }
+    pthread_mutex_lock(&g_mutex);
+    if (!g_surface || info.width < (uint32_t)g_w || info.height < (uint32_t)g_h) {
+        pthread_mutex_unlock(&g_mutex);
+        return JNI_FALSE;
+    }
+    int x0 = x > 0 ? x : 0, y0 = y > 0 ? y : 0;
+    int x1 = x + w < g_w ? x + w : g_w, y1 = y + h < g_h ? y + h : g_h;
+    if (x0 < x1 && y0 < y1) {
+        void *pixels = NULL;
+        if (AndroidBitmap_lockPixels(env, bitmap, &pixels) != ANDROID_BITMAP_RESULT_SUCCESS || !pixels) {
+            pthread_mutex_unlock(&g_mutex);
+            return JNI_FALSE;
+        }
+        mypaint_fixed_tiled_surface_read_rgba8_region(g_surface, x0, y0, x1 - x0, y1 - y0,
+                                                      (unsigned char*)pixels + (size_t)y0 * info.stride + (size_t)x0 * 4,
+                                                      (size_t)info.stride, (MyPaintRgba8Format)format);
+        AndroidBitmap_unlockPixels(env, bitmap);
+    }
+    pthread_mutex_unlock(&g_mutex);
+    return JNI_TRUE;
+}
@@ -28,10 +28,13 @@ class DrawingView @JvmOverloads constructor(
     private val bridge = MyPaintBridge()
 
     // Reusable bitmap for displaying the native canvas
-    private val bitmap: Bitmap = Bitmap.createBitmap(canvasWidth, canvasHeight, Bitmap.Config.ARGB_8888)
+    private val bitmap: Bitmap = Bitmap.createBitmap(canvasWidth, canvasHeight, Bitmap.Config.ARGB_8888).apply {
+        setHasAlpha(true)
+        setPremultiplied(true)
+    }
 
-    // Buffers reused to avoid allocations in the render loop
-    private var bgraBuffer: ByteArray = ByteArray(canvasWidth * canvasHeight * 4)
+    // Reused to avoid allocations in the render loop
+    private val dirtyRect = IntArray(4)
 
     // View<->Bitmap mapping (fitCenter)
     private val dstRect = RectF()
@@ -120,36 +123,13 @@ class DrawingView @JvmOverloads constructor(
         return Pair(ix, iy)
     }
 
+    // Only the area changed since the previous update is converted, straight into the
+    // bitmap's pixels, in the byte order and alpha mode used for it so far
     private fun updateBitmapAndInvalidate() {
-        bridge.readRgba()?.let { rgba ->
-            if (bgraBuffer.size != rgba.size) {
-                bgraBuffer = ByteArray(rgba.size)
-            }
-            rgbaToPremultipliedBGRA(rgba, bgraBuffer)
-            val buffer = java.nio.ByteBuffer.wrap(bgraBuffer)
-            bitmap.setHasAlpha(true)
-            bitmap.setPremultiplied(true)
-            bitmap.copyPixelsFromBuffer(buffer)
+        if (!bridge.getDirtyRect(dirtyRect)) return
+        val (x, y, w, h) = dirtyRect
+        if (bridge.readRgbaRegionToBitmap(x, y, w, h, bitmap, MyPaintBridge.FORMAT_BGRA_PREMULTIPLIED)) {
             invalidate()
         }
     }
-
-    // Convert RGBA bytes to premultiplied BGRA (Android Bitmap native order)
-    private fun rgbaToPremultipliedBGRA(src: ByteArray, dst: ByteArray) {
-        var i = 0
-        while (i < src.size) {
-            val r = src[i + 0].toInt() and 0xFF
-            val g = src[i + 1].toInt() and 0xFF
-            val b = src[i + 2].toInt() and 0xFF
-            val a = src[i + 3].toInt() and 0xFF
-            val pr = (r * a + 127) / 255
-            val pg = (g * a + 127) / 255
-            val pb = (b * a + 127) / 255
-            dst[i + 0] = pb.toByte()
-            dst[i + 1] = pg.toByte()
-            dst[i + 2] = pr.toByte()
-            dst[i + 3] = a.toByte()
-            i += 4
-        }
-    }
 }
@@ -67,10 +67,23 @@ class GLDrawingView @JvmOverloads constructor(
                         val drained: MutableList<StrokeEvent> = ArrayList(16)
                         drained.add(ev)
                         eventQueue.drainTo(drained, 100)
+                        // Consecutive moves go to the engine in a single call
+                        val moves = FloatArray(drained.size * 6)
+                        var movesCount = 0
+                        fun flushMoves() {
+                            if (movesCount > 0) {
+                                bridge.strokeToEvents(moves, movesCount)
+                                movesCount = 0
+                            }
+                        }
                         for (e2 in drained) {
+                            if (e2 !is StrokeEvent.Move) flushMoves()
                             when (e2) {
                                 is StrokeEvent.Move -> {
-                                    bridge.strokeTo(e2.x, e2.y, e2.pressure, e2.dt, e2.xtilt, e2.ytilt)
+                                    val o = movesCount * 6
+                                    moves[o] = e2.x; moves[o + 1] = e2.y; moves[o + 2] = e2.pressure
+                                    moves[o + 3] = e2.dt; moves[o + 4] = e2.xtilt; moves[o + 5] = e2.ytilt
+                                    movesCount++
                                 }
                                 is StrokeEvent.Begin -> {
                                     if (!inStroke) {
@@ -125,6 +138,7 @@ class GLDrawingView @JvmOverloads constructor(
                                 }
                             }
                         }
+                        flushMoves()
                         // Flush once after processing the batch so GL sees updates
                         bridge.flush()
                         requestRenderOnGL()
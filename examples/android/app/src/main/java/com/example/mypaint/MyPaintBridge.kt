@@ -5,6 +5,12 @@ class MyPaintBridge {
         init {
             System.loadLibrary("mypaint-jni")
         }
+
+        // Pixel formats of readRgbaRegion, values of MyPaintRgba8Format
+        const val FORMAT_RGBA_PREMULTIPLIED = 0
+        const val FORMAT_BGRA_PREMULTIPLIED = 1
+        const val FORMAT_RGBA_STRAIGHT = 2
+        const val FORMAT_BGRA_STRAIGHT = 3
     }
     // Existing demo renderer
     external fun renderDemo(width: Int, height: Int): ByteArray?
@@ -15,9 +21,19 @@ class MyPaintBridge {
     external fun setColorRgb(r: Float, g: Float, b: Float)
     external fun beginStroke()
     external fun strokeTo(x: Float, y: Float, pressure: Float, dtime: Float, xTilt: Float = Float.NaN, yTilt: Float = Float.NaN)
+    // Batched strokeTo: `count` events packed as x, y, pressure, dtime, xTilt, yTilt
+    external fun strokeToEvents(events: FloatArray, count: Int)
     external fun endStroke()
+    // Whole canvas as premultiplied RGBA
     external fun readRgba(): ByteArray?
 
+    // Bounding box (x, y, w, h) changed since the last call; false if nothing changed
+    external fun getDirtyRect(out: IntArray): Boolean
+    // Convert a region into a whole-canvas buffer with rows dstStride bytes apart
+    external fun readRgbaRegion(x: Int, y: Int, w: Int, h: Int, dst: ByteArray, dstStride: Int, format: Int): Boolean
+    // Convert a region straight into an ARGB_8888 bitmap at least as large as the canvas
+    external fun readRgbaRegionToBitmap(x: Int, y: Int, w: Int, h: Int, bitmap: android.graphics.Bitmap, format: Int): Boolean
+
     // Ensure visible intermediate results while inside atomic
     external fun flush()
 
@@ -5,16 +5,18 @@
 
 #include "helpers.c"
 #include "brushmodes.c"
-#include "fifo.c"
 #include "operationqueue.c"
 #include "rng-double.c"
 #include "write_ppm.c"
 #include "tilemap.c"
+#include "tilescheduler.c"
+#include "trace.c"
 
 #include "mypaint.c"
 #include "mypaint-brush.c"
 #include "mypaint-brush-settings.c"
 #include "mypaint-fixed-tiled-surface.c"
+#include "mypaint-recording-surface.c"
 #include "mypaint-matrix.c"
 #include "mypaint-symmetry.c"
 #include "mypaint-surface.c"
@@ -280,6 +280,36 @@ def settings_info_struct(s):
     )
 
 
+def cname_hash(name):
+    # FNV-1a, must match cname_hash() in mypaint-brush-settings.c
+    h = 2166136261
+    for c in name.encode("utf-8"):
+        h = ((h ^ c) * 16777619) & 0xffffffff
+    return h
+
+
+def generate_cname_hash_table(instance_name, size_name, names):
+    # Open addressing with linear probing, at most half full
+    size = 1
+    while size < 2 * len(names):
+        size *= 2
+    table = [-1] * size
+    for idx, name in enumerate(names):
+        slot = cname_hash(name) & (size - 1)
+        while table[slot] >= 0:
+            slot = (slot + 1) & (size - 1)
+        table[slot] = idx
+
+    indent = " " * 4
+    content = "#define %s %d\n" % (size_name, size)
+    content += "static const short %s[%s] = {\n" % (instance_name, size_name)
+    for i in range(0, size, 16):
+        row = ", ".join(str(v) for v in table[i:i + 16])
+        content += indent + row + ",\n"
+    content += "};\n"
+    return content
+
+
 def header_guard_name(file_name):
     alfa_num = "".join(map(lambda c: c if c.isalnum() else '_', file_name))
     return alfa_num.upper()
@@ -304,6 +334,18 @@ def generate_internal_settings_code():
         "inputs_info_array",
         [input_info_struct(i) for i in _INPUTS],
     )
+    content += "\n"
+    content += generate_cname_hash_table(
+        "settings_cname_hash_table",
+        "SETTINGS_CNAME_HASH_SIZE",
+        [s.real_internal_name for s in _SETTINGS],
+    )
+    content += "\n"
+    content += generate_cname_hash_table(
+        "inputs_cname_hash_table",
+        "INPUTS_CNAME_HASH_SIZE",
+        [i.real_id for i in _INPUTS],
+    )
     return content
 
 
@@ -17,6 +17,20 @@ mypaint_brush_get_type (void)
     return type;
 }
 
+GType
+mypaint_brush_settings_get_type (void)
+{
+    static GType type = 0;
+
+    if (!type) {
+        type = g_boxed_type_register_static("MyPaintBrushSettings",
+                                            (GBoxedCopyFunc) mypaint_brush_settings_ref,
+                                            (GBoxedFreeFunc) mypaint_brush_settings_unref);
+    }
+
+    return type;
+}
+
 GType
 mypaint_surface_get_type (void)
 {
@@ -7,6 +7,10 @@
 #define MYPAINT_VALUE_HOLDS_BRUSH(value) (G_TYPE_CHECK_VALUE_TYPE ((value), MYPAINT_TYPE_BRUSH))
 GType mypaint_brush_get_type(void);
 
+#define MYPAINT_TYPE_BRUSH_SETTINGS               (mypaint_brush_settings_get_type ())
+#define MYPAINT_VALUE_HOLDS_BRUSH_SETTINGS(value) (G_TYPE_CHECK_VALUE_TYPE ((value), MYPAINT_TYPE_BRUSH_SETTINGS))
+GType mypaint_brush_settings_get_type(void);
+
 #define MYPAINT_TYPE_SURFACE               (mypaint_surface_get_type ())
 #define MYPAINT_VALUE_HOLDS_SURFACE(value) (G_TYPE_CHECK_VALUE_TYPE ((value), MYPAINT_TYPE_SURFACE))
 GType mypaint_surface_get_type(void);
@@ -22,6 +22,7 @@
 #include <assert.h>
 #include <stdint.h>
 #include <math.h>
+#include <time.h>
 #include "fastapprox/fastpow.h"
 
 #include "helpers.h"
@@ -561,10 +562,13 @@ spectral_to_rgb (float *spectral, float *rgb_) {
 
 //function to make it easy to blend two spectral colors via weighted geometric mean
 //a is the current smudge state, b is the get_color or brush color
-float * mix_colors(float *a, float *b, float fac, float paint_mode)
+//the mix is written to result, which may not alias a or b
+void mix_colors(const float *a, const float *b, float fac, float paint_mode, float *result)
 {
-  static float result[4] = {0};  
-  
+  for (int i=0; i < 4; i++) {
+    result[i] = 0.0f;
+  }
+
   float opa_a = fac;
   float opa_b = 1.0-opa_a;
   result[3] = CLAMP(opa_a * a[3] + opa_b * b[3], 0.0f, 1.0f);
@@ -601,8 +605,19 @@ float * mix_colors(float *a, float *b, float fac, float paint_mode)
       result[i] = result[i] * paint_mode + (1-paint_mode) * (a[i] * opa_a + b[i] * opa_b);
     }
   }
+}
 
-  return result;
+// Seconds since an arbitrary point in time, for measuring intervals
+double
+get_monotonic_time (void)
+{
+#ifdef CLOCK_MONOTONIC
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+#else
+    return (double)clock() / CLOCKS_PER_SEC;
+#endif
 }
 
 #endif //HELPERS_C
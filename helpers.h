@@ -41,7 +41,7 @@ float mod_arith(float a, float N);
 
 float smallest_angular_difference(float angleA, float angleB);
 
-float * mix_colors(float *a, float *b, float fac, float paint_mode);
+void mix_colors(const float *a, const float *b, float fac, float paint_mode, float *result);
 
 void
 rgb_to_spectral (float r, float g, float b, float *spectral_);
@@ -49,4 +49,6 @@ rgb_to_spectral (float r, float g, float b, float *spectral_);
 void
 spectral_to_rgb (float *spectral, float *rgb_);
 
+double get_monotonic_time (void);
+
 #endif // HELPERS_H
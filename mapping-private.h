@@ -0,0 +1,83 @@
+#ifndef MAPPING_PRIVATE_H
+#define MAPPING_PRIVATE_H
+
+#include "mypaint-mapping.h"
+
+G_BEGIN_DECLS
+
+/* Number of intervals of a curve lookup table */
+#define CONTROL_POINTS_LUT_SIZE 256
+
+/* The curve of one input of a mapping: a set of control points (stepwise linear) */
+typedef struct {
+  float xvalues[64];
+  float yvalues[64];
+  int n;
+
+  // The curve sampled at CONTROL_POINTS_LUT_SIZE+1 uniform steps over
+  // [lut_x0, lut_x1], the range of the control points. NULL if the curve
+  // cannot be tabulated accurately; see control_points_update_lut().
+  float *lut;
+  float lut_x0;
+  float lut_x1;
+  float lut_scale;
+} ControlPoints;
+
+/* A deep copy of @self */
+MyPaintMapping *mypaint_mapping_copy(const MyPaintMapping *self);
+
+/* Set all @n points of the curve of @input at once, from @n (x, y) pairs.
+ * Same as mypaint_mapping_set_n() followed by mypaint_mapping_set_point()
+ * for each point, but the lookup table is only built once. */
+void mypaint_mapping_set_points(MyPaintMapping *self, int input, int n, const float *points);
+
+/* The curve of @input, or NULL if the input is not used by the mapping.
+ * The curve stays valid until the mapping is freed. */
+const ControlPoints *mypaint_mapping_get_curve(MyPaintMapping *self, int input);
+
+/* Value of a curve with at least two points at @x, searching the control points */
+static inline float
+control_points_evaluate_exact(const ControlPoints *p, float x)
+{
+    // find the segment with the slope that we need to use
+    float x0, y0, x1, y1;
+    x0 = p->xvalues[0];
+    y0 = p->yvalues[0];
+    x1 = p->xvalues[1];
+    y1 = p->yvalues[1];
+
+    int i;
+    for (i=2; i<p->n && x>x1; i++) {
+      x0 = x1;
+      y0 = y1;
+      x1 = p->xvalues[i];
+      y1 = p->yvalues[i];
+    }
+
+    if (x0 == x1 || y0 == y1) {
+      return y0;
+    } else {
+      // linear interpolation
+      return (y1*(x - x0) + y0*(x1 - x)) / (x1 - x0);
+    }
+}
+
+/* Value of a curve with at least two points at @x. Uses the lookup table
+ * inside of its range; outside, the first or last segment is extrapolated
+ * exactly as before. */
+static inline float
+control_points_evaluate(const ControlPoints *p, float x)
+{
+    if (p->lut && x >= p->lut_x0 && x <= p->lut_x1) {
+      const float f = (x - p->lut_x0) * p->lut_scale;
+      int i = (int)f;
+      if (i >= CONTROL_POINTS_LUT_SIZE) i = CONTROL_POINTS_LUT_SIZE - 1;
+      const float t = f - i;
+      return p->lut[i] + t * (p->lut[i+1] - p->lut[i]);
+    }
+    return control_points_evaluate_exact(p, x);
+}
+
+G_END_DECLS
+
+#endif // MAPPING_PRIVATE_H
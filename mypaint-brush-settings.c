@@ -35,6 +35,17 @@
 
 #include "brushsettings-gen.h"
 
+// FNV-1a, must match cname_hash() in generate.py
+static unsigned int
+cname_hash(const char *cname)
+{
+    unsigned int h = 2166136261u;
+    for (const unsigned char *c = (const unsigned char *)cname; *c; c++) {
+        h = (h ^ *c) * 16777619u;
+    }
+    return h & 0xffffffffu;
+}
+
 const MyPaintBrushSettingInfo *
 mypaint_brush_setting_info(MyPaintBrushSetting id)
 {
@@ -58,10 +69,12 @@ mypaint_brush_setting_info_get_tooltip(const MyPaintBrushSettingInfo *self)
 MyPaintBrushSetting
 mypaint_brush_setting_from_cname(const char *cname)
 {
-    for (int i=0; i<MYPAINT_BRUSH_SETTINGS_COUNT; i++) {
-        MyPaintBrushSetting id = (MyPaintBrushSetting)i;
-        if (strcmp(mypaint_brush_setting_info(id)->cname, cname) == 0) {
-            return id;
+    const unsigned int mask = SETTINGS_CNAME_HASH_SIZE - 1;
+    for (unsigned int slot = cname_hash(cname) & mask;
+         settings_cname_hash_table[slot] >= 0; slot = (slot + 1) & mask) {
+        const int i = settings_cname_hash_table[slot];
+        if (strcmp(settings_info_array[i].cname, cname) == 0) {
+            return (MyPaintBrushSetting)i;
         }
     }
     return (MyPaintBrushSetting)-1;
@@ -90,10 +103,12 @@ mypaint_brush_input_info_get_tooltip(const MyPaintBrushInputInfo *self)
 MyPaintBrushInput
 mypaint_brush_input_from_cname(const char *cname)
 {
-    for (int i=0; i<MYPAINT_BRUSH_INPUTS_COUNT; i++) {
-        MyPaintBrushInput id = (MyPaintBrushInput)i;
-        if (strcmp(mypaint_brush_input_info(id)->cname, cname) == 0) {
-            return id;
+    const unsigned int mask = INPUTS_CNAME_HASH_SIZE - 1;
+    for (unsigned int slot = cname_hash(cname) & mask;
+         inputs_cname_hash_table[slot] >= 0; slot = (slot + 1) & mask) {
+        const int i = inputs_cname_hash_table[slot];
+        if (strcmp(inputs_info_array[i].cname, cname) == 0) {
+            return (MyPaintBrushInput)i;
         }
     }
     return (MyPaintBrushInput)-1;
@@ -18,6 +18,8 @@
  * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
+#include <stddef.h>
+
 #include "mypaint-config.h"
 #include "mypaint-surface.h"
 #include "mypaint-brush-settings.h"
@@ -25,6 +27,25 @@
 G_BEGIN_DECLS
 
 typedef struct MyPaintBrush MyPaintBrush;
+typedef struct MyPaintBrushSettings MyPaintBrushSettings;
+
+/**
+  * MyPaintBrushEvent:
+  *
+  * A motion event for mypaint_brush_stroke_to_events(), with the
+  * same meaning as the arguments of mypaint_brush_stroke_to().
+  */
+typedef struct {
+    float x;
+    float y;
+    float pressure;
+    float xtilt;
+    float ytilt;
+    double dtime;
+    float viewzoom;
+    float viewrotation;
+    float barrel_rotation;
+} MyPaintBrushEvent;
 
 MyPaintBrush *
 mypaint_brush_new(void);
@@ -48,6 +69,22 @@ mypaint_brush_stroke_to(MyPaintBrush *self, MyPaintSurface *surface, float x, fl
                         float pressure, float xtilt, float ytilt, double dtime, float viewzoom,
                         float viewrotation, float barrel_rotation, gboolean linear);
 
+int
+mypaint_brush_stroke_to_events(MyPaintBrush *self, MyPaintSurface *surface,
+                               const MyPaintBrushEvent *events, int events_n,
+                               gboolean linear, gboolean *stroke_splits);
+
+MyPaintBrushSettings *
+mypaint_brush_get_settings(MyPaintBrush *self);
+
+void
+mypaint_brush_set_settings(MyPaintBrush *self, MyPaintBrushSettings *settings);
+
+void
+mypaint_brush_settings_ref(MyPaintBrushSettings *self);
+void
+mypaint_brush_settings_unref(MyPaintBrushSettings *self);
+
 void
 mypaint_brush_set_base_value(MyPaintBrush *self, MyPaintBrushSetting id, float value);
 
@@ -102,6 +139,19 @@ mypaint_brush_get_total_stroke_painting_time(MyPaintBrush *self);
 void
 mypaint_brush_set_print_inputs(MyPaintBrush *self, gboolean enabled);
 
+/* The default output changed when the fast math approximations were added:
+ * dab edges and smudged colors differ by less than 1/255 on average, but
+ * single pixels can be off by much more. Enable precise math to get the
+ * output of earlier versions. */
+void
+mypaint_brush_set_precise_math(MyPaintBrush *self, gboolean enabled);
+
+void
+mypaint_brush_set_event_coalescing(MyPaintBrush *self, gboolean enabled);
+
+int
+mypaint_brush_flush_events(MyPaintBrush *self);
+
 void
 mypaint_brush_from_defaults(MyPaintBrush *self);
 
@@ -109,6 +159,12 @@ mypaint_brush_from_defaults(MyPaintBrush *self);
 gboolean
 mypaint_brush_from_string(MyPaintBrush *self, const char *string);
 
+void *
+mypaint_brush_to_binary(MyPaintBrush *self, size_t *size);
+
+gboolean
+mypaint_brush_from_binary(MyPaintBrush *self, const void *data, size_t size);
+
 
 G_END_DECLS
 
@@ -18,7 +18,9 @@ struct MyPaintFixedTiledSurface {
 
     size_t tile_size; // Size (in bytes) of single tile
     uint16_t *tile_buffer; // Stores tiles in a linear chunk of memory (16bpc RGBA)
-    uint16_t *null_tile; // Single tile that we hand out and ignore writes to
+    uint16_t *null_tiles[MYPAINT_MAX_THREADS]; // Per-worker tiles that we hand out and ignore writes to
+    uint16_t *shared_null_tile; // The same, for the thread painting when it is the only one
+    uint16_t *zero_tile; // Handed out for reading outside of the surface, never written to
     int tiles_width; // width in tiles
     int tiles_height; // height in tiles
     int width; // width in pixels
@@ -28,9 +30,47 @@ struct MyPaintFixedTiledSurface {
 
 void free_simple_tiledsurf(MyPaintSurface *surface);
 
-void reset_null_tile(MyPaintFixedTiledSurface *self)
+// Tile to hand out for a request outside of the surface, or NULL if it cannot be allocated.
+// Worker threads each have their own, and so does the thread painting (thread_id -1).
+// With concurrent painting any number of threads may be painting at the same time,
+// so those get a scratch tile for the duration of the request.
+static uint16_t *
+get_null_tile(MyPaintFixedTiledSurface *self, MyPaintTileRequest *request)
 {
-    memset(self->null_tile, 0, self->tile_size);
+    const int thread_id = request->thread_id;
+    if (request->readonly) {
+        return self->zero_tile;
+    }
+    if (thread_id < 0 || thread_id >= MYPAINT_MAX_THREADS) {
+        if (!mypaint_tiled_surface_get_concurrent_painting(&self->parent)) {
+            if (!self->shared_null_tile) {
+                self->shared_null_tile = (uint16_t *)calloc(1, self->tile_size);
+            }
+            return self->shared_null_tile;
+        }
+        uint16_t *scratch_tile = (uint16_t *)calloc(1, self->tile_size);
+        if (!scratch_tile) {
+            fprintf(stderr, "Warning: unable to allocate a tile outside of the surface\n");
+        }
+        request->context = scratch_tile;
+        return scratch_tile;
+    }
+    if (!self->null_tiles[thread_id]) {
+        self->null_tiles[thread_id] = (uint16_t *)calloc(1, self->tile_size);
+    }
+    return self->null_tiles[thread_id];
+}
+
+static void
+release_null_tile(MyPaintFixedTiledSurface *self, MyPaintTileRequest *request)
+{
+    if (request->context) {
+        free(request->context);
+        request->context = NULL;
+    } else if (request->buffer && request->buffer != self->zero_tile) {
+        // Wipe any changes done to the null tile
+        memset(request->buffer, 0, self->tile_size);
+    }
 }
 
 static void
@@ -42,10 +82,11 @@ tile_request_start(MyPaintTiledSurface *tiled_surface, MyPaintTileRequest *reque
     const int ty = request->ty;
 
     uint16_t *tile_pointer = NULL;
+    request->context = NULL;
 
     if (tx >= self->tiles_width || ty >= self->tiles_height || tx < 0 || ty < 0) {
         // Give it a tile which we will ignore writes to
-        tile_pointer = self->null_tile;
+        tile_pointer = get_null_tile(self, request);
 
     } else {
         // Compute the offset for the tile into our linear memory buffer of tiles
@@ -68,8 +109,7 @@ tile_request_end(MyPaintTiledSurface *tiled_surface, MyPaintTileRequest *request
     const int ty = request->ty;
 
     if (tx >= self->tiles_width || ty >= self->tiles_height || tx < 0 || ty < 0) {
-        // Wipe any changes done to the null tile
-        reset_null_tile(self);
+        release_null_tile(self, request);
     } else {
         // We hand out direct pointers to our buffer, so for the normal case nothing needs to be done
     }
@@ -127,13 +167,16 @@ mypaint_fixed_tiled_surface_new(int width, int height)
 
     self->tile_buffer = buffer;
     self->tile_size = tile_size;
-    self->null_tile = (uint16_t *)malloc(tile_size);
+    memset(self->null_tiles, 0, sizeof(self->null_tiles));
+    self->shared_null_tile = NULL;
+    self->zero_tile = (uint16_t *)calloc(1, tile_size);
     self->tiles_width = tiles_width;
     self->tiles_height = tiles_height;
     self->height = height;
     self->width = width;
 
-    reset_null_tile(self);
+    // Null tiles are never shared between threads writing to them, so tiles can be processed in parallel
+    self->parent.threadsafe_tile_requests = TRUE;
 
     return self;
 }
@@ -145,48 +188,185 @@ void free_simple_tiledsurf(MyPaintSurface *surface)
     mypaint_tiled_surface_destroy(&self->parent);
 
     free(self->tile_buffer);
-    free(self->null_tile);
+    for (int i = 0; i < MYPAINT_MAX_THREADS; i++) {
+        free(self->null_tiles[i]);
+    }
+    free(self->shared_null_tile);
+    free(self->zero_tile);
 
     free(self);
 }
 
 
 
-void
-mypaint_fixed_tiled_surface_read_rgba8(MyPaintFixedTiledSurface *self, unsigned char *out_rgba8)
+// Fix15 channel to 8 bits, rounded. Unpainted pixels of the surface are 0xffff
+// in all channels (see mypaint_fixed_tiled_surface_new) and saturate to 255.
+static inline uint8_t
+fix15_to_8(uint32_t v)
 {
-    if (!self || !out_rgba8) {
-        return;
+    const uint32_t v8 = (v * 255 + (1 << 14)) >> 15;
+    return v8 > 255 ? 255 : (uint8_t)v8;
+}
+
+// Premultiplied fix15 color to straight 8 bits, @scale being 255 / alpha.
+// Colors never exceed their alpha, so transparent pixels come out black.
+static inline uint8_t
+unpremultiply_to_8(uint16_t c, float scale)
+{
+    const int32_t c8 = (int32_t)(c * scale + 0.5f);
+    return c8 > 255 ? 255 : (uint8_t)c8;
+}
+
+/* The kernels convert @n consecutive pixels of a tile row. They have no
+ * per pixel branches or index arithmetic, so that the compiler vectorizes
+ * them (SSE2 on x86-64, NEON on arm64). convert_span() calls them with a
+ * constant @n for most of the span, which GCC also vectorizes at -O2. */
+
+#define CONVERT_BLOCK_PIXELS 16
+
+static inline void
+convert_premultiplied_rgba(const uint16_t *restrict src, uint8_t *restrict dst, int n)
+{
+    for (int i = 0; i < 4 * n; i++) {
+        dst[i] = fix15_to_8(src[i]);
     }
-    const int width = self->width;
-    const int height = self->height;
-    const int tile_size_pixels = self->parent.tile_size;
+}
+
+static inline void
+convert_premultiplied_bgra(const uint16_t *restrict src, uint8_t *restrict dst, int n)
+{
+    for (int i = 0; i < n; i++) {
+        dst[4 * i + 0] = fix15_to_8(src[4 * i + 2]);
+        dst[4 * i + 1] = fix15_to_8(src[4 * i + 1]);
+        dst[4 * i + 2] = fix15_to_8(src[4 * i + 0]);
+        dst[4 * i + 3] = fix15_to_8(src[4 * i + 3]);
+    }
+}
 
-    const size_t rowstride_bytes = (size_t)self->tiles_width * self->tile_size; // bytes per tile row
+static inline void
+convert_straight(const uint16_t *restrict src, uint8_t *restrict dst, int n,
+                 const int r_out, const int b_out)
+{
+    for (int i = 0; i < n; i++) {
+        const uint16_t a = src[4 * i + 3];
+        const float scale = 255.0f / (float)(a + (a == 0));
+        dst[4 * i + r_out] = unpremultiply_to_8(src[4 * i + 0], scale);
+        dst[4 * i + 1] = unpremultiply_to_8(src[4 * i + 1], scale);
+        dst[4 * i + b_out] = unpremultiply_to_8(src[4 * i + 2], scale);
+        dst[4 * i + 3] = fix15_to_8(a);
+    }
+}
 
-    for (int y = 0; y < height; ++y) {
-        const int ty = y / tile_size_pixels;
-        const int y_in_tile = y % tile_size_pixels;
-        for (int x = 0; x < width; ++x) {
-            const int tx = x / tile_size_pixels;
-            const int x_in_tile = x % tile_size_pixels;
+static inline void
+convert_straight_rgba(const uint16_t *restrict src, uint8_t *restrict dst, int n)
+{
+    convert_straight(src, dst, n, 0, 2);
+}
 
-            const size_t x_offset = (size_t)tx * self->tile_size; // bytes
-            const size_t tile_offset_bytes = (size_t)ty * rowstride_bytes + x_offset; // bytes
-            const uint16_t *tile = self->tile_buffer + tile_offset_bytes / sizeof(uint16_t);
+static inline void
+convert_straight_bgra(const uint16_t *restrict src, uint8_t *restrict dst, int n)
+{
+    convert_straight(src, dst, n, 2, 0);
+}
 
-            const size_t pixel_index_in_tile = ((size_t)y_in_tile * (size_t)tile_size_pixels + (size_t)x_in_tile) * 4u;
+#define CONVERT_SPAN(kernel) \
+    for (; i + CONVERT_BLOCK_PIXELS <= n; i += CONVERT_BLOCK_PIXELS) { \
+        kernel(src + 4 * i, dst + 4 * i, CONVERT_BLOCK_PIXELS); \
+    } \
+    kernel(src + 4 * i, dst + 4 * i, n - i)
 
-            const uint16_t r16 = tile[pixel_index_in_tile + 0];
-            const uint16_t g16 = tile[pixel_index_in_tile + 1];
-            const uint16_t b16 = tile[pixel_index_in_tile + 2];
-            const uint16_t a16 = tile[pixel_index_in_tile + 3];
+static void
+convert_span(const uint16_t *src, uint8_t *dst, int n, MyPaintRgba8Format format)
+{
+    int i = 0;
+    switch (format) {
+    case MYPAINT_RGBA8_FORMAT_RGBA_PREMULTIPLIED:
+        CONVERT_SPAN(convert_premultiplied_rgba);
+        break;
+    case MYPAINT_RGBA8_FORMAT_BGRA_PREMULTIPLIED:
+        CONVERT_SPAN(convert_premultiplied_bgra);
+        break;
+    case MYPAINT_RGBA8_FORMAT_RGBA_STRAIGHT:
+        CONVERT_SPAN(convert_straight_rgba);
+        break;
+    case MYPAINT_RGBA8_FORMAT_BGRA_STRAIGHT:
+        CONVERT_SPAN(convert_straight_bgra);
+        break;
+    }
+}
 
-            const size_t out_idx = ((size_t)y * (size_t)width + (size_t)x) * 4u;
-            out_rgba8[out_idx + 0] = (unsigned char)(r16 >> 8);
-            out_rgba8[out_idx + 1] = (unsigned char)(g16 >> 8);
-            out_rgba8[out_idx + 2] = (unsigned char)(b16 >> 8);
-            out_rgba8[out_idx + 3] = (unsigned char)(a16 >> 8);
+#undef CONVERT_SPAN
+
+/**
+ * mypaint_fixed_tiled_surface_read_rgba8_region:
+ * @x: Left edge of the region, in surface pixels
+ * @y: Top edge of the region, in surface pixels
+ * @width: Width of the region
+ * @height: Height of the region
+ * @dst: Destination for the pixel at (@x, @y)
+ * @dst_stride: Bytes between the starts of two rows in @dst
+ * @format: Byte order and alpha mode to write
+ *
+ * Convert a region of the surface to 8 bits per channel, rounding the
+ * 15 bit fixed point values. The region is clipped to the surface and only
+ * the pixels inside of it are written, so the cost is proportional to
+ * the area read. Pass the dirty rectangles from mypaint_surface_end_atomic()
+ * to update a display buffer incrementally.
+ *
+ * Call it between transactions; tiles that are still being processed
+ * are read as they are.
+ */
+void
+mypaint_fixed_tiled_surface_read_rgba8_region(MyPaintFixedTiledSurface *self,
+                                              int x, int y, int width, int height,
+                                              unsigned char *dst, size_t dst_stride,
+                                              MyPaintRgba8Format format)
+{
+    if (!self || !dst) {
+        return;
+    }
+    const int x0 = x > 0 ? x : 0;
+    const int y0 = y > 0 ? y : 0;
+    const int x1 = x + width < self->width ? x + width : self->width;
+    const int y1 = y + height < self->height ? y + height : self->height;
+    if (x0 >= x1 || y0 >= y1) {
+        return;
+    }
+
+    const int tile_size_pixels = self->parent.tile_size;
+    const size_t tile_pixels = (size_t)self->tile_size / (4 * sizeof(uint16_t));
+
+    // Walk the region tile by tile, each tile being a contiguous block of memory
+    for (int ty = y0 / tile_size_pixels; ty * tile_size_pixels < y1; ty++) {
+        const int tile_y = ty * tile_size_pixels;
+        const int row_start = y0 > tile_y ? y0 : tile_y;
+        const int row_end = y1 < tile_y + tile_size_pixels ? y1 : tile_y + tile_size_pixels;
+
+        for (int tx = x0 / tile_size_pixels; tx * tile_size_pixels < x1; tx++) {
+            const int tile_x = tx * tile_size_pixels;
+            const int span_start = x0 > tile_x ? x0 : tile_x;
+            const int span_end = x1 < tile_x + tile_size_pixels ? x1 : tile_x + tile_size_pixels;
+            const int span = span_end - span_start;
+            const uint16_t *tile =
+                self->tile_buffer + ((size_t)ty * self->tiles_width + tx) * tile_pixels * 4;
+
+            for (int py = row_start; py < row_end; py++) {
+                const uint16_t *src =
+                    tile + ((size_t)(py - tile_y) * tile_size_pixels + (span_start - tile_x)) * 4;
+                uint8_t *out = dst + (size_t)(py - y) * dst_stride + (size_t)(span_start - x) * 4;
+                convert_span(src, out, span, format);
+            }
         }
     }
 }
+
+void
+mypaint_fixed_tiled_surface_read_rgba8(MyPaintFixedTiledSurface *self, unsigned char *out_rgba8)
+{
+    if (!self || !out_rgba8) {
+        return;
+    }
+    mypaint_fixed_tiled_surface_read_rgba8_region(self, 0, 0, self->width, self->height,
+                                                  out_rgba8, (size_t)self->width * 4,
+                                                  MYPAINT_RGBA8_FORMAT_RGBA_PREMULTIPLIED);
+}
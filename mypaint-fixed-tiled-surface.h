@@ -29,10 +29,33 @@ mypaint_fixed_tiled_surface_get_height(MyPaintFixedTiledSurface *self);
 MyPaintSurface *
 mypaint_fixed_tiled_surface_interface(MyPaintFixedTiledSurface *self);
 
-/* Read the full surface into a contiguous RGBA8 buffer (row-major, width*height*4 bytes). */
+/**
+ * MyPaintRgba8Format:
+ * @MYPAINT_RGBA8_FORMAT_RGBA_PREMULTIPLIED: R, G, B, A bytes, colors multiplied by alpha
+ * @MYPAINT_RGBA8_FORMAT_BGRA_PREMULTIPLIED: B, G, R, A bytes, colors multiplied by alpha
+ * @MYPAINT_RGBA8_FORMAT_RGBA_STRAIGHT: R, G, B, A bytes, colors not multiplied by alpha
+ * @MYPAINT_RGBA8_FORMAT_BGRA_STRAIGHT: B, G, R, A bytes, colors not multiplied by alpha
+ *
+ * Byte order and alpha mode of the 8 bit pixels written by
+ * mypaint_fixed_tiled_surface_read_rgba8_region().
+ */
+typedef enum {
+    MYPAINT_RGBA8_FORMAT_RGBA_PREMULTIPLIED = 0,
+    MYPAINT_RGBA8_FORMAT_BGRA_PREMULTIPLIED = 1,
+    MYPAINT_RGBA8_FORMAT_RGBA_STRAIGHT = 2,
+    MYPAINT_RGBA8_FORMAT_BGRA_STRAIGHT = 3
+} MyPaintRgba8Format;
+
+/* Read the full surface into a contiguous, premultiplied RGBA8 buffer (row-major, width*height*4 bytes). */
 void
 mypaint_fixed_tiled_surface_read_rgba8(MyPaintFixedTiledSurface *self, unsigned char *out_rgba8);
 
+void
+mypaint_fixed_tiled_surface_read_rgba8_region(MyPaintFixedTiledSurface *self,
+                                              int x, int y, int width, int height,
+                                              unsigned char *dst, size_t dst_stride,
+                                              MyPaintRgba8Format format);
+
 G_END_DECLS
 
 #endif // MYPAINTFIXEDTILEDSURFACE_H
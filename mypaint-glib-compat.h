@@ -27,6 +27,18 @@ typedef gint gboolean;
 /* From $LIBPATH/glib-2.0/include/glibconfig.h */
 typedef unsigned short guint16;
 
+/* From $INCLUDEPATH/glib-2.0/glib/gatomic.h. Other compilers than GCC and
+ * compatible ones get plain, non-atomic operations. */
+#if defined(__GNUC__)
+#define g_atomic_int_get(atomic) __atomic_load_n((atomic), __ATOMIC_SEQ_CST)
+#define g_atomic_int_inc(atomic) ((void)__atomic_fetch_add((atomic), 1, __ATOMIC_SEQ_CST))
+#define g_atomic_int_dec_and_test(atomic) (__atomic_sub_fetch((atomic), 1, __ATOMIC_SEQ_CST) == 0)
+#else
+#define g_atomic_int_get(atomic) (*(atomic))
+#define g_atomic_int_inc(atomic) ((void)(*(atomic))++)
+#define g_atomic_int_dec_and_test(atomic) (--(*(atomic)) == 0)
+#endif
+
 #endif // __G_LIB_H__
 
 #endif // MYPAINTGLIBCOMPAT_H
@@ -20,26 +20,22 @@
 #include "config.h"
 
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
+#include <math.h>
 
 #if MYPAINT_CONFIG_USE_GLIB
 #include <glib.h>
 #endif
 
 #include "mypaint-mapping.h"
+#include "mapping-private.h"
 
 #include "helpers.h"
 
 // user-defined mappings
 // (the curves you can edit in the brush settings)
 
-typedef struct {
-  // a set of control points (stepwise linear)
-  float xvalues[64];
-  float yvalues[64];
-  int n;
-} ControlPoints;
-
 struct MyPaintMapping {
     float base_value; // FIXME: accessed directly from mypaint-brush.c
 
@@ -56,9 +52,7 @@ mypaint_mapping_new(int inputs_)
     MyPaintMapping *self = (MyPaintMapping *)malloc(sizeof(MyPaintMapping));
 
     self->inputs = inputs_;
-    self->pointsList = (ControlPoints *)malloc(sizeof(ControlPoints)*self->inputs);
-    int i = 0;
-    for (i=0; i<self->inputs; i++) self->pointsList[i].n = 0;
+    self->pointsList = (ControlPoints *)calloc(self->inputs, sizeof(ControlPoints));
 
     self->inputs_used = 0;
     self->base_value = 0;
@@ -66,9 +60,27 @@ mypaint_mapping_new(int inputs_)
     return self;
 }
 
+MyPaintMapping *
+mypaint_mapping_copy(const MyPaintMapping *self)
+{
+    MyPaintMapping *copy = (MyPaintMapping *)malloc(sizeof(MyPaintMapping));
+    *copy = *self;
+    copy->pointsList = (ControlPoints *)malloc(sizeof(ControlPoints)*self->inputs);
+    memcpy(copy->pointsList, self->pointsList, sizeof(ControlPoints)*self->inputs);
+    for (int i=0; i<self->inputs; i++) {
+      ControlPoints *p = copy->pointsList + i;
+      if (p->lut) {
+        p->lut = (float *)malloc((CONTROL_POINTS_LUT_SIZE+1) * sizeof(float));
+        memcpy(p->lut, self->pointsList[i].lut, (CONTROL_POINTS_LUT_SIZE+1) * sizeof(float));
+      }
+    }
+    return copy;
+}
+
 void
 mypaint_mapping_free(MyPaintMapping *self)
 {
+    for (int i=0; i<self->inputs; i++) free(self->pointsList[i].lut);
     free(self->pointsList);
     free(self);
 }
@@ -83,6 +95,76 @@ void mypaint_mapping_set_base_value(MyPaintMapping *self, float value)
     self->base_value = value;
 }
 
+// Largest deviation of a lookup table from the exact curve,
+// relative to the range of the curve's y values
+#define LUT_MAX_ERROR (1.0f/4096)
+
+// (Re)build the lookup table of a curve, or drop it if the curve cannot
+// be tabulated within LUT_MAX_ERROR. Both the curve and its table are
+// piecewise linear, so their difference is largest at a control point
+// or a table entry; the entries are exact, so checking the control
+// points is enough.
+static void
+control_points_update_lut(ControlPoints *p)
+{
+    gboolean ok = p->n >= 2;
+    float ymin = 0, ymax = 0;
+    if (ok) {
+      ymin = ymax = p->yvalues[0];
+      for (int i=0; i<p->n; i++) {
+        if (!isfinite(p->xvalues[i]) || !isfinite(p->yvalues[i])) ok = FALSE;
+        ymin = MIN(ymin, p->yvalues[i]);
+        ymax = MAX(ymax, p->yvalues[i]);
+        if (i == 0) continue;
+        // unordered points, or a step between two points at the same x
+        if (p->xvalues[i] < p->xvalues[i-1]) ok = FALSE;
+        if (p->xvalues[i] == p->xvalues[i-1] && p->yvalues[i] != p->yvalues[i-1]) ok = FALSE;
+      }
+      ok = ok && p->xvalues[p->n-1] > p->xvalues[0];
+    }
+    if (!ok) {
+      free(p->lut);
+      p->lut = NULL;
+      return;
+    }
+
+    float *lut = p->lut;
+    p->lut = NULL; // sample the exact curve
+    if (!lut) lut = (float *)malloc((CONTROL_POINTS_LUT_SIZE+1) * sizeof(float));
+
+    const float x0 = p->xvalues[0];
+    const float x1 = p->xvalues[p->n-1];
+    // Same as control_points_evaluate_exact() for each entry, but the
+    // x are increasing, so the segment search can continue where the
+    // previous entry left off
+    int seg = 1;
+    for (int i=0; i<=CONTROL_POINTS_LUT_SIZE; i++) {
+      const float x = (i == CONTROL_POINTS_LUT_SIZE) ? x1 : x0 + (x1 - x0) * i / CONTROL_POINTS_LUT_SIZE;
+      while (seg < p->n-1 && x > p->xvalues[seg]) seg++;
+      const float sx0 = p->xvalues[seg-1], sy0 = p->yvalues[seg-1];
+      const float sx1 = p->xvalues[seg], sy1 = p->yvalues[seg];
+      if (sx0 == sx1 || sy0 == sy1) {
+        lut[i] = sy0;
+      } else {
+        lut[i] = (sy1*(x - sx0) + sy0*(sx1 - x)) / (sx1 - sx0);
+      }
+    }
+    p->lut_x0 = x0;
+    p->lut_x1 = x1;
+    p->lut_scale = CONTROL_POINTS_LUT_SIZE / (x1 - x0);
+    p->lut = lut;
+
+    const float max_error = (ymax - ymin) * LUT_MAX_ERROR;
+    for (int i=0; i<p->n; i++) {
+      const float x = p->xvalues[i];
+      if (fabsf(control_points_evaluate(p, x) - control_points_evaluate_exact(p, x)) > max_error) {
+        free(p->lut);
+        p->lut = NULL;
+        return;
+      }
+    }
+}
+
 void mypaint_mapping_set_n (MyPaintMapping * self, int input, int n)
 {
     assert (input >= 0 && input < self->inputs);
@@ -96,6 +178,29 @@ void mypaint_mapping_set_n (MyPaintMapping * self, int input, int n)
     assert(self->inputs_used <= self->inputs);
 
     p->n = n;
+    control_points_update_lut(p);
+}
+
+
+void mypaint_mapping_set_points (MyPaintMapping * self, int input, int n, const float *points)
+{
+    assert (input >= 0 && input < self->inputs);
+    assert (n >= 0 && n <= 64);
+    assert (n != 1);
+    ControlPoints * p = self->pointsList + input;
+
+    if (n != 0 && p->n == 0) self->inputs_used++;
+    if (n == 0 && p->n != 0) self->inputs_used--;
+
+    for (int i=0; i<n; i++) {
+      p->xvalues[i] = points[2*i];
+      p->yvalues[i] = points[2*i+1];
+      if (i > 0) {
+        assert (p->xvalues[i] >= p->xvalues[i-1]);
+      }
+    }
+    p->n = n;
+    control_points_update_lut(p);
 }
 
 
@@ -119,6 +224,7 @@ void mypaint_mapping_set_point (MyPaintMapping * self, int input, int index, flo
 
     p->xvalues[index] = x;
     p->yvalues[index] = y;
+    control_points_update_lut(p);
 }
 
 void mypaint_mapping_get_point (MyPaintMapping * self, int input, int index, float *x, float *y)
@@ -156,37 +262,20 @@ float mypaint_mapping_calculate (MyPaintMapping * self, float * data)
       ControlPoints * p = self->pointsList + j;
 
       if (p->n) {
-        float x, y;
-        x = data[j];
-
-        // find the segment with the slope that we need to use
-        float x0, y0, x1, y1;
-        x0 = p->xvalues[0];
-        y0 = p->yvalues[0];
-        x1 = p->xvalues[1];
-        y1 = p->yvalues[1];
-
-        int i;
-        for (i=2; i<p->n && x>x1; i++) {
-          x0 = x1;
-          y0 = y1;
-          x1 = p->xvalues[i];
-          y1 = p->yvalues[i];
-        }
-
-        if (x0 == x1 || y0 == y1) {
-          y = y0;
-        } else {
-          // linear interpolation
-          y = (y1*(x - x0) + y0*(x1 - x)) / (x1 - x0);
-        }
-
-        result += y;
+        result += control_points_evaluate(p, data[j]);
       }
     }
     return result;
 }
 
+const ControlPoints *
+mypaint_mapping_get_curve(MyPaintMapping *self, int input)
+{
+    assert (input >= 0 && input < self->inputs);
+    ControlPoints * p = self->pointsList + input;
+    return p->n ? p : NULL;
+}
+
 // used in mypaint itself for the global pressure mapping
 float mypaint_mapping_calculate_single_input (MyPaintMapping * self, float input)
 {
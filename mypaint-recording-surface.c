@@ -0,0 +1,486 @@
+/* libmypaint - The MyPaint Brush Library
+ * Copyright (C) 2012 Jon Nordby <jononor@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <assert.h>
+
+#include "mypaint-recording-surface.h"
+
+/* Log format
+ *
+ * A header of two 32 bit words, the magic number and the format version,
+ * followed by records in native byte order. Each record starts with a
+ * tag byte:
+ *
+ *   RECORD_DAB:          bitmask of the dab arguments that differ from the
+ *                        previous dab (32 bit), then the new values of those
+ *                        arguments (floats, in the order of #MyPaintDabs)
+ *   RECORD_GET_COLOR:    x, y, radius, paint, then the r, g, b, a that
+ *                        the target surface returned (floats)
+ *   RECORD_BEGIN_ATOMIC: nothing
+ *   RECORD_END_ATOMIC:   nothing
+ *
+ * Consecutive dabs of a stroke share most of their arguments, so a dab
+ * typically takes 20-35 bytes instead of the 68 of its arguments.
+ * Values are not aligned, they are read and written with memcpy().
+ */
+#define RECORDING_MAGIC 0x5250594dU // "MYPR" in little endian
+#define RECORDING_VERSION 1
+
+#define DAB_FIELDS 17 // arguments of a dab, see MyPaintDabs
+#define GET_COLOR_FIELDS 8
+
+enum {
+    RECORD_DAB = 'd',
+    RECORD_GET_COLOR = 'c',
+    RECORD_BEGIN_ATOMIC = 'b',
+    RECORD_END_ATOMIC = 'e'
+};
+
+struct MyPaintRecordingSurface {
+    MyPaintSurface parent;
+    MyPaintSurface *target; // can be NULL
+
+    unsigned char *data;
+    size_t size;
+    size_t allocated;
+    float last_dab[DAB_FIELDS]; // for the delta encoding of dabs
+    int num_dabs;
+};
+
+static unsigned char *
+recording_reserve(MyPaintRecordingSurface *self, size_t bytes)
+{
+    if (self->size + bytes > self->allocated) {
+        size_t allocated = self->allocated ? self->allocated : 4096;
+        while (self->size + bytes > allocated) {
+            allocated *= 2;
+        }
+        self->data = (unsigned char *)realloc(self->data, allocated);
+        self->allocated = allocated;
+    }
+    unsigned char *p = self->data + self->size;
+    self->size += bytes;
+    return p;
+}
+
+static void
+record_tag(MyPaintRecordingSurface *self, unsigned char tag)
+{
+    *recording_reserve(self, 1) = tag;
+}
+
+static void
+record_dab(MyPaintRecordingSurface *self, const float *dab)
+{
+    uint32_t changed = 0;
+    int changed_n = 0;
+    for (int i = 0; i < DAB_FIELDS; i++) {
+        // compare the bits, so that NaN and -0.0 are recorded exactly
+        if (memcmp(&dab[i], &self->last_dab[i], sizeof(float)) != 0) {
+            changed |= 1u << i;
+            changed_n++;
+        }
+    }
+
+    unsigned char *p = recording_reserve(self, 1 + sizeof(changed) + changed_n * sizeof(float));
+    *p++ = RECORD_DAB;
+    memcpy(p, &changed, sizeof(changed));
+    p += sizeof(changed);
+    for (int i = 0; i < DAB_FIELDS; i++) {
+        if (changed & (1u << i)) {
+            memcpy(p, &dab[i], sizeof(float));
+            p += sizeof(float);
+        }
+    }
+    memcpy(self->last_dab, dab, sizeof(self->last_dab));
+    self->num_dabs++;
+}
+
+static int
+recording_draw_dab(MyPaintSurface *surface, float x, float y, float radius,
+                   float color_r, float color_g, float color_b,
+                   float opaque, float hardness, float softness, float color_a,
+                   float aspect_ratio, float angle, float lock_alpha,
+                   float colorize, float posterize, float posterize_num, float paint)
+{
+    MyPaintRecordingSurface *self = (MyPaintRecordingSurface *)surface;
+    const float dab[DAB_FIELDS] = {
+        x, y, radius, color_r, color_g, color_b, opaque, hardness, softness, color_a,
+        aspect_ratio, angle, lock_alpha, colorize, posterize, posterize_num, paint
+    };
+    record_dab(self, dab);
+
+    if (!self->target) {
+        return 1;
+    }
+    return mypaint_surface_draw_dab(self->target, x, y, radius, color_r, color_g, color_b,
+                                    opaque, hardness, softness, color_a, aspect_ratio, angle,
+                                    lock_alpha, colorize, posterize, posterize_num, paint);
+}
+
+static int
+recording_draw_dabs(MyPaintSurface *surface, const MyPaintDabs *dabs)
+{
+    MyPaintRecordingSurface *self = (MyPaintRecordingSurface *)surface;
+    for (int i = 0; i < dabs->num_dabs; i++) {
+        const float dab[DAB_FIELDS] = {
+            dabs->x[i], dabs->y[i], dabs->radius[i],
+            dabs->color_r[i], dabs->color_g[i], dabs->color_b[i],
+            dabs->opaque[i], dabs->hardness[i], dabs->softness[i], dabs->alpha_eraser[i],
+            dabs->aspect_ratio[i], dabs->angle[i], dabs->lock_alpha[i], dabs->colorize[i],
+            dabs->posterize[i], dabs->posterize_num[i], dabs->paint[i]
+        };
+        record_dab(self, dab);
+    }
+
+    if (!self->target) {
+        return dabs->num_dabs;
+    }
+    return mypaint_surface_draw_dabs(self->target, dabs);
+}
+
+static void
+recording_get_color(MyPaintSurface *surface, float x, float y, float radius,
+                    float *color_r, float *color_g, float *color_b, float *color_a,
+                    float paint)
+{
+    MyPaintRecordingSurface *self = (MyPaintRecordingSurface *)surface;
+    if (self->target) {
+        mypaint_surface_get_color(self->target, x, y, radius, color_r, color_g, color_b, color_a, paint);
+    } else {
+        *color_r = *color_g = *color_b = *color_a = 0.0f;
+    }
+
+    const float values[GET_COLOR_FIELDS] = {
+        x, y, radius, paint, *color_r, *color_g, *color_b, *color_a
+    };
+    unsigned char *p = recording_reserve(self, 1 + sizeof(values));
+    *p++ = RECORD_GET_COLOR;
+    memcpy(p, values, sizeof(values));
+}
+
+static void
+recording_begin_atomic(MyPaintSurface *surface)
+{
+    MyPaintRecordingSurface *self = (MyPaintRecordingSurface *)surface;
+    record_tag(self, RECORD_BEGIN_ATOMIC);
+    if (self->target) {
+        mypaint_surface_begin_atomic(self->target);
+    }
+}
+
+static void
+recording_end_atomic(MyPaintSurface *surface, MyPaintRectangles *roi)
+{
+    MyPaintRecordingSurface *self = (MyPaintRecordingSurface *)surface;
+    record_tag(self, RECORD_END_ATOMIC);
+    if (self->target) {
+        mypaint_surface_end_atomic(self->target, roi);
+    } else if (roi) {
+        roi->num_rectangles = 0;
+    }
+}
+
+static void
+recording_save_png(MyPaintSurface *surface, const char *path, int x, int y, int width, int height)
+{
+    MyPaintRecordingSurface *self = (MyPaintRecordingSurface *)surface;
+    if (self->target) {
+        mypaint_surface_save_png(self->target, path, x, y, width, height);
+    }
+}
+
+static void
+free_recording_surface(MyPaintSurface *surface)
+{
+    MyPaintRecordingSurface *self = (MyPaintRecordingSurface *)surface;
+    if (self->target) {
+        mypaint_surface_unref(self->target);
+    }
+    free(self->data);
+    free(self);
+}
+
+/**
+ * mypaint_recording_surface_new:
+ * @target: (allow-none): Surface that everything is passed on to, or NULL
+ *
+ * Create a surface that records all calls into a log. With a @target,
+ * color picks return what the target holds; without one, they return
+ * transparent black and the dabs are only recorded.
+ */
+MyPaintRecordingSurface *
+mypaint_recording_surface_new(MyPaintSurface *target)
+{
+    MyPaintRecordingSurface *self = (MyPaintRecordingSurface *)malloc(sizeof(MyPaintRecordingSurface));
+
+    mypaint_surface_init(&self->parent);
+    self->parent.draw_dab = recording_draw_dab;
+    self->parent.draw_dabs = recording_draw_dabs;
+    self->parent.get_color = recording_get_color;
+    self->parent.begin_atomic = recording_begin_atomic;
+    self->parent.end_atomic = recording_end_atomic;
+    self->parent.destroy = free_recording_surface;
+    self->parent.save_png = recording_save_png;
+
+    self->target = target;
+    if (target) {
+        mypaint_surface_ref(target);
+    }
+    self->data = NULL;
+    self->size = 0;
+    self->allocated = 0;
+    mypaint_recording_surface_clear(self);
+
+    return self;
+}
+
+MyPaintSurface *
+mypaint_recording_surface_interface(MyPaintRecordingSurface *self)
+{
+    return (MyPaintSurface *)self;
+}
+
+/**
+ * mypaint_recording_surface_get_data: (skip)
+ * @size: (out): Location to return the size of the log in bytes
+ *
+ * The log recorded so far, for mypaint_recording_replay(). It is owned by
+ * the surface and valid until the next call on the surface.
+ */
+const void *
+mypaint_recording_surface_get_data(MyPaintRecordingSurface *self, size_t *size)
+{
+    *size = self->size;
+    return self->data;
+}
+
+/**
+ * mypaint_recording_surface_get_num_dabs:
+ *
+ * Number of dabs in the log.
+ */
+int
+mypaint_recording_surface_get_num_dabs(MyPaintRecordingSurface *self)
+{
+    return self->num_dabs;
+}
+
+/**
+ * mypaint_recording_surface_clear:
+ *
+ * Start a new, empty log. The target surface is not changed.
+ */
+void
+mypaint_recording_surface_clear(MyPaintRecordingSurface *self)
+{
+    const uint32_t header[2] = {RECORDING_MAGIC, RECORDING_VERSION};
+    self->size = 0;
+    memcpy(recording_reserve(self, sizeof(header)), header, sizeof(header));
+    memset(self->last_dab, 0, sizeof(self->last_dab));
+    self->num_dabs = 0;
+}
+
+// Dabs are replayed in batches, through mypaint_surface_draw_dabs()
+#define REPLAY_BATCH_SIZE 256
+
+typedef struct {
+    float fields[DAB_FIELDS][REPLAY_BATCH_SIZE];
+    MyPaintDabs dabs;
+} ReplayBatch;
+
+static void
+replay_batch_init(ReplayBatch *batch)
+{
+    MyPaintDabs *dabs = &batch->dabs;
+    dabs->num_dabs = 0;
+    dabs->x = batch->fields[0];
+    dabs->y = batch->fields[1];
+    dabs->radius = batch->fields[2];
+    dabs->color_r = batch->fields[3];
+    dabs->color_g = batch->fields[4];
+    dabs->color_b = batch->fields[5];
+    dabs->opaque = batch->fields[6];
+    dabs->hardness = batch->fields[7];
+    dabs->softness = batch->fields[8];
+    dabs->alpha_eraser = batch->fields[9];
+    dabs->aspect_ratio = batch->fields[10];
+    dabs->angle = batch->fields[11];
+    dabs->lock_alpha = batch->fields[12];
+    dabs->colorize = batch->fields[13];
+    dabs->posterize = batch->fields[14];
+    dabs->posterize_num = batch->fields[15];
+    dabs->paint = batch->fields[16];
+}
+
+static void
+replay_batch_flush(ReplayBatch *batch, MyPaintSurface *surface)
+{
+    if (batch->dabs.num_dabs) {
+        mypaint_surface_draw_dabs(surface, &batch->dabs);
+        batch->dabs.num_dabs = 0;
+    }
+}
+
+// Check the whole log before replaying any of it
+static int
+recording_count_dabs(const unsigned char *data, size_t size)
+{
+    uint32_t header[2];
+    if (size < sizeof(header)) {
+        return -1;
+    }
+    memcpy(header, data, sizeof(header));
+    if (header[0] != RECORDING_MAGIC || header[1] != RECORDING_VERSION) {
+        return -1;
+    }
+
+    int num_dabs = 0;
+    const unsigned char *p = data + sizeof(header);
+    const unsigned char *end = data + size;
+    while (p < end) {
+        const unsigned char tag = *p++;
+        if (tag == RECORD_DAB) {
+            uint32_t changed;
+            if ((size_t)(end - p) < sizeof(changed)) {
+                return -1;
+            }
+            memcpy(&changed, p, sizeof(changed));
+            p += sizeof(changed);
+            if (changed >> DAB_FIELDS) {
+                return -1;
+            }
+            int changed_n = 0;
+            for (int i = 0; i < DAB_FIELDS; i++) {
+                changed_n += (changed >> i) & 1;
+            }
+            if ((size_t)(end - p) < changed_n * sizeof(float)) {
+                return -1;
+            }
+            p += changed_n * sizeof(float);
+            num_dabs++;
+        } else if (tag == RECORD_GET_COLOR) {
+            if ((size_t)(end - p) < GET_COLOR_FIELDS * sizeof(float)) {
+                return -1;
+            }
+            p += GET_COLOR_FIELDS * sizeof(float);
+        } else if (tag != RECORD_BEGIN_ATOMIC && tag != RECORD_END_ATOMIC) {
+            return -1;
+        }
+    }
+    return num_dabs;
+}
+
+/**
+ * mypaint_recording_replay: (skip)
+ * @data: A log from mypaint_recording_surface_get_data()
+ * @size: Size of @data in bytes
+ * @surface: Surface to draw the dabs on
+ * @scale: Factor for the position and radius of the dabs, to replay at
+ * a different resolution
+ * @merge_atomic: Replay all dabs in a single atomic operation instead of
+ * the recorded ones
+ *
+ * Draw the dabs of a log onto @surface. Color picks are not repeated, the
+ * recorded dabs already contain their results.
+ *
+ * A #MyPaintTiledSurface only renders the dabs at the end of an atomic
+ * operation, binned by tile, processing tiles in parallel. Since only the
+ * order of the dabs within each tile matters, @merge_atomic gives the
+ * same pixels with a single parallel pass over all touched tiles, instead
+ * of one pass with a synchronization point per recorded event.
+ *
+ * Returns: the number of dabs replayed, or -1 if the log is malformed,
+ * in which case nothing is drawn.
+ */
+int
+mypaint_recording_replay(const void *data, size_t size, MyPaintSurface *surface,
+                         float scale, gboolean merge_atomic)
+{
+    const int num_dabs = recording_count_dabs((const unsigned char *)data, size);
+    if (num_dabs < 0) {
+        fprintf(stderr, "Error: Malformed dab recording\n");
+        return -1;
+    }
+
+    ReplayBatch *batch = (ReplayBatch *)malloc(sizeof(ReplayBatch));
+    replay_batch_init(batch);
+    float dab[DAB_FIELDS] = {0};
+
+    if (merge_atomic) {
+        mypaint_surface_begin_atomic(surface);
+    }
+    const unsigned char *p = (const unsigned char *)data + 2 * sizeof(uint32_t);
+    const unsigned char *end = (const unsigned char *)data + size;
+    while (p < end) {
+        const unsigned char tag = *p++;
+        switch (tag) {
+        case RECORD_DAB: {
+            uint32_t changed;
+            memcpy(&changed, p, sizeof(changed));
+            p += sizeof(changed);
+            for (int i = 0; i < DAB_FIELDS; i++) {
+                if (changed & (1u << i)) {
+                    memcpy(&dab[i], p, sizeof(float));
+                    p += sizeof(float);
+                }
+            }
+            const int n = batch->dabs.num_dabs++;
+            for (int i = 0; i < DAB_FIELDS; i++) {
+                batch->fields[i][n] = dab[i];
+            }
+            // x, y and radius
+            for (int i = 0; i < 3; i++) {
+                batch->fields[i][n] *= scale;
+            }
+            if (batch->dabs.num_dabs == REPLAY_BATCH_SIZE) {
+                replay_batch_flush(batch, surface);
+            }
+            break;
+        }
+        case RECORD_GET_COLOR:
+            p += GET_COLOR_FIELDS * sizeof(float);
+            break;
+        case RECORD_BEGIN_ATOMIC:
+            if (!merge_atomic) {
+                replay_batch_flush(batch, surface);
+                mypaint_surface_begin_atomic(surface);
+            }
+            break;
+        case RECORD_END_ATOMIC:
+            if (!merge_atomic) {
+                replay_batch_flush(batch, surface);
+                mypaint_surface_end_atomic(surface, NULL);
+            }
+            break;
+        default:
+            assert(0); // checked by recording_count_dabs()
+        }
+    }
+    replay_batch_flush(batch, surface);
+    if (merge_atomic) {
+        mypaint_surface_end_atomic(surface, NULL);
+    }
+
+    free(batch);
+    return num_dabs;
+}
@@ -0,0 +1,43 @@
+#ifndef MYPAINTRECORDINGSURFACE_H
+#define MYPAINTRECORDINGSURFACE_H
+
+#include <stddef.h>
+
+#include "mypaint-config.h"
+#include "mypaint-glib-compat.h"
+#include "mypaint-surface.h"
+
+G_BEGIN_DECLS
+
+/**
+ * MyPaintRecordingSurface:
+ *
+ * #MyPaintSurface that records every dab, color pick and atomic boundary
+ * into a compact binary log, and passes them on to a target surface.
+ * The log can be replayed into any surface with mypaint_recording_replay(),
+ * without running the brush engine again.
+ */
+typedef struct MyPaintRecordingSurface MyPaintRecordingSurface;
+
+MyPaintRecordingSurface *
+mypaint_recording_surface_new(MyPaintSurface *target);
+
+MyPaintSurface *
+mypaint_recording_surface_interface(MyPaintRecordingSurface *self);
+
+const void *
+mypaint_recording_surface_get_data(MyPaintRecordingSurface *self, size_t *size);
+
+int
+mypaint_recording_surface_get_num_dabs(MyPaintRecordingSurface *self);
+
+void
+mypaint_recording_surface_clear(MyPaintRecordingSurface *self);
+
+int
+mypaint_recording_replay(const void *data, size_t size, MyPaintSurface *surface,
+                         float scale, gboolean merge_atomic);
+
+G_END_DECLS
+
+#endif // MYPAINTRECORDINGSURFACE_H
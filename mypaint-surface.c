@@ -18,6 +18,7 @@
 #include "config.h"
 
 #include <assert.h>
+#include <stddef.h>
 
 #include "mypaint-surface.h"
 
@@ -44,6 +45,34 @@ mypaint_surface_draw_dab(MyPaintSurface *self,
                    lock_alpha, colorize, posterize, posterize_num, paint);
 }
 
+/**
+ * mypaint_surface_draw_dabs:
+ * @dabs: The dabs to draw, in order.
+ *
+ * Draw a batch of dabs onto the surface, with the same result as calling
+ * mypaint_surface_draw_dab() for each of them. Surfaces that do not implement
+ * the draw_dabs vfunc get them one by one.
+ *
+ * Returns: the number of dabs that modified the surface
+ */
+int
+mypaint_surface_draw_dabs(MyPaintSurface *self, const MyPaintDabs *dabs)
+{
+    if (self->draw_dabs) {
+        return self->draw_dabs(self, dabs);
+    }
+
+    int modified = 0;
+    for (int i = 0; i < dabs->num_dabs; i++) {
+        modified += mypaint_surface_draw_dab(self, dabs->x[i], dabs->y[i], dabs->radius[i],
+                                             dabs->color_r[i], dabs->color_g[i], dabs->color_b[i],
+                                             dabs->opaque[i], dabs->hardness[i], dabs->softness[i],
+                                             dabs->alpha_eraser[i], dabs->aspect_ratio[i], dabs->angle[i],
+                                             dabs->lock_alpha[i], dabs->colorize[i], dabs->posterize[i],
+                                             dabs->posterize_num[i], dabs->paint[i]) ? 1 : 0;
+    }
+    return modified;
+}
 
 void
 mypaint_surface_get_color(MyPaintSurface *self,
@@ -68,6 +97,7 @@ void
 mypaint_surface_init(MyPaintSurface *self)
 {
     self->refcount = 1;
+    self->draw_dabs = NULL;
 }
 
 /**
@@ -45,6 +45,37 @@ typedef int (*MyPaintSurfaceDrawDabFunction) (MyPaintSurface *self,
                        float posterize_num,
                        float paint);
 
+/**
+  * MyPaintDabs:
+  * @num_dabs: Number of dabs, the length of each of the arrays.
+  *
+  * A batch of dabs in struct-of-arrays layout, for mypaint_surface_draw_dabs().
+  * Each array holds one of the arguments of mypaint_surface_draw_dab(), with
+  * alpha_eraser as @alpha_eraser, for every dab in the batch.
+  */
+typedef struct {
+    int num_dabs;
+    float *x;
+    float *y;
+    float *radius;
+    float *color_r;
+    float *color_g;
+    float *color_b;
+    float *opaque;
+    float *hardness;
+    float *softness;
+    float *alpha_eraser;
+    float *aspect_ratio;
+    float *angle;
+    float *lock_alpha;
+    float *colorize;
+    float *posterize;
+    float *posterize_num;
+    float *paint;
+} MyPaintDabs;
+
+typedef int (*MyPaintSurfaceDrawDabsFunction) (MyPaintSurface *self, const MyPaintDabs *dabs);
+
 typedef void (*MyPaintSurfaceDestroyFunction) (MyPaintSurface *self);
 
 typedef void (*MyPaintSurfaceSavePngFunction) (MyPaintSurface *self, const char *path, int x, int y, int width, int height);
@@ -67,6 +98,7 @@ struct MyPaintSurface {
     MyPaintSurfaceDestroyFunction destroy;
     MyPaintSurfaceSavePngFunction save_png;
     int refcount;
+    MyPaintSurfaceDrawDabsFunction draw_dabs; // Optional, see mypaint_surface_draw_dabs()
 };
 
 /**
@@ -90,6 +122,9 @@ mypaint_surface_draw_dab(MyPaintSurface *self,
                        );
 
 
+int
+mypaint_surface_draw_dabs(MyPaintSurface *self, const MyPaintDabs *dabs);
+
 void
 mypaint_surface_get_color(MyPaintSurface *self,
                         float x, float y,
@@ -26,14 +26,237 @@
 #include <omp.h>
 #endif
 
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
 #include "mypaint-config.h"
 #include "mypaint-tiled-surface.h"
 #include "tiled-surface-private.h"
 #include "helpers.h"
 #include "brushmodes.h"
 #include "operationqueue.h"
+#include "tilescheduler.h"
+#include "trace.h"
+
+// Below this many dirty tiles, end_atomic does not wake the worker threads
+#define DEFAULT_MIN_BATCH_SIZE 4
+
+gboolean process_tile(MyPaintTiledSurface *self, int tx, int ty);
+
+/* Lets any number of threads paint on a surface at the same time, while
+ * beginning and ending a transaction gets the surface to itself. */
+struct TransactionLock {
+#ifdef HAVE_PTHREAD
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    int painters;          // threads in draw_dab() or get_color()
+    int exclusive_waiting; // threads waiting to begin or end a transaction
+    gboolean exclusive;
+    int transactions;      // transactions begun and not yet ended, by any thread
+    pthread_mutex_t bboxes_mutex;
+#else
+    int unused;
+#endif
+};
+
+static void
+painting_begin(MyPaintTiledSurface *self)
+{
+#ifdef HAVE_PTHREAD
+    TransactionLock *lock = self->transaction_lock;
+    if (!lock) return;
+    pthread_mutex_lock(&lock->mutex);
+    // Let waiting transactions go first, or a steady stream of dabs would hold them off
+    while (lock->exclusive || lock->exclusive_waiting) {
+        pthread_cond_wait(&lock->cond, &lock->mutex);
+    }
+    lock->painters++;
+    pthread_mutex_unlock(&lock->mutex);
+#endif
+}
+
+static void
+painting_end(MyPaintTiledSurface *self)
+{
+#ifdef HAVE_PTHREAD
+    TransactionLock *lock = self->transaction_lock;
+    if (!lock) return;
+    pthread_mutex_lock(&lock->mutex);
+    if (--lock->painters == 0) {
+        pthread_cond_broadcast(&lock->cond);
+    }
+    pthread_mutex_unlock(&lock->mutex);
+#endif
+}
+
+static void
+transaction_lock(MyPaintTiledSurface *self)
+{
+#ifdef HAVE_PTHREAD
+    TransactionLock *lock = self->transaction_lock;
+    if (!lock) return;
+    pthread_mutex_lock(&lock->mutex);
+    lock->exclusive_waiting++;
+    while (lock->exclusive || lock->painters) {
+        pthread_cond_wait(&lock->cond, &lock->mutex);
+    }
+    lock->exclusive_waiting--;
+    lock->exclusive = TRUE;
+    pthread_mutex_unlock(&lock->mutex);
+#endif
+}
+
+static void
+transaction_unlock(MyPaintTiledSurface *self)
+{
+#ifdef HAVE_PTHREAD
+    TransactionLock *lock = self->transaction_lock;
+    if (!lock) return;
+    pthread_mutex_lock(&lock->mutex);
+    lock->exclusive = FALSE;
+    pthread_cond_broadcast(&lock->cond);
+    pthread_mutex_unlock(&lock->mutex);
+#endif
+}
+
+/* Count the transactions that are open at the same time, which must
+ * be done while holding the lock exclusively. */
+static void
+transaction_opened(MyPaintTiledSurface *self)
+{
+#ifdef HAVE_PTHREAD
+    if (self->transaction_lock) self->transaction_lock->transactions++;
+#endif
+}
+
+/* Returns TRUE if the bounding boxes can be cleared, because no other
+ * painter is in the middle of a transaction that has dirtied them. */
+static gboolean
+transaction_closed(MyPaintTiledSurface *self)
+{
+#ifdef HAVE_PTHREAD
+    TransactionLock *lock = self->transaction_lock;
+    if (!lock) return FALSE;
+    if (lock->transactions > 0) lock->transactions--;
+    return lock->transactions == 0;
+#else
+    return FALSE;
+#endif
+}
+
+static void
+transaction_lock_free(TransactionLock *lock)
+{
+    if (!lock) return;
+#ifdef HAVE_PTHREAD
+    pthread_mutex_destroy(&lock->mutex);
+    pthread_cond_destroy(&lock->cond);
+    pthread_mutex_destroy(&lock->bboxes_mutex);
+#endif
+    free(lock);
+}
 
-void process_tile(MyPaintTiledSurface *self, int tx, int ty);
+static inline void
+bboxes_lock(MyPaintTiledSurface *self)
+{
+#ifdef HAVE_PTHREAD
+    if (self->transaction_lock) pthread_mutex_lock(&self->transaction_lock->bboxes_mutex);
+#endif
+}
+
+static inline void
+bboxes_unlock(MyPaintTiledSurface *self)
+{
+#ifdef HAVE_PTHREAD
+    if (self->transaction_lock) pthread_mutex_unlock(&self->transaction_lock->bboxes_mutex);
+#endif
+}
+
+/* Counters of a surface, see mypaint_tiled_surface_get_stats().
+ * Each tile worker adds to its own slot, padded so that the workers do not share
+ * cache lines. Other threads count into a local struct and add it to the shared
+ * slot once per call, under the mutex. */
+typedef struct {
+    MyPaintTiledSurfaceStats stats;
+    char padding[64];
+} StatsSlot;
+
+struct TiledSurfaceStats {
+    StatsSlot workers[MYPAINT_MAX_THREADS];
+    StatsSlot shared;
+#ifdef HAVE_PTHREAD
+    pthread_mutex_t mutex;
+#endif
+};
+
+static TiledSurfaceStats *
+tiled_surface_stats_new(void)
+{
+    TiledSurfaceStats *stats = (TiledSurfaceStats *)calloc(1, sizeof(TiledSurfaceStats));
+#ifdef HAVE_PTHREAD
+    pthread_mutex_init(&stats->mutex, NULL);
+#endif
+    return stats;
+}
+
+static void
+tiled_surface_stats_free(TiledSurfaceStats *stats)
+{
+#ifdef HAVE_PTHREAD
+    pthread_mutex_destroy(&stats->mutex);
+#endif
+    free(stats);
+}
+
+static void
+stats_add(MyPaintTiledSurfaceStats *sum, const MyPaintTiledSurfaceStats *stats)
+{
+    sum->dabs_queued += stats->dabs_queued;
+    sum->dabs_culled += stats->dabs_culled;
+    sum->tiles_dirtied += stats->tiles_dirtied;
+    sum->tiles_processed += stats->tiles_processed;
+    sum->mask_pixels += stats->mask_pixels;
+    for (int i = 0; i < MYPAINT_BLEND_STATS_COUNT; i++) {
+        sum->blend_pixels[i] += stats->blend_pixels[i];
+    }
+    sum->get_color_calls += stats->get_color_calls;
+    sum->get_color_pixels += stats->get_color_pixels;
+    sum->queue_peak_bytes = MAX(sum->queue_peak_bytes, stats->queue_peak_bytes);
+    sum->mask_time += stats->mask_time;
+    sum->blend_time += stats->blend_time;
+    sum->tile_request_time += stats->tile_request_time;
+}
+
+// Returns the counters for the calling thread to add to: its own slot
+// if it is a tile worker, otherwise @local, cleared.
+static MyPaintTiledSurfaceStats *
+stats_begin(MyPaintTiledSurface *self, MyPaintTiledSurfaceStats *local)
+{
+    const int worker = tile_scheduler_get_worker_id();
+    if (worker >= 0 && worker < MYPAINT_MAX_THREADS) {
+        return &self->stats->workers[worker].stats;
+    }
+    memset(local, 0, sizeof(MyPaintTiledSurfaceStats));
+    return local;
+}
+
+static void
+stats_end(MyPaintTiledSurface *self, MyPaintTiledSurfaceStats *stats,
+          const MyPaintTiledSurfaceStats *local)
+{
+    if (stats != local) {
+        return;
+    }
+#ifdef HAVE_PTHREAD
+    pthread_mutex_lock(&self->stats->mutex);
+    stats_add(&self->stats->shared.stats, local);
+    pthread_mutex_unlock(&self->stats->mutex);
+#else
+    #pragma omp critical (mypaint_tiled_surface_stats)
+    stats_add(&self->stats->shared.stats, local);
+#endif
+}
 
 // Optional paper grain: env-gated procedural noise modulation of per-pixel dab opacity.
 // Disabled by default. Enable by setting MYPAINT_PAPER_NOISE to a nonzero value.
@@ -57,8 +280,7 @@ static inline float paper_noise_value(int x, int y) {
     return (h / 4294967295.0f);
 }
 
-static inline void paper_noise_init_if_needed(void) {
-    if (g_paper_noise_enabled != -1) return;
+static void paper_noise_init(void) {
     const char* env = getenv("MYPAINT_PAPER_NOISE");
     if (env && env[0] && strcmp(env, "0") != 0) {
         g_paper_noise_enabled = 1;
@@ -74,6 +296,17 @@ static inline void paper_noise_init_if_needed(void) {
     }
 }
 
+// Tiles are rendered by several threads at once, so the environment is read exactly once.
+// Called once per dab mask, not per pixel.
+static inline void paper_noise_init_if_needed(void) {
+#ifdef HAVE_PTHREAD
+    static pthread_once_t once = PTHREAD_ONCE_INIT;
+    pthread_once(&once, paper_noise_init);
+#else
+    if (g_paper_noise_enabled == -1) paper_noise_init();
+#endif
+}
+
 static void
 begin_atomic_default(MyPaintSurface *surface)
 {
@@ -86,8 +319,10 @@ end_atomic_default(MyPaintSurface *surface, MyPaintRectangles *roi)
     mypaint_tiled_surface_end_atomic((MyPaintTiledSurface *)surface, roi);
 }
 
+// If @keep is TRUE, the bounding boxes of the previous transaction are kept
+// and added to, instead of being cleared.
 void
-prepare_bounding_boxes(MyPaintTiledSurface *self) {
+prepare_bounding_boxes(MyPaintTiledSurface *self, gboolean keep) {
     MyPaintSymmetryState symm_state = self->symmetry_data.state_current;
     const gboolean snowflake = symm_state.type == MYPAINT_SYMMETRY_TYPE_SNOWFLAKE;
     const int num_bboxes_desired = symm_state.num_lines * (snowflake ? 2 : 1);
@@ -100,18 +335,26 @@ prepare_bounding_boxes(MyPaintTiledSurface *self) {
         int bytes_to_allocate = num_to_allocate * sizeof(MyPaintRectangle);
         MyPaintRectangle* new_bboxes = malloc(bytes_to_allocate);
         if (new_bboxes) {
+            // Initialize memory
+            memset(new_bboxes, 0, bytes_to_allocate);
+            if (keep) {
+                memcpy(new_bboxes, self->bboxes, self->num_bboxes * sizeof(MyPaintRectangle));
+            }
             if (self->num_bboxes > NUM_BBOXES_DEFAULT) {
                 // Free previous allocation
                 free(self->bboxes);
             }
-            // Initialize memory
-            memset(new_bboxes, 0, bytes_to_allocate);
             self->bboxes = new_bboxes;
             self->num_bboxes = num_to_allocate;
-            // No need to clear anything after the memset, so reset counter
-            self->num_bboxes_dirtied = 0;
+            if (!keep) {
+                // No need to clear anything after the memset, so reset counter
+                self->num_bboxes_dirtied = 0;
+            }
         }
     }
+    if (keep) {
+        return;
+    }
     // Clean up any previously populated bounding boxes and reset the counter
     for (int i = 0; i < MIN(self->num_bboxes, self->num_bboxes_dirtied); ++i) {
         self->bboxes[i].height = 0;
@@ -133,32 +376,80 @@ prepare_bounding_boxes(MyPaintTiledSurface *self) {
 void
 mypaint_tiled_surface_begin_atomic(MyPaintTiledSurface *self)
 {
+    transaction_lock(self);
     mypaint_update_symmetry_state(&self->symmetry_data);
-    prepare_bounding_boxes(self);
+    // Tiles left over by mypaint_tiled_surface_end_atomic_budgeted() are part of the
+    // new transaction, and so are their bounding boxes. When painting concurrently,
+    // other threads may be in the middle of their transactions, and the bounding
+    // boxes are cleared when the last open transaction ends instead.
+    prepare_bounding_boxes(self, self->tiles_pending || self->transaction_lock);
+    transaction_opened(self);
+    transaction_unlock(self);
 }
 
-/**
- * mypaint_tiled_surface_end_atomic: (skip)
- *
- * Implementation of #MyPaintSurface::end_atomic vfunc
- * Note: Only intended to be used from #MyPaintTiledSurface subclasses, which should chain up to this
- * if implementing their own #MyPaintSurface::end_atomic vfunc.
- * Application code should only use mypaint_surface_end_atomic().
- */
-void
-mypaint_tiled_surface_end_atomic(MyPaintTiledSurface *self, MyPaintRectangles *roi)
+static void
+process_tile_func(void *user_data, TileIndex index)
 {
-    // Process tiles
-    TileIndex *tiles;
-    int tiles_n = operation_queue_get_dirty_tiles(self->operation_queue, &tiles);
+    process_tile((MyPaintTiledSurface *)user_data, index.x, index.y);
+}
 
-    #pragma omp parallel for schedule(static) if(self->threadsafe_tile_requests && tiles_n > 3)
+static int
+tile_cost_func(void *user_data, TileIndex index)
+{
+    MyPaintTiledSurface *self = (MyPaintTiledSurface *)user_data;
+    return operation_queue_get_queue_length(self->operation_queue, index);
+}
+
+static int
+tile_cost_total(MyPaintTiledSurface *self, TileIndex *tiles, int tiles_n)
+{
+    int total = 0;
     for (int i = 0; i < tiles_n; i++) {
-        process_tile(self, tiles[i].x, tiles[i].y);
+        total += operation_queue_get_queue_length(self->operation_queue, tiles[i]);
     }
+    return total;
+}
 
-    operation_queue_clear_dirty_tiles(self->operation_queue);
+/* Drain the queue of a tile in the background, also picking up any dabs
+ * that are queued for it while it is being processed. */
+static void
+process_tile_async_func(void *user_data, TileIndex index)
+{
+    MyPaintTiledSurface *self = (MyPaintTiledSurface *)user_data;
+
+    if (!operation_queue_acquire_tile(self->operation_queue, index)) {
+        return; // Nothing queued, or already being processed by another thread
+    }
+    do {
+        if (!process_tile(self, index.x, index.y)) {
+            // Unable to get the tile; drop the operations rather than retrying forever
+            operation_queue_drop(self->operation_queue, index);
+        }
+    } while (operation_queue_release_tile(self->operation_queue, index));
+}
+
+/* Lazily start the worker threads on the first transaction big enough to use them */
+static TileScheduler *
+get_tile_scheduler(MyPaintTiledSurface *self)
+{
+    if (!self->tile_scheduler) {
+        if (self->async) {
+            // Background threads, in addition to the thread producing the dabs
+            const int num_threads = self->num_threads ? self->num_threads : tile_scheduler_default_num_threads();
+            self->tile_scheduler = tile_scheduler_new(num_threads + 1);
+            if (self->tile_scheduler) {
+                tile_scheduler_set_background_func(self->tile_scheduler, process_tile_async_func, self);
+            }
+        } else {
+            self->tile_scheduler = tile_scheduler_new(self->num_threads);
+        }
+    }
+    return self->tile_scheduler;
+}
 
+static void
+write_roi(MyPaintTiledSurface *self, MyPaintRectangles *roi)
+{
     if (roi) {
         const int roi_rects = roi->num_rectangles;
         const int num_dirty = self->num_bboxes_dirtied;
@@ -187,6 +478,258 @@ mypaint_tiled_surface_end_atomic(MyPaintTiledSurface *self, MyPaintRectangles *r
     }
 }
 
+static void
+end_atomic_unlocked(MyPaintTiledSurface *self, MyPaintRectangles *roi)
+{
+    TRACE_BEGIN(end_atomic);
+
+    // Process tiles
+    TileIndex *tiles;
+    int tiles_n = operation_queue_get_dirty_tiles(self->operation_queue, &tiles);
+
+    TileScheduler *scheduler = NULL;
+    if (self->async) {
+        // The tiles are already being processed, only wait for them to finish
+        tiles_n = 0;
+        tile_scheduler_wait(self->tile_scheduler);
+    } else if (self->threadsafe_tile_requests && self->num_threads != 1 && tiles_n >= self->min_batch_size) {
+        scheduler = get_tile_scheduler(self);
+    }
+
+    if (scheduler) {
+        // Heaviest tiles first, so one tile with a long queue does not end up last
+        tile_scheduler_run(scheduler, tiles, tiles_n, tile_cost_func, process_tile_func, self);
+    } else {
+        for (int i = 0; i < tiles_n; i++) {
+            process_tile(self, tiles[i].x, tiles[i].y);
+        }
+    }
+
+    operation_queue_clear_dirty_tiles(self->operation_queue);
+    self->tiles_pending = FALSE;
+
+    write_roi(self, roi);
+    // The rectangles of painters still in their transactions are merged
+    // into the ones reported when those end
+    if (transaction_closed(self)) {
+        prepare_bounding_boxes(self, FALSE);
+    }
+    TRACE_END(end_atomic);
+}
+
+/**
+ * mypaint_tiled_surface_end_atomic: (skip)
+ *
+ * Implementation of #MyPaintSurface::end_atomic vfunc
+ * Note: Only intended to be used from #MyPaintTiledSurface subclasses, which should chain up to this
+ * if implementing their own #MyPaintSurface::end_atomic vfunc.
+ * Application code should only use mypaint_surface_end_atomic().
+ */
+void
+mypaint_tiled_surface_end_atomic(MyPaintTiledSurface *self, MyPaintRectangles *roi)
+{
+    transaction_lock(self);
+    end_atomic_unlocked(self, roi);
+    transaction_unlock(self);
+}
+
+static gboolean
+tile_in_rect(TileIndex index, const MyPaintRectangle *rect)
+{
+    const int x = index.x * MYPAINT_TILE_SIZE;
+    const int y = index.y * MYPAINT_TILE_SIZE;
+    return x < rect->x + rect->width && x + MYPAINT_TILE_SIZE > rect->x
+        && y < rect->y + rect->height && y + MYPAINT_TILE_SIZE > rect->y;
+}
+
+typedef struct {
+    TileIndex index;
+    int priority;
+    int cost;
+} TileOrder;
+
+static int
+compare_tile_order(const void *a, const void *b)
+{
+    const TileOrder *ta = (const TileOrder *)a;
+    const TileOrder *tb = (const TileOrder *)b;
+    if (ta->priority != tb->priority) {
+        return tb->priority - ta->priority;
+    }
+    return (tb->cost > ta->cost) - (tb->cost < ta->cost);
+}
+
+/* Order @tiles in place: those intersecting @viewport first, heaviest first within each group */
+static void
+order_tiles_for_viewport(MyPaintTiledSurface *self, TileIndex *tiles, int tiles_n,
+                         const MyPaintRectangle *viewport)
+{
+    TileOrder *order = (TileOrder *)malloc(tiles_n * sizeof(TileOrder));
+    if (!order) {
+        return; // Not ordering them is fine too
+    }
+    for (int i = 0; i < tiles_n; i++) {
+        order[i].index = tiles[i];
+        order[i].priority = (viewport && tile_in_rect(tiles[i], viewport)) ? 1 : 0;
+        order[i].cost = operation_queue_get_queue_length(self->operation_queue, tiles[i]);
+    }
+    qsort(order, tiles_n, sizeof(TileOrder), compare_tile_order);
+    for (int i = 0; i < tiles_n; i++) {
+        tiles[i] = order[i].index;
+    }
+    free(order);
+}
+
+static int
+end_atomic_budgeted_unlocked(MyPaintTiledSurface *self, MyPaintRectangles *roi,
+                             const MyPaintRectangle *viewport,
+                             double time_budget, int tile_budget)
+{
+    if (time_budget <= 0.0 && tile_budget <= 0) {
+        end_atomic_unlocked(self, roi);
+        return 0;
+    }
+
+    const double start_time = get_monotonic_time();
+    TileIndex *tiles;
+    const int tiles_n = operation_queue_get_dirty_tiles(self->operation_queue, &tiles);
+    order_tiles_for_viewport(self, tiles, tiles_n, viewport);
+
+    TileScheduler *scheduler = NULL;
+    if (!self->async && self->threadsafe_tile_requests && self->num_threads != 1
+        && tiles_n >= self->min_batch_size) {
+        scheduler = get_tile_scheduler(self);
+    }
+    // Process in batches small enough to keep to the time budget, but big enough for all threads
+    const int batch_size = scheduler ? tile_scheduler_get_num_threads(scheduler) : 1;
+
+    int processed = 0;
+    while (processed < tiles_n) {
+        if (processed > 0) {
+            if (tile_budget > 0 && processed >= tile_budget) break;
+            if (time_budget > 0.0 && get_monotonic_time() - start_time >= time_budget) break;
+        }
+        int batch = MIN(batch_size, tiles_n - processed);
+        if (tile_budget > 0) {
+            batch = MAX(1, MIN(batch, tile_budget - processed));
+        }
+
+        if (self->async) {
+            // Help the background threads, starting with the tiles that are wanted first.
+            // Tiles that a worker is already busy with are skipped.
+            process_tile_async_func(self, tiles[processed]);
+        } else if (batch > 1) {
+            tile_scheduler_run(scheduler, tiles + processed, batch, tile_cost_func, process_tile_func, self);
+        } else {
+            process_tile(self, tiles[processed].x, tiles[processed].y);
+        }
+        processed += batch;
+    }
+
+    const int remaining = operation_queue_prune_dirty_tiles(self->operation_queue);
+    self->tiles_pending = remaining > 0;
+
+    write_roi(self, roi);
+    if (transaction_closed(self) && !self->tiles_pending) {
+        prepare_bounding_boxes(self, FALSE);
+    }
+    return remaining;
+}
+
+/**
+ * mypaint_tiled_surface_end_atomic_budgeted:
+ * @roi: (nullable): Output for the dirtied areas, see mypaint_surface_end_atomic()
+ * @viewport: (nullable): Area of the surface to process first, typically the visible part.
+ * @time_budget: Number of seconds to spend processing tiles, or 0 for no limit.
+ * @tile_budget: Number of tiles to process, or 0 for no limit.
+ *
+ * Variant of mypaint_tiled_surface_end_atomic() that stops processing tiles once
+ * either budget is used up, so that painting with very large dabs does not hold up
+ * the frame it happens in. At least one tile is processed per call.
+ *
+ * Tiles that are left over are carried into the next transaction, and processed
+ * by the next call to end the transaction. Until then, @roi keeps covering the
+ * areas dirtied in all of the transactions involved.
+ *
+ * Returns: the number of tiles that still have dabs queued.
+ */
+int
+mypaint_tiled_surface_end_atomic_budgeted(MyPaintTiledSurface *self, MyPaintRectangles *roi,
+                                          const MyPaintRectangle *viewport,
+                                          double time_budget, int tile_budget)
+{
+    transaction_lock(self);
+    TRACE_BEGIN(end_atomic_budgeted);
+    const int remaining = end_atomic_budgeted_unlocked(self, roi, viewport, time_budget, tile_budget);
+    TRACE_END(end_atomic_budgeted);
+    transaction_unlock(self);
+    return remaining;
+}
+
+/* Process the tiles with the longest queues until the queued dabs use at most
+ * half of the configured maximum. Tiles keep their order of operations, so
+ * the result is the same as processing them in end_atomic. */
+static void
+flush_queue_to_limit(MyPaintTiledSurface *self)
+{
+    // The running count may include dabs that have been processed already
+    if (operation_queue_prune_dirty_tiles(self->operation_queue) == 0
+        || operation_queue_get_queued_bytes(self->operation_queue) <= self->max_queue_bytes) {
+        return;
+    }
+
+    TileIndex *tiles;
+    const int tiles_n = operation_queue_get_dirty_tiles(self->operation_queue, &tiles);
+    order_tiles_for_viewport(self, tiles, tiles_n, NULL);
+
+    // Select the heaviest tiles until enough is freed
+    const size_t target_bytes = self->max_queue_bytes / 2;
+    const size_t queued_bytes = operation_queue_get_queued_bytes(self->operation_queue);
+    // Background threads may still be draining the queues, so count only once
+    const int queued_ops = tile_cost_total(self, tiles, tiles_n);
+    const size_t bytes_per_op = queued_bytes / MAX(1, queued_ops);
+    size_t freed_bytes = 0;
+    int flush_n = 0;
+    while (flush_n < tiles_n && queued_bytes - freed_bytes > target_bytes) {
+        freed_bytes += bytes_per_op * operation_queue_get_queue_length(self->operation_queue, tiles[flush_n]);
+        flush_n++;
+    }
+
+    if (self->async) {
+        // Backpressure: help the background threads until enough has been drained
+        for (int i = 0; i < flush_n; i++) {
+            process_tile_async_func(self, tiles[i]);
+        }
+    } else if (self->threadsafe_tile_requests && self->num_threads != 1
+               && flush_n >= self->min_batch_size && get_tile_scheduler(self)) {
+        tile_scheduler_run(self->tile_scheduler, tiles, flush_n, tile_cost_func, process_tile_func, self);
+    } else {
+        for (int i = 0; i < flush_n; i++) {
+            process_tile(self, tiles[i].x, tiles[i].y);
+        }
+    }
+
+    operation_queue_prune_dirty_tiles(self->operation_queue);
+}
+
+/**
+ * mypaint_tiled_surface_set_max_queue_bytes:
+ * @max_queue_bytes: Memory limit for queued dabs in bytes, or 0 for no limit.
+ *
+ * Dabs are queued per tile until the end of the transaction. When a long transaction
+ * (like a whole stroke) makes the queue exceed this size, the tiles with the most
+ * dabs queued are processed early, which gives the same result.
+ *
+ * Defaults to 0, so tiles are only processed when the transaction ends,
+ * unless asynchronous mode is on. Something like 64 MiB bounds the memory
+ * used by whole-stroke transactions with huge dabs.
+ */
+void
+mypaint_tiled_surface_set_max_queue_bytes(MyPaintTiledSurface *self, size_t max_queue_bytes)
+{
+    self->max_queue_bytes = max_queue_bytes;
+}
+
 /**
  * mypaint_tiled_surface_tile_request_start:
  *
@@ -198,7 +741,9 @@ mypaint_tiled_surface_end_atomic(MyPaintTiledSurface *self, MyPaintRectangles *r
 void mypaint_tiled_surface_tile_request_start(MyPaintTiledSurface *self, MyPaintTileRequest *request)
 {
     assert(self->tile_request_start);
+    TRACE_BEGIN(tile_request_start);
     self->tile_request_start(self, request);
+    TRACE_END(tile_request_start);
 }
 
 /**
@@ -212,7 +757,9 @@ void mypaint_tiled_surface_tile_request_start(MyPaintTiledSurface *self, MyPaint
 void mypaint_tiled_surface_tile_request_end(MyPaintTiledSurface *self, MyPaintTileRequest *request)
 {
     assert(self->tile_request_end);
+    TRACE_BEGIN(tile_request_end);
     self->tile_request_end(self, request);
+    TRACE_END(tile_request_end);
 }
 
 /* FIXME: either expose this through MyPaintSurface, or move it into the brush engine */
@@ -239,6 +786,253 @@ mypaint_tiled_surface_set_symmetry_state(MyPaintTiledSurface *self, gboolean act
         &self->symmetry_data, active, center_x, center_y, symmetry_angle, symmetry_type, rot_symmetry_lines);
 }
 
+/**
+ * mypaint_tiled_surface_set_num_threads:
+ * @num_threads: Number of threads to process tiles with,
+ * or 0 to use one thread per processor.
+ *
+ * Set how many threads mypaint_surface_end_atomic() uses to process queued dabs.
+ * The threads are started on first use and kept until the surface is destroyed.
+ * Has no effect unless the subclass supports threadsafe tile requests.
+ *
+ * In asynchronous mode the background threads are restarted right away. If
+ * that fails, the surface goes back to synchronous mode, which
+ * mypaint_tiled_surface_get_async() reports.
+ */
+void
+mypaint_tiled_surface_set_num_threads(MyPaintTiledSurface *self, int num_threads)
+{
+    if (num_threads < 0) num_threads = 0;
+    if (num_threads > MYPAINT_MAX_THREADS) num_threads = MYPAINT_MAX_THREADS;
+    if (num_threads == self->num_threads) {
+        return;
+    }
+    // Restarted with the new thread count on next use
+    tile_scheduler_free(self->tile_scheduler);
+    self->tile_scheduler = NULL;
+    self->num_threads = num_threads;
+    if (self->async && !get_tile_scheduler(self)) {
+        // Unable to start the background threads, process tiles in end_atomic instead
+        operation_queue_set_threadsafe(self->operation_queue, self->transaction_lock != NULL);
+        self->async = FALSE;
+    }
+}
+
+/**
+ * mypaint_tiled_surface_get_num_threads:
+ *
+ * Returns: the number of threads used to process tiles,
+ * as set by mypaint_tiled_surface_set_num_threads(), or 0 for automatic.
+ */
+int
+mypaint_tiled_surface_get_num_threads(MyPaintTiledSurface *self)
+{
+    return self->num_threads;
+}
+
+/**
+ * mypaint_tiled_surface_set_min_batch_size:
+ * @min_batch_size: Smallest number of dirty tiles to process in parallel.
+ *
+ * Transactions touching fewer tiles than this are processed on the calling thread,
+ * since waking up the worker threads would cost more than it saves. Defaults to 4.
+ */
+void
+mypaint_tiled_surface_set_min_batch_size(MyPaintTiledSurface *self, int min_batch_size)
+{
+    self->min_batch_size = MAX(1, min_batch_size);
+}
+
+/**
+ * mypaint_tiled_surface_set_async:
+ * @async: TRUE to process tiles in the background, FALSE to process them in end_atomic.
+ *
+ * In asynchronous mode, dabs are rendered by background threads while the brush
+ * is still producing them, and mypaint_surface_end_atomic() only waits for
+ * the queued dabs to be done. Use mypaint_tiled_surface_set_area_changed_callback()
+ * to find out about tiles as soon as they are finished.
+ *
+ * The number of background threads is set by mypaint_tiled_surface_set_num_threads().
+ * Must not be called during a transaction.
+ *
+ * Returns: TRUE if the mode was set. Asynchronous mode is unavailable if the
+ * subclass does not support threadsafe tile requests, or without pthreads.
+ */
+gboolean
+mypaint_tiled_surface_set_async(MyPaintTiledSurface *self, gboolean async)
+{
+    async = async ? TRUE : FALSE;
+    if (async == self->async) {
+        return TRUE;
+    }
+    if (async && !self->threadsafe_tile_requests) {
+        return FALSE;
+    }
+    const gboolean concurrent = self->transaction_lock != NULL;
+    if (!operation_queue_set_threadsafe(self->operation_queue, async || concurrent)) {
+        return FALSE;
+    }
+
+    // The pool is set up differently for the two modes
+    tile_scheduler_free(self->tile_scheduler);
+    self->tile_scheduler = NULL;
+    self->async = async;
+
+    if (async && !get_tile_scheduler(self)) {
+        operation_queue_set_threadsafe(self->operation_queue, concurrent);
+        self->async = FALSE;
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/**
+ * mypaint_tiled_surface_get_async:
+ *
+ * Returns: TRUE if tiles are processed in the background, see mypaint_tiled_surface_set_async()
+ */
+gboolean
+mypaint_tiled_surface_get_async(MyPaintTiledSurface *self)
+{
+    return self->async;
+}
+
+/**
+ * mypaint_tiled_surface_set_concurrent_painting:
+ * @concurrent: TRUE to allow several threads to paint on the surface at once.
+ *
+ * With concurrent painting enabled, mypaint_surface_draw_dab() and
+ * mypaint_surface_get_color() may be called from any number of threads at the
+ * same time, for example by one #MyPaintBrush per thread. Dabs on different
+ * tiles are queued without contending for a lock, and dabs landing on the same
+ * tile are rendered in the order they were queued.
+ *
+ * Beginning and ending a transaction waits for the dabs being queued to be done,
+ * and holds off new ones until it returns. Each painting thread may begin and
+ * end its own transactions. Ending one renders the dabs of all threads, and the
+ * rectangles it reports also cover the areas dirtied by the transactions that
+ * are still open, which are only cleared once the last of them has ended.
+ *
+ * Must not be called during a transaction.
+ *
+ * Returns: TRUE if the mode was set. Concurrent painting is unavailable if the
+ * subclass does not support threadsafe tile requests, or without pthreads.
+ */
+gboolean
+mypaint_tiled_surface_set_concurrent_painting(MyPaintTiledSurface *self, gboolean concurrent)
+{
+#ifdef HAVE_PTHREAD
+    concurrent = concurrent ? TRUE : FALSE;
+    if (concurrent == (self->transaction_lock != NULL)) {
+        return TRUE;
+    }
+    if (concurrent && !self->threadsafe_tile_requests) {
+        return FALSE;
+    }
+    if (!operation_queue_set_threadsafe(self->operation_queue, concurrent || self->async)) {
+        return FALSE;
+    }
+
+    if (concurrent) {
+        TransactionLock *lock = (TransactionLock *)malloc(sizeof(TransactionLock));
+        pthread_mutex_init(&lock->mutex, NULL);
+        pthread_cond_init(&lock->cond, NULL);
+        pthread_mutex_init(&lock->bboxes_mutex, NULL);
+        lock->painters = 0;
+        lock->exclusive_waiting = 0;
+        lock->exclusive = FALSE;
+        lock->transactions = 0;
+        self->transaction_lock = lock;
+    } else {
+        transaction_lock_free(self->transaction_lock);
+        self->transaction_lock = NULL;
+    }
+    return TRUE;
+#else
+    return !concurrent;
+#endif
+}
+
+/**
+ * mypaint_tiled_surface_get_concurrent_painting:
+ *
+ * Returns: TRUE if several threads may paint at once, see mypaint_tiled_surface_set_concurrent_painting()
+ */
+gboolean
+mypaint_tiled_surface_get_concurrent_painting(MyPaintTiledSurface *self)
+{
+    return self->transaction_lock != NULL;
+}
+
+/**
+ * mypaint_tiled_surface_set_area_changed_callback:
+ * @area_changed: (nullable): Function called with the bounds of each processed tile, or NULL.
+ * @user_data: Passed to @area_changed.
+ *
+ * Set a function to be called whenever the queued dabs for a tile have been rendered.
+ * In asynchronous mode, and when tiles are processed in parallel, it is called
+ * from the worker threads, and must be threadsafe.
+ */
+void
+mypaint_tiled_surface_set_area_changed_callback(MyPaintTiledSurface *self,
+                                                MyPaintTiledSurfaceAreaChanged area_changed,
+                                                void *user_data)
+{
+    self->area_changed = area_changed;
+    self->area_changed_user_data = user_data;
+}
+
+/**
+ * mypaint_tiled_surface_get_stats:
+ * @stats: (out): Location to store the counters in
+ *
+ * Get the counters collected since the surface was created,
+ * or since the last call to mypaint_tiled_surface_reset_stats().
+ * Call it between transactions: dabs still being rendered may not be counted yet.
+ */
+void
+mypaint_tiled_surface_get_stats(MyPaintTiledSurface *self, MyPaintTiledSurfaceStats *stats)
+{
+    transaction_lock(self);
+    memset(stats, 0, sizeof(MyPaintTiledSurfaceStats));
+    for (int i = 0; i < MYPAINT_MAX_THREADS; i++) {
+        stats_add(stats, &self->stats->workers[i].stats);
+    }
+    stats_add(stats, &self->stats->shared.stats);
+    transaction_unlock(self);
+}
+
+/**
+ * mypaint_tiled_surface_reset_stats:
+ *
+ * Set all counters to zero, for example at the start of each frame.
+ * The memory of the dabs that are queued at this point counts towards the new peak.
+ */
+void
+mypaint_tiled_surface_reset_stats(MyPaintTiledSurface *self)
+{
+    transaction_lock(self);
+    for (int i = 0; i < MYPAINT_MAX_THREADS; i++) {
+        memset(&self->stats->workers[i].stats, 0, sizeof(MyPaintTiledSurfaceStats));
+    }
+    memset(&self->stats->shared.stats, 0, sizeof(MyPaintTiledSurfaceStats));
+    self->stats->shared.stats.queue_peak_bytes = operation_queue_get_queued_bytes(self->operation_queue);
+    transaction_unlock(self);
+}
+
+/**
+ * mypaint_tiled_surface_set_stats_timing:
+ * @enabled: TRUE to measure the time spent in each rendering phase
+ *
+ * The time counters of #MyPaintTiledSurfaceStats read the clock around every
+ * rendered dab, which is too costly to do by default. Off by default.
+ */
+void
+mypaint_tiled_surface_set_stats_timing(MyPaintTiledSurface *self, gboolean enabled)
+{
+    self->stats_timing = enabled;
+}
+
 /**
  * mypaint_tile_request_init:
  *
@@ -254,10 +1048,11 @@ mypaint_tile_request_init(MyPaintTileRequest *data, int level,
     data->readonly = readonly;
     data->buffer = NULL;
     data->context = NULL;
+    data->thread_id = tile_scheduler_get_worker_id();
 #ifdef _OPENMP
-    data->thread_id = omp_get_thread_num();
-#else
-    data->thread_id = -1;
+    if (data->thread_id < 0) {
+        data->thread_id = omp_get_thread_num();
+    }
 #endif
     data->mipmap_level = level;
 }
@@ -412,7 +1207,8 @@ calculate_opa(float rr, float hardness,
 }
 
 // Must be threadsafe
-void render_dab_mask (uint16_t * mask,
+// Returns the number of non-transparent pixels in the mask
+int render_dab_mask (uint16_t * mask,
                         float x, float y,
                         float radius,
                         float hardness,
@@ -421,6 +1217,8 @@ void render_dab_mask (uint16_t * mask,
                         int tile_origin_x, int tile_origin_y
                         )
 {
+    paper_noise_init_if_needed();
+    const gboolean paper_noise = g_paper_noise_enabled == 1;
 
     hardness = CLAMP(hardness, 0.0, 1.0);
     if (aspect_ratio<1.0) aspect_ratio=1.0;
@@ -503,6 +1301,7 @@ void render_dab_mask (uint16_t * mask,
     // value in the mask is the number of pixels that can be skipped.
     uint16_t * mask_p = mask;
     int skip=0;
+    int pixels=0;
 
     skip += y0*MYPAINT_TILE_SIZE;
     for (int yp = y0; yp <= y1; yp++) {
@@ -515,17 +1314,14 @@ void render_dab_mask (uint16_t * mask,
                                   segment1_offset, segment1_slope,
                                   segment2_offset, segment2_slope);
         // Paper grain modulation (optional, env-gated)
-        if (opa > 0.0f) {
-          paper_noise_init_if_needed();
-          if (g_paper_noise_enabled == 1) {
-            const int abs_x = tile_origin_x + xp;
-            const int abs_y = tile_origin_y + yp;
-            float n = paper_noise_value(abs_x, abs_y); // [0,1]
-            float m = (1.0f - g_paper_noise_strength) + g_paper_noise_strength * n;
-            opa *= m;
-          }
+        if (paper_noise && opa > 0.0f) {
+          const int abs_x = tile_origin_x + xp;
+          const int abs_y = tile_origin_y + yp;
+          float n = paper_noise_value(abs_x, abs_y); // [0,1]
+          float m = (1.0f - g_paper_noise_strength) + g_paper_noise_strength * n;
+          opa *= m;
         }
-        const uint16_t opa_ = (uint16_t)CLAMP(opa, 0.0f, 1.0f) * (1<<15);
+        const uint16_t opa_ = (uint16_t)(CLAMP(opa, 0.0f, 1.0f) * (1<<15));
         if (!opa_) {
           skip++;
         } else {
@@ -535,22 +1331,27 @@ void render_dab_mask (uint16_t * mask,
             skip = 0;
           }
           *mask_p++ = opa_;
+          pixels++;
         }
       }
       skip += MYPAINT_TILE_SIZE-xp;
     }
     *mask_p++ = 0;
     *mask_p++ = 0;
+    return pixels;
   }
 
 // Must be threadsafe
+// The pixel counts and, if @timing is set, the times are added to @stats
 void
 process_op(uint16_t *rgba_p, uint16_t *mask,
-           int tx, int ty, OperationDataDrawDab *op)
+           int tx, int ty, OperationDataDrawDab *op,
+           MyPaintTiledSurfaceStats *stats, gboolean timing)
 {
+    const double mask_start = timing ? get_monotonic_time() : 0.0;
 
     // first, we calculate the mask (opacity for each pixel)
-    render_dab_mask(mask,
+    const int pixels = render_dab_mask(mask,
                     op->x - tx*MYPAINT_TILE_SIZE,
                     op->y - ty*MYPAINT_TILE_SIZE,
                     op->radius,
@@ -559,94 +1360,120 @@ process_op(uint16_t *rgba_p, uint16_t *mask,
                     op->aspect_ratio, op->angle,
                     tx*MYPAINT_TILE_SIZE, ty*MYPAINT_TILE_SIZE
                     );
+    stats->mask_pixels += pixels;
 
-    // second, we use the mask to stamp a dab for each activated blend mode
-    if (op->paint < 1.0) {
-      if (op->normal) {
-        if (op->color_a == 1.0) {
-          draw_dab_pixels_BlendMode_Normal(mask, rgba_p,
-                                           op->color_r, op->color_g, op->color_b, op->normal*op->opaque*(1 - op->paint)*(1<<15));
-        } else {
-          // normal case for brushes that use smudging (eg. watercolor)
-          draw_dab_pixels_BlendMode_Normal_and_Eraser(mask, rgba_p,
-                                                      op->color_r, op->color_g, op->color_b, op->color_a*(1<<15),
-                                                      op->normal*op->opaque*(1 - op->paint)*(1<<15));
-        }
-      }
+    const double blend_start = timing ? get_monotonic_time() : 0.0;
 
-      if (op->lock_alpha && op->color_a != 0) {
-        draw_dab_pixels_BlendMode_LockAlpha(mask, rgba_p,
-                                            op->color_r, op->color_g, op->color_b,
-                                            op->lock_alpha*op->opaque*(1 - op->colorize)*(1 - op->posterize)*(1 - op->paint)*(1<<15));
+    // second, we use the mask to stamp a dab for each activated blend mode
+    const uint16_t blend_modes = op->blend_modes;
+    if (blend_modes & DAB_BLEND_NORMAL) {
+      if (!(blend_modes & DAB_BLEND_ERASER)) {
+        draw_dab_pixels_BlendMode_Normal(mask, rgba_p,
+                                         op->color_r, op->color_g, op->color_b, op->opacity_normal);
+        stats->blend_pixels[MYPAINT_BLEND_STAT_NORMAL] += pixels;
+      } else {
+        // normal case for brushes that use smudging (eg. watercolor)
+        draw_dab_pixels_BlendMode_Normal_and_Eraser(mask, rgba_p,
+                                                    op->color_r, op->color_g, op->color_b, op->color_a,
+                                                    op->opacity_normal);
+        stats->blend_pixels[MYPAINT_BLEND_STAT_NORMAL_AND_ERASER] += pixels;
       }
     }
-    
-    if (op->paint > 0.0) {
-      if (op->normal) {
-        if (op->color_a == 1.0) {
-          draw_dab_pixels_BlendMode_Normal_Paint(mask, rgba_p,
-                                           op->color_r, op->color_g, op->color_b, op->normal*op->opaque*op->paint*(1<<15));
-        } else {
-          // normal case for brushes that use smudging (eg. watercolor)
-          draw_dab_pixels_BlendMode_Normal_and_Eraser_Paint(mask, rgba_p,
-                                                      op->color_r, op->color_g, op->color_b, op->color_a*(1<<15),
-                                                      op->normal*op->opaque*op->paint*(1<<15));
-        }
-      }
+    if (blend_modes & DAB_BLEND_LOCK_ALPHA) {
+      draw_dab_pixels_BlendMode_LockAlpha(mask, rgba_p,
+                                          op->color_r, op->color_g, op->color_b, op->opacity_lock_alpha);
+      stats->blend_pixels[MYPAINT_BLEND_STAT_LOCK_ALPHA] += pixels;
+    }
 
-      if (op->lock_alpha && op->color_a != 0) {
-        draw_dab_pixels_BlendMode_LockAlpha_Paint(mask, rgba_p,
-                                            op->color_r, op->color_g, op->color_b,
-                                            op->lock_alpha*op->opaque*(1 - op->colorize)*(1 - op->posterize)*op->paint*(1<<15));
+    if (blend_modes & DAB_BLEND_NORMAL_PAINT) {
+      if (!(blend_modes & DAB_BLEND_ERASER)) {
+        draw_dab_pixels_BlendMode_Normal_Paint(mask, rgba_p,
+                                               op->color_r, op->color_g, op->color_b, op->opacity_normal_paint);
+        stats->blend_pixels[MYPAINT_BLEND_STAT_NORMAL_PAINT] += pixels;
+      } else {
+        // normal case for brushes that use smudging (eg. watercolor)
+        draw_dab_pixels_BlendMode_Normal_and_Eraser_Paint(mask, rgba_p,
+                                                          op->color_r, op->color_g, op->color_b, op->color_a,
+                                                          op->opacity_normal_paint);
+        stats->blend_pixels[MYPAINT_BLEND_STAT_NORMAL_AND_ERASER_PAINT] += pixels;
       }
     }
-    
-    if (op->colorize) {
+    if (blend_modes & DAB_BLEND_LOCK_ALPHA_PAINT) {
+      draw_dab_pixels_BlendMode_LockAlpha_Paint(mask, rgba_p,
+                                                op->color_r, op->color_g, op->color_b, op->opacity_lock_alpha_paint);
+      stats->blend_pixels[MYPAINT_BLEND_STAT_LOCK_ALPHA_PAINT] += pixels;
+    }
+
+    if (blend_modes & DAB_BLEND_COLORIZE) {
       draw_dab_pixels_BlendMode_Color(mask, rgba_p,
-                                      op->color_r, op->color_g, op->color_b,
-                                      op->colorize*op->opaque*(1<<15));
+                                      op->color_r, op->color_g, op->color_b, op->opacity_colorize);
+      stats->blend_pixels[MYPAINT_BLEND_STAT_COLORIZE] += pixels;
     }
-    if (op->posterize) {
-      draw_dab_pixels_BlendMode_Posterize(mask, rgba_p,
-                                      op->posterize*op->opaque*(1<<15),
-                                      op->posterize_num);
+    if (blend_modes & DAB_BLEND_POSTERIZE) {
+      draw_dab_pixels_BlendMode_Posterize(mask, rgba_p, op->opacity_posterize, op->posterize_num);
+      stats->blend_pixels[MYPAINT_BLEND_STAT_POSTERIZE] += pixels;
+    }
+
+    if (timing) {
+      const double blend_end = get_monotonic_time();
+      stats->mask_time += blend_start - mask_start;
+      stats->blend_time += blend_end - blend_start;
     }
 }
 
 // Must be threadsafe
-void
+// Returns FALSE if operations were queued, but the tile could not be fetched
+gboolean
 process_tile(MyPaintTiledSurface *self, int tx, int ty)
 {
     TileIndex tile_index = {tx, ty};
-    OperationDataDrawDab *op = operation_queue_pop(self->operation_queue, tile_index);
-    if (!op) {
-        return;
+    OperationDataDrawDab op;
+    if (!operation_queue_pop(self->operation_queue, tile_index, &op)) {
+        return TRUE;
     }
+    TRACE_BEGIN(process_tile);
+
+    MyPaintTiledSurfaceStats local_stats;
+    MyPaintTiledSurfaceStats *stats = stats_begin(self, &local_stats);
+    const gboolean timing = self->stats_timing;
 
     MyPaintTileRequest request_data;
     const int mipmap_level = 0;
     mypaint_tile_request_init(&request_data, mipmap_level, tx, ty, FALSE);
 
+    double request_start = timing ? get_monotonic_time() : 0.0;
     mypaint_tiled_surface_tile_request_start(self, &request_data);
+    if (timing) stats->tile_request_time += get_monotonic_time() - request_start;
     uint16_t * rgba_p = request_data.buffer;
     if (!rgba_p) {
         printf("Warning: Unable to get tile!\n");
-        return;
+        stats_end(self, stats, &local_stats);
+        TRACE_END(process_tile);
+        return FALSE;
     }
 
     uint16_t mask[MYPAINT_TILE_SIZE*MYPAINT_TILE_SIZE+2*MYPAINT_TILE_SIZE];
 
-    while (op) {
-        process_op(rgba_p, mask, tile_index.x, tile_index.y, op);
-        free(op);
-        op = operation_queue_pop(self->operation_queue, tile_index);
-    }
+    do {
+        process_op(rgba_p, mask, tile_index.x, tile_index.y, &op, stats, timing);
+    } while (operation_queue_pop(self->operation_queue, tile_index, &op));
 
+    request_start = timing ? get_monotonic_time() : 0.0;
     mypaint_tiled_surface_tile_request_end(self, &request_data);
+    if (timing) stats->tile_request_time += get_monotonic_time() - request_start;
+    stats->tiles_processed++;
+    stats_end(self, stats, &local_stats);
+    TRACE_END(process_tile);
+
+    if (self->area_changed) {
+        self->area_changed(self, tx * MYPAINT_TILE_SIZE, ty * MYPAINT_TILE_SIZE,
+                           MYPAINT_TILE_SIZE, MYPAINT_TILE_SIZE, self->area_changed_user_data);
+    }
+    return TRUE;
 }
 
 void
-update_dirty_bbox(MyPaintRectangle *bbox, OperationDataDrawDab *op)
+update_dirty_bbox(MyPaintRectangle *bbox, const OperationDataDrawDab *op)
 {
     int bb_x, bb_y, bb_w, bb_h;
     float r_fringe = op->radius + 1.0f; // +1.0 should not be required, only to be sure
@@ -659,119 +1486,168 @@ update_dirty_bbox(MyPaintRectangle *bbox, OperationDataDrawDab *op)
     mypaint_rectangle_expand_to_include_point(bbox, bb_x+bb_w-1, bb_y+bb_h-1);
 }
 
-// returns TRUE if the surface was modified
-gboolean draw_dab_internal (MyPaintTiledSurface *self, float x, float y,
-               float radius,
-               float color_r, float color_g, float color_b,
-               float opaque, float hardness, float softness,
-               float color_a,
-               float aspect_ratio, float angle,
-               float lock_alpha,
-               float colorize,
-               float posterize,
-               float posterize_num,
-               float paint,
-               int bbox_index
-               )
-
-{
-    OperationDataDrawDab op_struct;
-    OperationDataDrawDab *op = &op_struct;
-
-    op->x = x;
-    op->y = y;
-    op->radius = radius;
-    op->aspect_ratio = aspect_ratio;
-    op->angle = angle;
-    op->opaque = CLAMP(opaque, 0.0f, 1.0f);
-    op->hardness = CLAMP(hardness, 0.0f, 1.0f);
-    op->softness = CLAMP(softness, 0.0f, 1.0f);
-    op->lock_alpha = CLAMP(lock_alpha, 0.0f, 1.0f);
-    op->colorize = CLAMP(colorize, 0.0f, 1.0f);
-    op->posterize = CLAMP(posterize, 0.0f, 1.0f);
-    op->posterize_num= CLAMP(ROUND(posterize_num * 100.0), 1, 128);
-    op->paint = CLAMP(paint, 0.0f, 1.0f);
-    if (op->radius < 0.1f) return FALSE; // don't bother with dabs smaller than 0.1 pixel
-    if (op->hardness == 0.0f) return FALSE; // infintly small center point, fully transparent outside
-    if (op->softness == 1.0f) return FALSE;
-    if (op->opaque == 0.0f) return FALSE;
-
-    color_r = CLAMP(color_r, 0.0f, 1.0f);
-    color_g = CLAMP(color_g, 0.0f, 1.0f);
-    color_b = CLAMP(color_b, 0.0f, 1.0f);
-    color_a = CLAMP(color_a, 0.0f, 1.0f);
-
-    op->color_r = color_r * (1<<15);
-    op->color_g = color_g * (1<<15);
-    op->color_b = color_b * (1<<15);
-    op->color_a = color_a;
-
-    // blending mode preparation
-    op->normal = 1.0f;
-
-    op->normal *= 1.0f-op->lock_alpha;
-    op->normal *= 1.0f-op->colorize;
-    op->normal *= 1.0f-op->posterize;
-
-    if (op->aspect_ratio<1.0f) op->aspect_ratio=1.0f;
-
-    // Determine the tiles influenced by operation, and queue it for processing for each tile
-    float r_fringe = radius + 1.0f; // +1.0 should not be required, only to be sure
-      
-    int tx1 = floor(floor(x - r_fringe) / MYPAINT_TILE_SIZE);
-    int tx2 = floor(floor(x + r_fringe) / MYPAINT_TILE_SIZE);
-    int ty1 = floor(floor(y - r_fringe) / MYPAINT_TILE_SIZE);
-    int ty2 = floor(floor(y + r_fringe) / MYPAINT_TILE_SIZE);
+// Dabs are prepared in chunks of this many, see prepare_dab_ops()
+#define DAB_CHUNK_SIZE 64
+
+/* Clamp dabs [@base, @base + @n) of @dabs and convert them to operations.
+ * Each step is a loop over the whole chunk, so that the compiler can vectorize
+ * the clamping and fixed point conversion.
+ * Returns the number of dabs that would modify the surface, with their
+ * indices into @ops stored in @kept. */
+static int
+prepare_dab_ops(const MyPaintDabs *dabs, int base, int n,
+                OperationDataDrawDab *ops, int *kept)
+{
+    float opaque[DAB_CHUNK_SIZE];
+    float hardness[DAB_CHUNK_SIZE];
+    float softness[DAB_CHUNK_SIZE];
+    float lock_alpha[DAB_CHUNK_SIZE];
+    float colorize[DAB_CHUNK_SIZE];
+    float posterize[DAB_CHUNK_SIZE];
+    float paint[DAB_CHUNK_SIZE];
+    float color_a[DAB_CHUNK_SIZE];
+
+    for (int i = 0; i < n; i++) {
+        opaque[i] = CLAMP(dabs->opaque[base + i], 0.0f, 1.0f);
+        hardness[i] = CLAMP(dabs->hardness[base + i], 0.0f, 1.0f);
+        softness[i] = CLAMP(dabs->softness[base + i], 0.0f, 1.0f);
+        lock_alpha[i] = CLAMP(dabs->lock_alpha[base + i], 0.0f, 1.0f);
+        colorize[i] = CLAMP(dabs->colorize[base + i], 0.0f, 1.0f);
+        posterize[i] = CLAMP(dabs->posterize[base + i], 0.0f, 1.0f);
+        paint[i] = CLAMP(dabs->paint[base + i], 0.0f, 1.0f);
+        color_a[i] = CLAMP(dabs->alpha_eraser[base + i], 0.0f, 1.0f);
+    }
+
+    // Skip dabs smaller than 0.1 pixel, infinitely small center points (fully
+    // transparent outside), and dabs that are fully soft or fully transparent
+    int kept_n = 0;
+    for (int i = 0; i < n; i++) {
+        kept[kept_n] = i;
+        kept_n += !(dabs->radius[base + i] < 0.1f) && hardness[i] != 0.0f
+            && softness[i] != 1.0f && opaque[i] != 0.0f;
+    }
+    if (kept_n == 0) {
+        return 0;
+    }
+
+    for (int i = 0; i < n; i++) {
+        OperationDataDrawDab *op = &ops[i];
+        const float aspect_ratio = dabs->aspect_ratio[base + i];
+        op->x = dabs->x[base + i];
+        op->y = dabs->y[base + i];
+        op->radius = dabs->radius[base + i];
+        op->hardness = hardness[i];
+        op->softness = softness[i];
+        op->aspect_ratio = aspect_ratio < 1.0f ? 1.0f : aspect_ratio;
+        op->angle = dabs->angle[base + i];
+
+        op->color_r = CLAMP(dabs->color_r[base + i], 0.0f, 1.0f) * (1<<15);
+        op->color_g = CLAMP(dabs->color_g[base + i], 0.0f, 1.0f) * (1<<15);
+        op->color_b = CLAMP(dabs->color_b[base + i], 0.0f, 1.0f) * (1<<15);
+        op->color_a = color_a[i] * (1<<15);
+        op->posterize_num = CLAMP(ROUND(dabs->posterize_num[base + i] * 100.0), 1, 128);
+    }
+
+    // blending mode preparation: resolve which modes apply, and their opacities
+    for (int i = 0; i < n; i++) {
+        OperationDataDrawDab *op = &ops[i];
+        const float normal = (1.0f-lock_alpha[i]) * (1.0f-colorize[i]) * (1.0f-posterize[i]);
+
+        op->opacity_normal = normal*opaque[i]*(1 - paint[i])*(1<<15);
+        op->opacity_lock_alpha = lock_alpha[i]*opaque[i]*(1 - colorize[i])*(1 - posterize[i])*(1 - paint[i])*(1<<15);
+        op->opacity_normal_paint = normal*opaque[i]*paint[i]*(1<<15);
+        op->opacity_lock_alpha_paint = lock_alpha[i]*opaque[i]*(1 - colorize[i])*(1 - posterize[i])*paint[i]*(1<<15);
+        op->opacity_colorize = colorize[i]*opaque[i]*(1<<15);
+        op->opacity_posterize = posterize[i]*opaque[i]*(1<<15);
+
+        op->blend_modes = 0;
+        if (color_a[i] != 1.0f) op->blend_modes |= DAB_BLEND_ERASER;
+        if (paint[i] < 1.0f) {
+            if (normal) op->blend_modes |= DAB_BLEND_NORMAL;
+            if (lock_alpha[i] && color_a[i] != 0) op->blend_modes |= DAB_BLEND_LOCK_ALPHA;
+        }
+        if (paint[i] > 0.0f) {
+            if (normal) op->blend_modes |= DAB_BLEND_NORMAL_PAINT;
+            if (lock_alpha[i] && color_a[i] != 0) op->blend_modes |= DAB_BLEND_LOCK_ALPHA_PAINT;
+        }
+        if (colorize[i]) op->blend_modes |= DAB_BLEND_COLORIZE;
+        if (posterize[i]) op->blend_modes |= DAB_BLEND_POSTERIZE;
+    }
+
+    return kept_n;
+}
+
+// Queue the operation for each of the tiles it touches
+static void
+queue_dab(MyPaintTiledSurface *self, const OperationDataDrawDab *op, int bbox_index,
+          MyPaintTiledSurfaceStats *stats)
+{
+    float r_fringe = op->radius + 1.0f; // +1.0 should not be required, only to be sure
+
+    int tx1 = floor(floor(op->x - r_fringe) / MYPAINT_TILE_SIZE);
+    int tx2 = floor(floor(op->x + r_fringe) / MYPAINT_TILE_SIZE);
+    int ty1 = floor(floor(op->y - r_fringe) / MYPAINT_TILE_SIZE);
+    int ty2 = floor(floor(op->y + r_fringe) / MYPAINT_TILE_SIZE);
+
+    // Stored once, the tiles only hold its index
+    const uint32_t dab = operation_queue_add_dab(self->operation_queue, op,
+                                                 (tx2 - tx1 + 1) * (ty2 - ty1 + 1));
+    if (dab == OPERATION_QUEUE_NO_DAB) {
+        return; // Out of memory, reported by the queue
+    }
 
     for (int ty = ty1; ty <= ty2; ty++) {
         for (int tx = tx1; tx <= tx2; tx++) {
             const TileIndex tile_index = {tx, ty};
-            OperationDataDrawDab *op_copy = (OperationDataDrawDab *)malloc(sizeof(OperationDataDrawDab));
-            *op_copy = *op;
-            operation_queue_add(self->operation_queue, tile_index, op_copy);
+            if (operation_queue_add(self->operation_queue, tile_index, dab)) {
+                stats->tiles_dirtied++;
+                if (self->async) {
+                    // Start rendering right away
+                    tile_scheduler_push(self->tile_scheduler, tile_index);
+                }
+            }
         }
     }
 
-    update_dirty_bbox(&self->bboxes[bbox_index], op);
+    stats->dabs_queued++;
 
-    return TRUE;
+    bboxes_lock(self);
+    update_dirty_bbox(&self->bboxes[bbox_index], op);
+    bboxes_unlock(self);
 }
 
-
-// returns TRUE if the surface was modified
-int draw_dab (MyPaintSurface *surface, float x, float y,
-               float radius,
-               float color_r, float color_g, float color_b,
-               float opaque, float hardness, float softness,
-               float color_a,
-               float aspect_ratio, float angle,
-               float lock_alpha,
-               float colorize,
-               float posterize,
-               float posterize_num,
-               float paint)
+// Queue a copy of the operation moved to (x, y) and rotated to angle
+static void
+queue_dab_at(MyPaintTiledSurface *self, const OperationDataDrawDab *op,
+             float x, float y, float angle, int bbox_index,
+             MyPaintTiledSurfaceStats *stats)
 {
-    MyPaintTiledSurface* self = (MyPaintTiledSurface*)surface;
+    OperationDataDrawDab moved = *op;
+    moved.x = x;
+    moved.y = y;
+    moved.angle = angle;
+    queue_dab(self, &moved, bbox_index, stats);
+}
 
+// Queue the operation along with its symmetric copies
+static void
+queue_dab_with_symmetry(MyPaintTiledSurface *self, const OperationDataDrawDab *op,
+                        MyPaintTiledSurfaceStats *stats)
+{
     // These calls are repeated enough to warrant a local macro, for both readability and correctness.
-#define DDI(x, y, angle, bb_idx) (draw_dab_internal(\
-        self, (x), (y), radius, color_r, color_g, color_b, opaque, \
-        hardness, softness, color_a, aspect_ratio, (angle), \
-        lock_alpha, colorize, posterize, posterize_num, paint, (bb_idx)))
+#define QUEUE_AT(x, y, angle, bb_idx) (queue_dab_at(self, op, (x), (y), (angle), (bb_idx), stats))
 
     // Normal pass
-    gboolean surface_modified = DDI(x, y, angle, 0);
+    queue_dab(self, op, 0, stats);
 
-    int num_bboxes_used = surface_modified ? 1 : 0;
+    int num_bboxes_used = 1;
 
     // Symmetry pass
 
-    // OPTIMIZATION: skip the symmetry pass if surface was not modified by the initial dab;
-    // at current if the initial dab does not modify the surface, none of the symmetry dabs
-    // will either. If/when selection masks are added, this optimization _must_ be removed,
-    // and `surface_modified` must be or'ed with the result of each call to draw_dab_internal.
+    // The symmetric dabs are only drawn if the initial dab modifies the surface, which
+    // the caller has checked already. If/when selection masks are added, this must change.
     MyPaintSymmetryData *symm_data = &self->symmetry_data;
-    if (surface_modified && symm_data->active && symm_data->num_symmetry_matrices) {
+    if (symm_data->active && symm_data->num_symmetry_matrices) {
         const MyPaintSymmetryState symm = symm_data->state_current;
         const int num_bboxes = self->num_bboxes;
         const float rot_angle = 360.0 / symm.num_lines;
@@ -780,27 +1656,27 @@ int draw_dab (MyPaintSurface *surface, float x, float y,
 
         switch (symm.type) {
         case MYPAINT_SYMMETRY_TYPE_VERTICAL: {
-            mypaint_transform_point(&matrices[0], x, y, &x_out, &y_out);
-            DDI(x_out, y_out, -2.0 * (90 + symm.angle) - angle, 1);
+            mypaint_transform_point(&matrices[0], op->x, op->y, &x_out, &y_out);
+            QUEUE_AT(x_out, y_out, -2.0 * (90 + symm.angle) - op->angle, 1);
             num_bboxes_used = 2;
             break;
         }
         case MYPAINT_SYMMETRY_TYPE_HORIZONTAL: {
-            mypaint_transform_point(&matrices[0], x, y, &x_out, &y_out);
-            DDI(x_out, y_out, -2.0 * symm.angle - angle, 1);
+            mypaint_transform_point(&matrices[0], op->x, op->y, &x_out, &y_out);
+            QUEUE_AT(x_out, y_out, -2.0 * symm.angle - op->angle, 1);
             num_bboxes_used = 2;
             break;
         }
         case MYPAINT_SYMMETRY_TYPE_VERTHORZ: {
             // Reflect across horizontal line
-            mypaint_transform_point(&matrices[0], x, y, &x_out, &y_out);
-            DDI(x_out, y_out, -2.0 * symm.angle - angle, 1);
+            mypaint_transform_point(&matrices[0], op->x, op->y, &x_out, &y_out);
+            QUEUE_AT(x_out, y_out, -2.0 * symm.angle - op->angle, 1);
             // Then across the vertical line (diagonal)
-            mypaint_transform_point(&matrices[1], x, y, &x_out, &y_out);
-            DDI(x_out, y_out, angle, 2);
+            mypaint_transform_point(&matrices[1], op->x, op->y, &x_out, &y_out);
+            QUEUE_AT(x_out, y_out, op->angle, 2);
             // Then back across the horizontal line
-            mypaint_transform_point(&matrices[2], x, y, &x_out, &y_out);
-            DDI(x_out, y_out, -2.0 * symm.angle - angle, 3);
+            mypaint_transform_point(&matrices[2], op->x, op->y, &x_out, &y_out);
+            QUEUE_AT(x_out, y_out, -2.0 * symm.angle - op->angle, 3);
             num_bboxes_used = 4;
             break;
         }
@@ -810,14 +1686,14 @@ int draw_dab (MyPaintSurface *surface, float x, float y,
             const int offset = MIN(num_bboxes / 2, symm.num_lines);
             const float dabs_per_bbox = MAX(1, (float)symm.num_lines * 2.0 / num_bboxes);
             const int base_idx = symm.num_lines - 1;
-            const float base_angle = -2 * symm.angle - angle;
+            const float base_angle = -2 * symm.angle - op->angle;
             // draw snowflake dabs for _all_ symmetry lines as we need to reflect the initial dab.
             for (int dab_count = 0; dab_count < symm.num_lines; dab_count++) {
                 // If the number of bboxes cannot fit all snowflake dabs, use half for the rotational dabs
                 // and the other half for the reflected dabs. This is not always optimal, but seldom bad.
                 const int bbox_idx = offset + MIN(roundf(dab_count / dabs_per_bbox), num_bboxes - 1);
-                mypaint_transform_point(&matrices[base_idx + dab_count], x, y, &x_out, &y_out);
-                DDI(x_out, y_out, base_angle - dab_count * rot_angle, bbox_idx);
+                mypaint_transform_point(&matrices[base_idx + dab_count], op->x, op->y, &x_out, &y_out);
+                QUEUE_AT(x_out, y_out, base_angle - dab_count * rot_angle, bbox_idx);
             }
             num_bboxes_used = MIN(self->num_bboxes, symm.num_lines * 2);
             // fall through to rotational to finish the process
@@ -833,8 +1709,8 @@ int draw_dab (MyPaintSurface *surface, float x, float y,
             // draw self->rot_symmetry_lines - 1 rotational dabs since initial pass handles the first dab
             for (int dab_count = 1; dab_count < symm.num_lines; dab_count++) {
                 const int bbox_index = MIN(roundf(dab_count / dabs_per_bbox), num_bboxes - 1);
-                mypaint_transform_point(&matrices[dab_count - 1], x, y, &x_out, &y_out);
-                DDI(x_out, y_out, angle - dab_count * rot_angle, bbox_index);
+                mypaint_transform_point(&matrices[dab_count - 1], op->x, op->y, &x_out, &y_out);
+                QUEUE_AT(x_out, y_out, op->angle - dab_count * rot_angle, bbox_index);
             }
 
             // Use existing (larger) number of bboxes if it was set (in a snowflake pass)
@@ -846,13 +1722,73 @@ int draw_dab (MyPaintSurface *surface, float x, float y,
             break;
         }
     }
-    self->num_bboxes_dirtied = MIN(self->num_bboxes, num_bboxes_used);
-    return surface_modified;
-#undef DDI
+    // Never shrink: a dab that was culled must not drop the bounding boxes of earlier dabs
+    bboxes_lock(self);
+    self->num_bboxes_dirtied = MAX(self->num_bboxes_dirtied, MIN(self->num_bboxes, num_bboxes_used));
+    bboxes_unlock(self);
+#undef QUEUE_AT
 }
 
+// returns the number of dabs that modified the surface
+static int
+draw_dabs (MyPaintSurface *surface, const MyPaintDabs *dabs)
+{
+    MyPaintTiledSurface* self = (MyPaintTiledSurface*)surface;
+    OperationDataDrawDab ops[DAB_CHUNK_SIZE];
+    int kept[DAB_CHUNK_SIZE];
+    int modified = 0;
+    MyPaintTiledSurfaceStats local_stats;
+    MyPaintTiledSurfaceStats *stats = stats_begin(self, &local_stats);
+
+    painting_begin(self);
+    for (int base = 0; base < dabs->num_dabs; base += DAB_CHUNK_SIZE) {
+        const int n = MIN(DAB_CHUNK_SIZE, dabs->num_dabs - base);
+        const int kept_n = prepare_dab_ops(dabs, base, n, ops, kept);
+        for (int i = 0; i < kept_n; i++) {
+            queue_dab_with_symmetry(self, &ops[kept[i]], stats);
+        }
+        modified += kept_n;
+    }
+    painting_end(self);
+
+    // The queue only grows while dabs are added, so its peak is seen here
+    const size_t queued_bytes = operation_queue_get_queued_bytes(self->operation_queue);
+    stats->dabs_culled += dabs->num_dabs - modified;
+    stats->queue_peak_bytes = MAX(stats->queue_peak_bytes, queued_bytes);
+    stats_end(self, stats, &local_stats);
+
+    if (self->max_queue_bytes && queued_bytes > self->max_queue_bytes) {
+        transaction_lock(self);
+        flush_queue_to_limit(self);
+        transaction_unlock(self);
+    }
+    return modified;
+}
 
-void get_color (MyPaintSurface *surface, float x, float y,
+// returns TRUE if the surface was modified
+int draw_dab (MyPaintSurface *surface, float x, float y,
+               float radius,
+               float color_r, float color_g, float color_b,
+               float opaque, float hardness, float softness,
+               float color_a,
+               float aspect_ratio, float angle,
+               float lock_alpha,
+               float colorize,
+               float posterize,
+               float posterize_num,
+               float paint)
+{
+    // A batch of one
+    const MyPaintDabs dab = {
+        1, &x, &y, &radius, &color_r, &color_g, &color_b, &opaque, &hardness, &softness,
+        &color_a, &aspect_ratio, &angle, &lock_alpha, &colorize, &posterize, &posterize_num, &paint
+    };
+    return draw_dabs(surface, &dab) > 0;
+}
+
+
+static void
+get_color_unlocked (MyPaintSurface *surface, float x, float y,
                   float radius,
                   float * color_r, float * color_g, float * color_b, float * color_a,
                   float paint
@@ -868,6 +1804,7 @@ void get_color (MyPaintSurface *surface, float x, float y,
 
     float sum_weight, sum_r, sum_g, sum_b, sum_a;
     sum_weight = sum_r = sum_g = sum_b = sum_a = 0.0f;
+    int sampled = 0;
 
     // in case we return with an error
     *color_r = 0.0f;
@@ -912,7 +1849,16 @@ void get_color (MyPaintSurface *surface, float x, float y,
       for (int tx = tx1; tx <= tx2; tx++) {
 
         // Flush queued draw_dab operations
-        process_tile(self, tx, ty);
+        if (self->async || self->transaction_lock) {
+            // Process the tile here if no other thread has started on it yet,
+            // including any dabs added by other painting threads meanwhile
+            const TileIndex tile_index = {tx, ty};
+            do {
+                process_tile_async_func(self, tile_index);
+            } while (operation_queue_wait_tile_idle(self->operation_queue, tile_index));
+        } else {
+            process_tile(self, tx, ty);
+        }
 
         MyPaintTileRequest request_data;
         const int mipmap_level = 0;
@@ -941,7 +1887,7 @@ void get_color (MyPaintSurface *surface, float x, float y,
         // TODO: try atomic operations instead
         #pragma omp critical
         {
-        get_color_pixels_accumulate (
+        sampled += get_color_pixels_accumulate (
           mask, rgba_p, &sum_weight, &sum_r, &sum_g, &sum_b, &sum_a, paint,
           sample_interval, random_sample_rate);
         }
@@ -950,6 +1896,12 @@ void get_color (MyPaintSurface *surface, float x, float y,
       }
     }
 
+    MyPaintTiledSurfaceStats local_stats;
+    MyPaintTiledSurfaceStats *stats = stats_begin(self, &local_stats);
+    stats->get_color_calls++;
+    stats->get_color_pixels += sampled;
+    stats_end(self, stats, &local_stats);
+
     assert(sum_weight > 0.0f);
     sum_a /= sum_weight;
 
@@ -978,6 +1930,21 @@ void get_color (MyPaintSurface *surface, float x, float y,
     }
 }
 
+void get_color (MyPaintSurface *surface, float x, float y,
+                  float radius,
+                  float * color_r, float * color_g, float * color_b, float * color_a,
+                  float paint
+                  )
+{
+    MyPaintTiledSurface *self = (MyPaintTiledSurface *)surface;
+
+    painting_begin(self);
+    TRACE_BEGIN(get_color);
+    get_color_unlocked(surface, x, y, radius, color_r, color_g, color_b, color_a, paint);
+    TRACE_END(get_color);
+    painting_end(self);
+}
+
 /**
  * mypaint_tiled_surface_init: (skip)
  *
@@ -991,6 +1958,7 @@ mypaint_tiled_surface_init(MyPaintTiledSurface *self,
 {
     mypaint_surface_init(&self->parent);
     self->parent.draw_dab = draw_dab;
+    self->parent.draw_dabs = draw_dabs;
     self->parent.get_color = get_color;
     self->parent.begin_atomic = begin_atomic_default;
     self->parent.end_atomic = end_atomic_default;
@@ -1000,6 +1968,17 @@ mypaint_tiled_surface_init(MyPaintTiledSurface *self,
 
     self->tile_size = MYPAINT_TILE_SIZE;
     self->threadsafe_tile_requests = FALSE;
+    self->tile_scheduler = NULL;
+    self->num_threads = 0;
+    self->min_batch_size = DEFAULT_MIN_BATCH_SIZE;
+    self->async = FALSE;
+    self->area_changed = NULL;
+    self->area_changed_user_data = NULL;
+    self->tiles_pending = FALSE;
+    self->max_queue_bytes = 0;
+    self->transaction_lock = NULL;
+    self->stats = tiled_surface_stats_new();
+    self->stats_timing = FALSE;
 
     self->num_bboxes = NUM_BBOXES_DEFAULT;
     self->bboxes = self->default_bboxes;
@@ -1019,7 +1998,10 @@ mypaint_tiled_surface_init(MyPaintTiledSurface *self,
 void
 mypaint_tiled_surface_destroy(MyPaintTiledSurface *self)
 {
+    tile_scheduler_free(self->tile_scheduler);
     operation_queue_free(self->operation_queue);
+    transaction_lock_free(self->transaction_lock);
+    tiled_surface_stats_free(self->stats);
     if (self->bboxes != self->default_bboxes) {
       free(self->bboxes);
     }
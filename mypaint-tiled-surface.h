@@ -1,6 +1,7 @@
 #ifndef MYPAINTTILEDSURFACE_H
 #define MYPAINTTILEDSURFACE_H
 
+#include <stddef.h>
 #include <stdint.h>
 #include "mypaint-surface.h"
 #include "mypaint-symmetry.h"
@@ -11,6 +12,8 @@
 G_BEGIN_DECLS
 
 typedef struct MyPaintTiledSurface MyPaintTiledSurface;
+typedef struct TransactionLock TransactionLock;
+typedef struct TiledSurfaceStats TiledSurfaceStats;
 
 typedef struct {
     int tx;
@@ -28,7 +31,58 @@ mypaint_tile_request_init(MyPaintTileRequest *data, int level,
 
 typedef void (*MyPaintTileRequestStartFunction) (MyPaintTiledSurface *self, MyPaintTileRequest *request);
 typedef void (*MyPaintTileRequestEndFunction) (MyPaintTiledSurface *self, MyPaintTileRequest *request);
-typedef void (*MyPaintTiledSurfaceAreaChanged) (MyPaintTiledSurface *self, int bb_x, int bb_y, int bb_w, int bb_h);
+typedef void (*MyPaintTiledSurfaceAreaChanged) (MyPaintTiledSurface *self, int bb_x, int bb_y, int bb_w, int bb_h,
+                                                void *user_data);
+
+/**
+  * MyPaintBlendStat:
+  *
+  * Indices into #MyPaintTiledSurfaceStats.blend_pixels, one per blend kernel.
+  */
+typedef enum {
+    MYPAINT_BLEND_STAT_NORMAL,
+    MYPAINT_BLEND_STAT_NORMAL_AND_ERASER,
+    MYPAINT_BLEND_STAT_LOCK_ALPHA,
+    MYPAINT_BLEND_STAT_NORMAL_PAINT,
+    MYPAINT_BLEND_STAT_NORMAL_AND_ERASER_PAINT,
+    MYPAINT_BLEND_STAT_LOCK_ALPHA_PAINT,
+    MYPAINT_BLEND_STAT_COLORIZE,
+    MYPAINT_BLEND_STAT_POSTERIZE,
+    MYPAINT_BLEND_STATS_COUNT
+} MyPaintBlendStat;
+
+/**
+  * MyPaintTiledSurfaceStats:
+  * @dabs_queued: Dabs queued for rendering, including symmetric copies
+  * @dabs_culled: Dabs dropped before queueing because they would not change the surface
+  * @tiles_dirtied: Tiles that went from clean to having queued dabs
+  * @tiles_processed: Tiles whose queued dabs were rendered
+  * @mask_pixels: Non-transparent dab mask pixels computed while rendering
+  * @blend_pixels: Pixels written by each blend kernel, indexed by #MyPaintBlendStat
+  * @get_color_calls: Number of color picks
+  * @get_color_pixels: Pixels sampled by the color picks
+  * @queue_peak_bytes: Most memory used by queued dabs at once
+  * @mask_time: Seconds spent computing dab masks
+  * @blend_time: Seconds spent in the blend kernels
+  * @tile_request_time: Seconds spent in the tile request vfuncs while rendering
+  *
+  * Counters collected since the surface was created or the stats were reset.
+  * The times are only measured after mypaint_tiled_surface_set_stats_timing().
+  */
+typedef struct {
+    uint64_t dabs_queued;
+    uint64_t dabs_culled;
+    uint64_t tiles_dirtied;
+    uint64_t tiles_processed;
+    uint64_t mask_pixels;
+    uint64_t blend_pixels[MYPAINT_BLEND_STATS_COUNT];
+    uint64_t get_color_calls;
+    uint64_t get_color_pixels;
+    size_t queue_peak_bytes;
+    double mask_time;
+    double blend_time;
+    double tile_request_time;
+} MyPaintTiledSurfaceStats;
 
 
 /**
@@ -51,6 +105,17 @@ struct MyPaintTiledSurface {
     MyPaintRectangle default_bboxes[NUM_BBOXES_DEFAULT];
     gboolean threadsafe_tile_requests;
     int tile_size;
+    struct TileScheduler *tile_scheduler;
+    int num_threads;
+    int min_batch_size;
+    gboolean async;
+    MyPaintTiledSurfaceAreaChanged area_changed;
+    void *area_changed_user_data;
+    gboolean tiles_pending;
+    size_t max_queue_bytes;
+    TransactionLock *transaction_lock;
+    TiledSurfaceStats *stats;
+    gboolean stats_timing;
 };
 
 void
@@ -73,9 +138,52 @@ mypaint_tiled_surface_get_alpha (MyPaintTiledSurface *self, float x, float y, fl
 void mypaint_tiled_surface_tile_request_start(MyPaintTiledSurface *self, MyPaintTileRequest *request);
 void mypaint_tiled_surface_tile_request_end(MyPaintTiledSurface *self, MyPaintTileRequest *request);
 
+void
+mypaint_tiled_surface_set_num_threads(MyPaintTiledSurface *self, int num_threads);
+
+int
+mypaint_tiled_surface_get_num_threads(MyPaintTiledSurface *self);
+
+void
+mypaint_tiled_surface_set_min_batch_size(MyPaintTiledSurface *self, int min_batch_size);
+
+void
+mypaint_tiled_surface_set_max_queue_bytes(MyPaintTiledSurface *self, size_t max_queue_bytes);
+
+gboolean
+mypaint_tiled_surface_set_async(MyPaintTiledSurface *self, gboolean async);
+
+gboolean
+mypaint_tiled_surface_get_async(MyPaintTiledSurface *self);
+
+gboolean
+mypaint_tiled_surface_set_concurrent_painting(MyPaintTiledSurface *self, gboolean concurrent);
+
+gboolean
+mypaint_tiled_surface_get_concurrent_painting(MyPaintTiledSurface *self);
+
+void
+mypaint_tiled_surface_set_area_changed_callback(MyPaintTiledSurface *self,
+                                                MyPaintTiledSurfaceAreaChanged area_changed,
+                                                void *user_data);
+
+void
+mypaint_tiled_surface_get_stats(MyPaintTiledSurface *self, MyPaintTiledSurfaceStats *stats);
+
+void
+mypaint_tiled_surface_reset_stats(MyPaintTiledSurface *self);
+
+void
+mypaint_tiled_surface_set_stats_timing(MyPaintTiledSurface *self, gboolean enabled);
+
 void mypaint_tiled_surface_begin_atomic(MyPaintTiledSurface *self);
 void mypaint_tiled_surface_end_atomic(MyPaintTiledSurface *self, MyPaintRectangles *roi);
 
+int
+mypaint_tiled_surface_end_atomic_budgeted(MyPaintTiledSurface *self, MyPaintRectangles *roi,
+                                          const MyPaintRectangle *viewport,
+                                          double time_budget, int tile_budget);
+
 G_END_DECLS
 
 #endif // MYPAINTTILEDSURFACE_H
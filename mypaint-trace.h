@@ -0,0 +1,26 @@
+#ifndef MYPAINTTRACE_H
+#define MYPAINTTRACE_H
+
+#include "mypaint-glib-compat.h"
+
+G_BEGIN_DECLS
+
+/* With libmypaint configured with --enable-tracing, the brush engine and
+ * the tiled surface record when each stroke_to, dab, transaction, tile and
+ * tile request starts and ends. The events are kept in a ring buffer per
+ * thread, holding the most recent ones, and can be written out in the
+ * Chrome trace event format, for chrome://tracing or the Perfetto UI.
+ */
+
+gboolean
+mypaint_trace_is_enabled(void);
+
+gboolean
+mypaint_trace_write_json(const char *path);
+
+void
+mypaint_trace_clear(void);
+
+G_END_DECLS
+
+#endif // MYPAINTTRACE_H
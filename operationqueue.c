@@ -17,8 +17,14 @@
 #include "config.h"
 
 #include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
 #include <assert.h>
 
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
 #if MYPAINT_CONFIG_USE_GLIB
 #include <glib.h>
 #else // not MYPAINT_CONFIG_USE_GLIB
@@ -26,30 +32,231 @@
 #endif
 
 #include "operationqueue.h"
-#include "fifo.h"
+
+/* Operations queued for a single tile, as indices into the dab buffer.
+ * Allocated when the first operation is added, freed again when the
+ * queue has been drained and the tile is not held by a consumer. */
+typedef struct {
+    uint32_t *dabs;
+    int first;  // index of the next dab to pop
+    int end;    // one past the last dab pushed
+    int capacity;
+    gboolean busy;
+} TileOperations;
+
+#define TILE_OPERATIONS_INITIAL_CAPACITY 16
+
+/* Memory used by one queued operation */
+#define OPERATION_BYTES sizeof(uint32_t)
+
+/* The dab buffer is made of segments that double in size, so that dabs never
+ * move once added, and can be read while other threads are adding more.
+ * Segment s holds DAB_SEGMENT_FIRST_SIZE << s dabs. */
+#define DAB_SEGMENT_FIRST_BITS 12
+#define DAB_SEGMENT_FIRST_SIZE (1 << DAB_SEGMENT_FIRST_BITS)
+#define DAB_SEGMENTS_MAX 21 // enough for any 32 bit index
+
+/* Tiles are spread over this many locks, so that threads working on
+ * different tiles rarely wait for each other */
+#define NUM_STRIPES 32
+
+/* Without pthreads the queue is never shared between threads, and the
+ * locks are placeholders that mutex_lock() and mutex_unlock() ignore */
+#ifdef HAVE_PTHREAD
+typedef pthread_mutex_t QueueMutex;
+#else
+typedef int QueueMutex;
+#endif
+
+typedef struct {
+    QueueMutex lock;
+#ifdef HAVE_PTHREAD
+    pthread_cond_t tile_idle_cond;
+#endif
+} QueueStripe;
 
 struct OperationQueue {
     TileMap *tile_map;
 
     TileIndex *dirty_tiles;
     int dirty_tiles_n;
+
+    // All dabs added since the queue was last empty. Dabs touching several
+    // tiles are stored once, and referenced by index from each of them.
+    OperationDataDrawDab *dab_segments[DAB_SEGMENTS_MAX];
+    uint32_t dabs_n;
+
+    // Consumers do not update this, it is resynchronized by
+    // operation_queue_clear_dirty_tiles() and operation_queue_prune_dirty_tiles()
+    size_t queued_bytes;
+
+    gboolean threadsafe;
+    // Locking order: map_lock, then a stripe lock, then dirty_lock or dabs_lock.
+    // The map is only written to when it grows, or to prune the dirty tiles.
+#ifdef HAVE_PTHREAD
+    pthread_rwlock_t map_lock;
+#endif
+    QueueMutex dirty_lock; // dirty_tiles
+    QueueMutex dabs_lock;  // dabs_n, dab_segments and queued_bytes
+    QueueStripe stripes[NUM_STRIPES];
 };
 
-/* For use with queue_delete */
-void
-operation_delete_func(void *user_data) {
-    if (user_data) {
-        free(user_data);
+static inline QueueStripe *
+get_stripe(OperationQueue *self, TileIndex index)
+{
+    const unsigned int hash = (unsigned int)index.x * 73856093u ^ (unsigned int)index.y * 19349663u;
+    return &self->stripes[hash % NUM_STRIPES];
+}
+
+static inline void
+map_read_lock(OperationQueue *self)
+{
+#ifdef HAVE_PTHREAD
+    if (self->threadsafe) pthread_rwlock_rdlock(&self->map_lock);
+#endif
+}
+
+static inline void
+map_write_lock(OperationQueue *self)
+{
+#ifdef HAVE_PTHREAD
+    if (self->threadsafe) pthread_rwlock_wrlock(&self->map_lock);
+#endif
+}
+
+static inline void
+map_unlock(OperationQueue *self)
+{
+#ifdef HAVE_PTHREAD
+    if (self->threadsafe) pthread_rwlock_unlock(&self->map_lock);
+#endif
+}
+
+/* Lock the tile @index, and the map it is in */
+static inline void
+tile_lock(OperationQueue *self, TileIndex index)
+{
+    map_read_lock(self);
+#ifdef HAVE_PTHREAD
+    if (self->threadsafe) pthread_mutex_lock(&get_stripe(self, index)->lock);
+#endif
+}
+
+static inline void
+tile_unlock(OperationQueue *self, TileIndex index)
+{
+#ifdef HAVE_PTHREAD
+    if (self->threadsafe) pthread_mutex_unlock(&get_stripe(self, index)->lock);
+#endif
+    map_unlock(self);
+}
+
+static inline void
+mutex_lock(OperationQueue *self, QueueMutex *mutex)
+{
+#ifdef HAVE_PTHREAD
+    if (self->threadsafe) pthread_mutex_lock(mutex);
+#endif
+}
+
+static inline void
+mutex_unlock(OperationQueue *self, QueueMutex *mutex)
+{
+#ifdef HAVE_PTHREAD
+    if (self->threadsafe) pthread_mutex_unlock(mutex);
+#endif
+}
+
+/* Segment holding dab @dab, and the position within it */
+static inline int
+dab_segment(uint32_t dab, uint32_t *offset_out)
+{
+    const uint32_t n = (dab >> DAB_SEGMENT_FIRST_BITS) + 1;
+    int segment = 0;
+    while (n >> (segment + 1)) {
+        segment++;
     }
+    *offset_out = dab - (((uint32_t)1 << segment) - 1) * DAB_SEGMENT_FIRST_SIZE;
+    return segment;
 }
 
+static inline OperationDataDrawDab *
+get_dab(OperationQueue *self, uint32_t dab)
+{
+    uint32_t offset;
+    const int segment = dab_segment(dab, &offset);
+    return &self->dab_segments[segment][offset];
+}
+
+/* Returns NULL if out of memory */
+static TileOperations *
+tile_operations_new(void)
+{
+    TileOperations *tile_ops = (TileOperations *)malloc(sizeof(TileOperations));
+    if (!tile_ops) {
+        return NULL;
+    }
+    tile_ops->dabs = (uint32_t *)malloc(TILE_OPERATIONS_INITIAL_CAPACITY * sizeof(uint32_t));
+    if (!tile_ops->dabs) {
+        free(tile_ops);
+        return NULL;
+    }
+    tile_ops->first = 0;
+    tile_ops->end = 0;
+    tile_ops->capacity = TILE_OPERATIONS_INITIAL_CAPACITY;
+    tile_ops->busy = FALSE;
+    return tile_ops;
+}
 
 void
-free_fifo(void *item) {
-    Fifo *op_queue = item;
-    if (op_queue) {
-        fifo_free(op_queue, operation_delete_func);
+free_tile_operations(void *item) {
+    TileOperations *tile_ops = item;
+    if (tile_ops) {
+        free(tile_ops->dabs);
+        free(tile_ops);
+    }
+}
+
+static inline int
+tile_operations_length(TileOperations *tile_ops)
+{
+    return tile_ops->end - tile_ops->first;
+}
+
+/* Returns FALSE if the dab could not be added because out of memory,
+ * in which case the queued dabs are kept as they were */
+static gboolean
+tile_operations_push(TileOperations *tile_ops, uint32_t dab)
+{
+    if (tile_ops->end == tile_ops->capacity) {
+        const int length = tile_operations_length(tile_ops);
+        if (length > tile_ops->capacity / 2) {
+            uint32_t *dabs = (uint32_t *)realloc(tile_ops->dabs, 2 * tile_ops->capacity * sizeof(uint32_t));
+            if (dabs) {
+                tile_ops->dabs = dabs;
+                tile_ops->capacity *= 2;
+            }
+        }
+        // Reuse the space of the dabs that were popped already
+        memmove(tile_ops->dabs, tile_ops->dabs + tile_ops->first, length * sizeof(uint32_t));
+        tile_ops->first = 0;
+        tile_ops->end = length;
+        if (length == tile_ops->capacity) {
+            return FALSE;
+        }
+    }
+    tile_ops->dabs[tile_ops->end++] = dab;
+    return TRUE;
+}
+
+/* Returns the operations for @index, or NULL if none are queued */
+static TileOperations *
+get_tile_operations(OperationQueue *self, TileIndex index)
+{
+    if (!tile_map_contains(self->tile_map, index)) {
+        return NULL;
     }
+    return (TileOperations *)*tile_map_get(self->tile_map, index);
 }
 
 gboolean
@@ -67,7 +274,7 @@ operation_queue_resize(OperationQueue *self, int new_size)
         }
         return TRUE;
     } else {
-        TileMap *new_tile_map = tile_map_new(new_size, sizeof(Fifo *), free_fifo);
+        TileMap *new_tile_map = tile_map_new(new_size, sizeof(TileOperations *), free_tile_operations);
         const int new_map_size = new_size*2*new_size*2;
         TileIndex *new_dirty_tiles = (TileIndex *)malloc(new_map_size*sizeof(TileIndex));
 
@@ -96,6 +303,20 @@ operation_queue_new(void)
     self->tile_map = NULL;
     self->dirty_tiles_n = 0;
     self->dirty_tiles = NULL;
+    memset(self->dab_segments, 0, sizeof(self->dab_segments));
+    self->dabs_n = 0;
+    self->queued_bytes = 0;
+
+    self->threadsafe = FALSE;
+#ifdef HAVE_PTHREAD
+    pthread_rwlock_init(&self->map_lock, NULL);
+    pthread_mutex_init(&self->dirty_lock, NULL);
+    pthread_mutex_init(&self->dabs_lock, NULL);
+    for (int i = 0; i < NUM_STRIPES; i++) {
+        pthread_mutex_init(&self->stripes[i].lock, NULL);
+        pthread_cond_init(&self->stripes[i].tile_idle_cond, NULL);
+    }
+#endif
 
 #ifdef HEAVY_DEBUG
     operation_queue_resize(self, 1);
@@ -110,10 +331,38 @@ void
 operation_queue_free(OperationQueue *self)
 {
     operation_queue_resize(self, 0); // free the tile map data
+    for (int i = 0; i < DAB_SEGMENTS_MAX; i++) {
+        free(self->dab_segments[i]);
+    }
 
+#ifdef HAVE_PTHREAD
+    for (int i = 0; i < NUM_STRIPES; i++) {
+        pthread_cond_destroy(&self->stripes[i].tile_idle_cond);
+        pthread_mutex_destroy(&self->stripes[i].lock);
+    }
+    pthread_mutex_destroy(&self->dabs_lock);
+    pthread_mutex_destroy(&self->dirty_lock);
+    pthread_rwlock_destroy(&self->map_lock);
+#endif
     free(self);
 }
 
+/* Make the queue safe to use from any number of producer threads adding
+ * operations and consumer threads processing them, at the same time.
+ *
+ * Must not be called while other threads are using the queue.
+ * Without pthreads support the queue is never threadsafe, and FALSE is returned. */
+gboolean
+operation_queue_set_threadsafe(OperationQueue *self, gboolean threadsafe)
+{
+#ifdef HAVE_PTHREAD
+    self->threadsafe = threadsafe;
+    return TRUE;
+#else
+    return !threadsafe;
+#endif
+}
+
 int
 tile_equal(TileIndex a, TileIndex b)
 {
@@ -148,7 +397,8 @@ remove_duplicate_tiles(TileIndex *array, size_t length)
  * The consumer that actually does the processing should iterate over this list
  * of tiles, and use operation_queue_pop() to pop all the operations.
  *
- * Concurrency: This function is not thread-safe on the same @self instance. */
+ * Concurrency: This function is not thread-safe on the same @self instance,
+ * and must not be called while operations are being added. */
 int
 operation_queue_get_dirty_tiles(OperationQueue *self, TileIndex** tiles_out)
 {
@@ -158,6 +408,19 @@ operation_queue_get_dirty_tiles(OperationQueue *self, TileIndex** tiles_out)
     return self->dirty_tiles_n;
 }
 
+/* Free the dab segments past the first, keeping memory use down after a large transaction.
+ * Must be called with the map locked for writing. */
+static void
+trim_dab_segments(OperationQueue *self)
+{
+    uint32_t offset;
+    const int last_used = self->dabs_n ? dab_segment(self->dabs_n - 1, &offset) : 0;
+    for (int i = last_used + 1; i < DAB_SEGMENTS_MAX; i++) {
+        free(self->dab_segments[i]);
+        self->dab_segments[i] = NULL;
+    }
+}
+
 /* Clears the list of dirty tiles
  * Consumers should call this after having processed all the tiles.
  *
@@ -165,91 +428,350 @@ operation_queue_get_dirty_tiles(OperationQueue *self, TileIndex** tiles_out)
 void
 operation_queue_clear_dirty_tiles(OperationQueue *self)
 {
+    map_write_lock(self);
     // operation_queue_add will overwrite the invalid tiles as new dirty tiles comes in
     self->dirty_tiles_n = 0;
+    // All tiles have been processed, so no dab is referenced anymore
+    mutex_lock(self, &self->dabs_lock);
+    self->dabs_n = 0;
+    trim_dab_segments(self);
+    self->queued_bytes = 0;
+    mutex_unlock(self, &self->dabs_lock);
+    map_unlock(self);
+}
+
+/* Renumber the dabs that are still queued for some tile, dropping the others.
+ * Dabs keep their relative order. Must be called with the map locked for writing. */
+static void
+compact_dabs(OperationQueue *self)
+{
+    uint32_t *new_index = (uint32_t *)calloc(self->dabs_n, sizeof(uint32_t));
+    if (!new_index) {
+        return; // Retry on the next prune
+    }
+
+    for (int i = 0; i < self->dirty_tiles_n; i++) {
+        TileOperations *tile_ops = get_tile_operations(self, self->dirty_tiles[i]);
+        for (int j = tile_ops->first; j < tile_ops->end; j++) {
+            new_index[tile_ops->dabs[j]] = 1;
+        }
+    }
+
+    uint32_t live = 0;
+    for (uint32_t d = 0; d < self->dabs_n; d++) {
+        if (new_index[d]) {
+            *get_dab(self, live) = *get_dab(self, d);
+            new_index[d] = live++;
+        }
+    }
+    self->dabs_n = live;
+    trim_dab_segments(self);
+
+    for (int i = 0; i < self->dirty_tiles_n; i++) {
+        TileOperations *tile_ops = get_tile_operations(self, self->dirty_tiles[i]);
+        for (int j = tile_ops->first; j < tile_ops->end; j++) {
+            tile_ops->dabs[j] = new_index[tile_ops->dabs[j]];
+        }
+    }
+    free(new_index);
+}
+
+/* Removes the tiles that have nothing queued or in progress from the list of
+ * dirty tiles, for consumers that only processed some of them, and frees
+ * the space of dabs that are no longer queued for any tile.
+ * Returns the number of tiles left in the list.
+ *
+ * Concurrency: Must not be called while operations are being added. If the
+ * queue is threadsafe, consumers may pop operations concurrently. */
+int
+operation_queue_prune_dirty_tiles(OperationQueue *self)
+{
+    map_write_lock(self);
+
+    int kept = 0;
+    for (int i = 0; i < self->dirty_tiles_n; i++) {
+        if (get_tile_operations(self, self->dirty_tiles[i])) {
+            self->dirty_tiles[kept++] = self->dirty_tiles[i];
+        }
+    }
+    self->dirty_tiles_n = remove_duplicate_tiles(self->dirty_tiles, kept);
+
+    size_t queued_ops = 0;
+    for (int i = 0; i < self->dirty_tiles_n; i++) {
+        queued_ops += tile_operations_length(get_tile_operations(self, self->dirty_tiles[i]));
+    }
+
+    // Dabs are only freed in bulk, drop them once most are no longer referenced
+    mutex_lock(self, &self->dabs_lock);
+    if (queued_ops == 0) {
+        self->dabs_n = 0;
+        trim_dab_segments(self);
+    } else if (self->dabs_n > 2 * queued_ops) {
+        compact_dabs(self);
+    }
+    self->queued_bytes = queued_ops * OPERATION_BYTES + self->dabs_n * sizeof(OperationDataDrawDab);
+    mutex_unlock(self, &self->dabs_lock);
+
+    const int remaining = self->dirty_tiles_n;
+    map_unlock(self);
+    return remaining;
+}
+
+/* Approximate memory used by the queued operations, in bytes
+ * May overestimate, see operation_queue_prune_dirty_tiles() for an exact figure.
+ *
+ * Concurrency: This function is reentrant if the queue is threadsafe. */
+size_t
+operation_queue_get_queued_bytes(OperationQueue *self)
+{
+    mutex_lock(self, &self->dabs_lock);
+    const size_t queued_bytes = self->queued_bytes;
+    mutex_unlock(self, &self->dabs_lock);
+    return queued_bytes;
+}
+
+/* Store a dab for use with operation_queue_add(), which is then to be called
+ * for each of the @tiles_n tiles it touches.
+ * Returns the index of the dab, valid until the tiles it is added to have
+ * been processed and the dirty tiles cleared or pruned, or
+ * OPERATION_QUEUE_NO_DAB if out of memory.
+ *
+ * Concurrency: This function is reentrant if the queue is threadsafe. */
+uint32_t
+operation_queue_add_dab(OperationQueue *self, const OperationDataDrawDab *op, int tiles_n)
+{
+    mutex_lock(self, &self->dabs_lock);
+
+    assert(self->dabs_n < OPERATION_QUEUE_NO_DAB);
+    const uint32_t dab = self->dabs_n;
+    uint32_t offset;
+    const int segment = dab_segment(dab, &offset);
+    if (!self->dab_segments[segment]) {
+        const size_t segment_size = (size_t)DAB_SEGMENT_FIRST_SIZE << segment;
+        self->dab_segments[segment] = (OperationDataDrawDab *)malloc(segment_size * sizeof(OperationDataDrawDab));
+        if (!self->dab_segments[segment]) {
+            mutex_unlock(self, &self->dabs_lock);
+            fprintf(stderr, "CRITICAL: unable to allocate memory for %zu queued dabs\n", segment_size);
+            return OPERATION_QUEUE_NO_DAB;
+        }
+    }
+    self->dabs_n++;
+    OperationDataDrawDab *slot = &self->dab_segments[segment][offset];
+    self->queued_bytes += sizeof(OperationDataDrawDab) + tiles_n * OPERATION_BYTES;
+
+    mutex_unlock(self, &self->dabs_lock);
+
+    // Nobody else knows about the dab until it is added to a tile
+    *slot = *op;
+    return dab;
 }
 
-/* Add an operation to the queue for tile @index
+/* Queue the dab with index @dab, from operation_queue_add_dab(), for tile @index
  * Note: if an operation affects more than one tile, it must be added once per tile.
  *
- * Concurrency: This function is not thread-safe on the same @self instance. */
-void
-operation_queue_add(OperationQueue *self, TileIndex index, OperationDataDrawDab *op)
+ * Returns TRUE if the tile had nothing queued and is not held by a consumer,
+ * meaning that the caller is responsible for getting it processed.
+ *
+ * Concurrency: This function is reentrant if the queue is threadsafe. Otherwise,
+ * only one thread may add operations at a time, and nothing may be popped meanwhile. */
+gboolean
+operation_queue_add(OperationQueue *self, TileIndex index, uint32_t dab)
 {
+    gboolean newly_dirty = FALSE;
+
+    map_read_lock(self);
     while (!tile_map_contains(self->tile_map, index)) {
+        // Growing the map moves all tiles, nobody else may hold any of them
+        map_unlock(self);
+        map_write_lock(self);
+        while (!tile_map_contains(self->tile_map, index)) {
 #ifdef HEAVY_DEBUG
-        operation_queue_resize(self, self->tile_map->size+1);
+            operation_queue_resize(self, self->tile_map->size+1);
 #else
-        operation_queue_resize(self, self->tile_map->size*2);
+            operation_queue_resize(self, self->tile_map->size*2);
 #endif
+        }
+        map_unlock(self);
+        map_read_lock(self);
     }
 
-    Fifo **queue_pointer = (Fifo **)tile_map_get(self->tile_map, index);
-    Fifo *op_queue = *queue_pointer;
+    QueueStripe *stripe = get_stripe(self, index);
+    mutex_lock(self, &stripe->lock);
+
+    TileOperations **tile_ops_pointer = (TileOperations **)tile_map_get(self->tile_map, index);
+    TileOperations *tile_ops = *tile_ops_pointer;
 
-    if (op_queue == NULL) {
+    if (tile_ops == NULL) {
         // Lazy initialization
-        op_queue = fifo_new();
-        *queue_pointer = op_queue;
+        tile_ops = tile_operations_new();
+        if (!tile_ops) {
+            mutex_unlock(self, &stripe->lock);
+            map_unlock(self);
+            fprintf(stderr, "CRITICAL: unable to allocate memory, dab dropped for tile %d,%d\n",
+                    index.x, index.y);
+            return FALSE;
+        }
+        *tile_ops_pointer = tile_ops;
+        newly_dirty = TRUE;
     }
 
-    if (fifo_peek_first(op_queue) == NULL) {
-        // Critical section, not thread-safe
-       if (!(self->dirty_tiles_n < self->tile_map->size*2*self->tile_map->size*2)) {
-           // Prune duplicate tiles that cause us to almost exceed max
-           self->dirty_tiles_n = remove_duplicate_tiles(self->dirty_tiles, self->dirty_tiles_n);
-       }
-       assert(self->dirty_tiles_n < self->tile_map->size*2*self->tile_map->size*2);
-       self->dirty_tiles[self->dirty_tiles_n++] = index;
+    if (tile_operations_length(tile_ops) == 0) {
+        mutex_lock(self, &self->dirty_lock);
+        if (!(self->dirty_tiles_n < self->tile_map->size*2*self->tile_map->size*2)) {
+            // Prune duplicate tiles that cause us to almost exceed max
+            self->dirty_tiles_n = remove_duplicate_tiles(self->dirty_tiles, self->dirty_tiles_n);
+        }
+        assert(self->dirty_tiles_n < self->tile_map->size*2*self->tile_map->size*2);
+        self->dirty_tiles[self->dirty_tiles_n++] = index;
+        mutex_unlock(self, &self->dirty_lock);
+    }
+    if (!tile_operations_push(tile_ops, dab)) {
+        // The tile keeps the dabs queued before, and is already known to be dirty
+        fprintf(stderr, "CRITICAL: unable to allocate memory, dab dropped for tile %d,%d\n",
+                index.x, index.y);
     }
-    fifo_push(op_queue, (void *)op);
+
+    mutex_unlock(self, &stripe->lock);
+    map_unlock(self);
+    return newly_dirty;
 }
 
-/* Pop an operation off the queue for tile @index
- * The user of this function is responsible for freeing the result using free()
+/* Pop an operation off the queue for tile @index, copying it to @op_out
+ * Returns FALSE if nothing is queued for the tile.
  *
- * Concurrency: This function is reentrant (and lock-free) on different @index */
-OperationDataDrawDab *
-operation_queue_pop(OperationQueue *self, TileIndex index)
+ * Concurrency: This function is reentrant (and lock-free) on different @index,
+ * unless the queue is threadsafe, in which case it is fully reentrant. */
+gboolean
+operation_queue_pop(OperationQueue *self, TileIndex index, OperationDataDrawDab *op_out)
 {
-    OperationDataDrawDab *op = NULL;
-
-    if (!tile_map_contains(self->tile_map, index)) {
-        return NULL;
+    gboolean popped = FALSE;
+
+    tile_lock(self, index);
+
+    TileOperations *tile_ops = get_tile_operations(self, index);
+    if (tile_ops) {
+        if (tile_operations_length(tile_ops) > 0) {
+            // Copied while locked, pruning may move the dab around
+            *op_out = *get_dab(self, tile_ops->dabs[tile_ops->first++]);
+            popped = TRUE;
+        } else if (!tile_ops->busy) {
+            // Queue empty
+            free_tile_operations(tile_ops);
+            *tile_map_get(self->tile_map, index) = NULL;
+        }
     }
 
-    Fifo **queue_pointer = (Fifo **)tile_map_get(self->tile_map, index);
-    Fifo *op_queue = *queue_pointer;
+    tile_unlock(self, index);
+    return popped;
+}
 
-    if (!op_queue) {
-        return NULL;
+/* Discard all operations queued for tile @index, for consumers unable to process them
+ *
+ * Concurrency: see operation_queue_pop() */
+void
+operation_queue_drop(OperationQueue *self, TileIndex index)
+{
+    OperationDataDrawDab op;
+    while (operation_queue_pop(self, index, &op)) {
+        // Nothing to do
     }
+}
 
-    op = (OperationDataDrawDab *)fifo_pop(op_queue);
-    if (!op) {
-        // Queue empty
-        fifo_free(op_queue, operation_delete_func);
-        *queue_pointer = NULL;
+/* Claim tile @index for processing by the calling thread
+ * Until released, the operations for the tile are not handed out again, and
+ * operation_queue_add() does not report the tile as newly dirty.
+ *
+ * Returns FALSE if the tile has nothing queued or is already claimed.
+ *
+ * Concurrency: This function is reentrant if the queue is threadsafe. */
+gboolean
+operation_queue_acquire_tile(OperationQueue *self, TileIndex index)
+{
+    gboolean acquired = FALSE;
+
+    tile_lock(self, index);
+
+    TileOperations *tile_ops = get_tile_operations(self, index);
+    if (tile_ops && !tile_ops->busy) {
+        tile_ops->busy = TRUE;
+        acquired = TRUE;
     }
-    return op;
+
+    tile_unlock(self, index);
+    return acquired;
 }
 
-OperationDataDrawDab *
-operation_queue_peek_first(OperationQueue *self, TileIndex index) {
-    if (!tile_map_contains(self->tile_map, index)) {
-        return NULL;
+/* Release a tile claimed with operation_queue_acquire_tile()
+ * If operations were added while the tile was being processed, the claim
+ * is kept and TRUE is returned: the caller should pop those too and release again.
+ *
+ * Concurrency: This function is reentrant if the queue is threadsafe. */
+gboolean
+operation_queue_release_tile(OperationQueue *self, TileIndex index)
+{
+    gboolean more_queued = FALSE;
+
+    tile_lock(self, index);
+
+    TileOperations **tile_ops_pointer = (TileOperations **)tile_map_get(self->tile_map, index);
+    TileOperations *tile_ops = *tile_ops_pointer;
+    assert(tile_ops && tile_ops->busy);
+
+    if (tile_operations_length(tile_ops) > 0) {
+        more_queued = TRUE;
+    } else {
+        free_tile_operations(tile_ops);
+        *tile_ops_pointer = NULL;
+#ifdef HAVE_PTHREAD
+        if (self->threadsafe) pthread_cond_broadcast(&get_stripe(self, index)->tile_idle_cond);
+#endif
     }
 
-    Fifo *op_queue = (Fifo *)*tile_map_get(self->tile_map, index);
-    return (!op_queue) ? NULL : (OperationDataDrawDab *)fifo_peek_first(op_queue);
+    tile_unlock(self, index);
+    return more_queued;
 }
 
-OperationDataDrawDab *
-operation_queue_peek_last(OperationQueue *self, TileIndex index) {
-    if (!tile_map_contains(self->tile_map, index)) {
-        return NULL;
+/* Block until tile @index is not claimed by any thread
+ * Only useful with a threadsafe queue, where other threads are processing the tile.
+ *
+ * Returns TRUE if operations are queued for the tile (added by other producers
+ * in the meantime), which the caller may claim and process itself.
+ *
+ * Concurrency: This function is reentrant if the queue is threadsafe. */
+gboolean
+operation_queue_wait_tile_idle(OperationQueue *self, TileIndex index)
+{
+    gboolean queued = FALSE;
+#ifdef HAVE_PTHREAD
+    if (!self->threadsafe) {
+        return FALSE;
     }
+    QueueStripe *stripe = get_stripe(self, index);
+    TileOperations *tile_ops;
+    tile_lock(self, index);
+    while ((tile_ops = get_tile_operations(self, index)) != NULL && tile_ops->busy) {
+        // Do not keep the map from growing while sleeping
+        map_unlock(self);
+        pthread_cond_wait(&stripe->tile_idle_cond, &stripe->lock);
+        pthread_mutex_unlock(&stripe->lock);
+        tile_lock(self, index);
+    }
+    queued = tile_ops != NULL;
+    tile_unlock(self, index);
+#endif
+    return queued;
+}
 
-    Fifo *op_queue = (Fifo *)*tile_map_get(self->tile_map, index);
-    return (!op_queue) ? NULL : (OperationDataDrawDab *)fifo_peek_last(op_queue);
+/* Number of operations queued for tile @index
+ * Used as an estimate of how much work it takes to process the tile.
+ *
+ * Concurrency: This function is reentrant (and lock-free) on different @index,
+ * unless the queue is threadsafe, in which case it is fully reentrant. */
+int
+operation_queue_get_queue_length(OperationQueue *self, TileIndex index) {
+    tile_lock(self, index);
+    TileOperations *tile_ops = get_tile_operations(self, index);
+    const int length = (!tile_ops) ? 0 : tile_operations_length(tile_ops);
+    tile_unlock(self, index);
+    return length;
 }
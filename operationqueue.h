@@ -2,27 +2,43 @@
 #define OPERATIONQUEUE_H
 
 #include <stdint.h>
+#include <stddef.h>
 #include "tilemap.h"
 
+/* Blend modes to apply for a dab, see process_op() */
+enum {
+    DAB_BLEND_NORMAL = 1 << 0,
+    DAB_BLEND_LOCK_ALPHA = 1 << 1,
+    DAB_BLEND_NORMAL_PAINT = 1 << 2,
+    DAB_BLEND_LOCK_ALPHA_PAINT = 1 << 3,
+    DAB_BLEND_COLORIZE = 1 << 4,
+    DAB_BLEND_POSTERIZE = 1 << 5,
+    // Normal blending also erases (color_a < 1.0), for smudging brushes
+    DAB_BLEND_ERASER = 1 << 6
+};
+
+/* A dab, with the opacity of every blend mode resolved to fix15.
+ * Stored once per dab, and shared by all the tiles it touches. */
 typedef struct {
     float x;
     float y;
     float radius;
-    uint16_t color_r;
-    uint16_t color_g;
-    uint16_t color_b;
-    float color_a;
-    float opaque;
     float hardness;
     float softness;
     float aspect_ratio;
     float angle;
-    float normal;
-    float lock_alpha;
-    float colorize;
-    float posterize;
-    float posterize_num;
-    float paint;
+    uint16_t color_r;
+    uint16_t color_g;
+    uint16_t color_b;
+    uint16_t color_a;
+    uint16_t opacity_normal;
+    uint16_t opacity_lock_alpha;
+    uint16_t opacity_normal_paint;
+    uint16_t opacity_lock_alpha_paint;
+    uint16_t opacity_colorize;
+    uint16_t opacity_posterize;
+    uint16_t posterize_num;
+    uint16_t blend_modes;
 } OperationDataDrawDab;
 
 typedef struct OperationQueue OperationQueue;
@@ -32,11 +48,23 @@ void operation_queue_free(OperationQueue *self);
 
 int operation_queue_get_dirty_tiles(OperationQueue *self, TileIndex** tiles_out);
 void operation_queue_clear_dirty_tiles(OperationQueue *self);
+int operation_queue_prune_dirty_tiles(OperationQueue *self);
+size_t operation_queue_get_queued_bytes(OperationQueue *self);
+
+gboolean operation_queue_set_threadsafe(OperationQueue *self, gboolean threadsafe);
+
+/* Returned by operation_queue_add_dab() when the dab could not be stored */
+#define OPERATION_QUEUE_NO_DAB UINT32_MAX
+
+uint32_t operation_queue_add_dab(OperationQueue *self, const OperationDataDrawDab *op, int tiles_n);
+gboolean operation_queue_add(OperationQueue *self, TileIndex index, uint32_t dab);
+gboolean operation_queue_pop(OperationQueue *self, TileIndex index, OperationDataDrawDab *op_out);
+void operation_queue_drop(OperationQueue *self, TileIndex index);
 
-void operation_queue_add(OperationQueue *self, TileIndex index, OperationDataDrawDab *op);
-OperationDataDrawDab *operation_queue_pop(OperationQueue *self, TileIndex index);
+gboolean operation_queue_acquire_tile(OperationQueue *self, TileIndex index);
+gboolean operation_queue_release_tile(OperationQueue *self, TileIndex index);
+gboolean operation_queue_wait_tile_idle(OperationQueue *self, TileIndex index);
 
-OperationDataDrawDab *operation_queue_peek_first(OperationQueue *self, TileIndex index);
-OperationDataDrawDab *operation_queue_peek_last(OperationQueue *self, TileIndex index);
+int operation_queue_get_queue_length(OperationQueue *self, TileIndex index);
 
 #endif // OPERATIONQUEUE_H
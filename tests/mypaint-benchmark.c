@@ -43,17 +43,26 @@ double get_time(void)
 }
 
 #else
+#include <time.h>
 #include <sys/time.h>
 #include <sys/resource.h>
 double get_time(void)
 {
+#ifdef CLOCK_MONOTONIC
+    // Not affected by changes of the system clock during a benchmark
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec*1e-9;
+#else
     struct timeval t;
     gettimeofday(&t, NULL);
     return t.tv_sec + t.tv_usec*1e-6;
+#endif
 }
 #endif
 
 static double g_start_time = 0.0;
+static double g_last_duration = 0.0;
 
 gboolean
 profiling_enabled(void)
@@ -85,6 +94,7 @@ int mypaint_benchmark_end(void)
 {
     double time_spent = get_time() - g_start_time;
     g_start_time = 0.0;
+    g_last_duration = time_spent;
 
     if (profiling_enabled()) {
 #ifdef HAVE_GPERFTOOLS
@@ -97,3 +107,12 @@ int mypaint_benchmark_end(void)
     assert(time_spent*1000 < INT_MAX);
     return (int)(time_spent*1000);
 }
+
+/**
+ * returns the duration measured by the last _end(), in milliseconds
+ * with sub-millisecond precision
+ */
+double mypaint_benchmark_get_last_duration(void)
+{
+    return g_last_duration*1000;
+}
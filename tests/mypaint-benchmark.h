@@ -19,5 +19,9 @@
 
 void mypaint_benchmark_start(const char *name);
 int mypaint_benchmark_end(void);
+double mypaint_benchmark_get_last_duration(void);
+
+/* Wall clock time in seconds */
+double get_time(void);
 
 #endif // MYPAINTBENCHMARK_H
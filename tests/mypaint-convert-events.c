@@ -0,0 +1,64 @@
+/* libmypaint - The MyPaint Brush Library
+ * Copyright (C) 2012 Jon Nordby <jononor@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* mypaint-convert-events: convert stroke event files to the binary format
+ *
+ * The text format has one event per line: time, x, y and pressure,
+ * optionally followed by either barrel_rotation alone, or by xtilt, ytilt
+ * and optionally viewzoom, viewrotation and barrel_rotation. The binary
+ * format holds all of them for every event, and is mapped into memory by
+ * the stroke player instead of parsed.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "mypaint-utils-stroke-player.h"
+
+int
+main(int argc, char **argv)
+{
+    if (argc != 3 || strcmp(argv[1], "--help") == 0) {
+        fprintf(stderr, "Usage: %s INPUT OUTPUT\n", argv[0]);
+        return argc == 2 ? 0 : 1;
+    }
+
+    MyPaintUtilsStrokePlayer *player = mypaint_utils_stroke_player_new();
+    if (!mypaint_utils_stroke_player_load_file(player, argv[1])) {
+        mypaint_utils_stroke_player_free(player);
+        return 1;
+    }
+
+    size_t size = 0;
+    void *data = mypaint_utils_stroke_player_to_binary(player, &size);
+    const int num_events = mypaint_utils_stroke_player_get_num_events(player);
+    mypaint_utils_stroke_player_free(player);
+
+    FILE *file = fopen(argv[2], "wb");
+    gboolean ok = file && fwrite(data, 1, size, file) == size;
+    if (file && fclose(file) != 0) {
+        ok = FALSE;
+    }
+    free(data);
+
+    if (!ok) {
+        fprintf(stderr, "Error: Unable to write '%s'\n", argv[2]);
+        return 1;
+    }
+    fprintf(stdout, "%s: %d events, %zu bytes\n", argv[2], num_events, size);
+    return 0;
+}
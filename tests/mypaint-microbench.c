@@ -0,0 +1,626 @@
+/* libmypaint - The MyPaint Brush Library
+ * Copyright (C) 2012 Jon Nordby <jononor@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* mypaint-microbench: benchmarks of the engine kernels in isolation
+ *
+ * Each case is calibrated to run for at least --min-time seconds, then
+ * timed --repetitions times. The median, minimum, mean and standard
+ * deviation are reported per dab (one kernel invocation, or one call for
+ * the non-pixel kernels) and per pixel covered by the dab mask.
+ */
+
+#include "mypaint-config.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <stdint.h>
+
+#include "mypaint-mapping.h"
+#include "mypaint-brush-settings.h"
+#include "tiled-surface-private.h"
+#include "brushmodes.h"
+#include "operationqueue.h"
+#include "helpers.h"
+
+#define MASK_SIZE (MYPAINT_TILE_SIZE*MYPAINT_TILE_SIZE+2*MYPAINT_TILE_SIZE)
+#define TILE_VALUES (MYPAINT_TILE_SIZE*MYPAINT_TILE_SIZE*4)
+#define MAX_REPETITIONS 100
+
+typedef struct Bench Bench;
+typedef void (*BenchFunction) (Bench *bench, long iterations);
+
+struct Bench {
+    char name[96];
+    const char *group;
+    BenchFunction function;
+
+    // Parameters, each group uses a subset
+    float radius;
+    float hardness;
+    float aspect_ratio;
+    uint16_t blend_modes;
+    float paint;
+    int inputs;
+    int points;
+
+    // Pixels covered by the dab mask, 0 for kernels without one
+    int pixels;
+
+    // Results
+    long iterations;
+    int repetitions;
+    double ns_per_dab[MAX_REPETITIONS];
+};
+
+typedef struct {
+    double median;
+    double min;
+    double mean;
+    double stddev;
+} BenchStats;
+
+// Shared state of the kernels, set up by bench_setup()
+static uint16_t g_mask[MASK_SIZE];
+static uint16_t g_tile[TILE_VALUES];
+static MyPaintMapping *g_mapping = NULL;
+static float g_mapping_inputs[256][MYPAINT_BRUSH_INPUTS_COUNT];
+
+// Keeps the compiler from dropping results
+static volatile float g_sink;
+
+/* A dab slightly off the tile center, as the engine rarely sees integer positions */
+static void
+render_mask(const Bench *bench)
+{
+    render_dab_mask(g_mask, MYPAINT_TILE_SIZE/2 + 0.3f, MYPAINT_TILE_SIZE/2 - 0.3f,
+                    bench->radius, bench->hardness, 0.0f, bench->aspect_ratio, 30.0f, 0, 0);
+}
+
+/* Number of pixels in the run-length encoded mask */
+static int
+count_mask_pixels(const uint16_t *mask)
+{
+    int pixels = 0;
+    while (1) {
+        for (; mask[0]; mask++) {
+            pixels++;
+        }
+        if (!mask[1]) {
+            break;
+        }
+        mask += 2;
+    }
+    return pixels;
+}
+
+/* Semi-transparent canvas, with some variation between pixels */
+static void
+fill_tile(void)
+{
+    for (int i = 0; i < MYPAINT_TILE_SIZE*MYPAINT_TILE_SIZE; i++) {
+        const uint32_t a = (1<<14) + (i * 97) % (1<<14);
+        g_tile[i*4+0] = a * ((i * 31) % 256) / 255;
+        g_tile[i*4+1] = a * ((i * 17) % 256) / 255;
+        g_tile[i*4+2] = a * ((i * 7) % 256) / 255;
+        g_tile[i*4+3] = a;
+    }
+}
+
+static void
+bench_render_dab_mask(Bench *bench, long iterations)
+{
+    for (long i = 0; i < iterations; i++) {
+        render_mask(bench);
+    }
+    g_sink = g_mask[0];
+}
+
+/* Stamp the mask with each of the blend modes of the dab, like process_op() */
+static void
+bench_blend(Bench *bench, long iterations)
+{
+    const uint16_t modes = bench->blend_modes;
+    const uint16_t opacity = (1<<15) / 2;
+    for (long i = 0; i < iterations; i++) {
+        // Alternate the colors, so the canvas does not converge to the dab color
+        const uint16_t r = (i & 1) ? (1<<15) : (1<<13);
+        const uint16_t g = (i & 1) ? (1<<13) : (1<<14);
+        const uint16_t b = (i & 1) ? (1<<14) : (1<<15);
+        const uint16_t a = (1<<15) * 3 / 4;
+
+        if (modes & DAB_BLEND_NORMAL) {
+            if (!(modes & DAB_BLEND_ERASER)) {
+                draw_dab_pixels_BlendMode_Normal(g_mask, g_tile, r, g, b, opacity);
+            } else {
+                draw_dab_pixels_BlendMode_Normal_and_Eraser(g_mask, g_tile, r, g, b, a, opacity);
+            }
+        }
+        if (modes & DAB_BLEND_LOCK_ALPHA) {
+            draw_dab_pixels_BlendMode_LockAlpha(g_mask, g_tile, r, g, b, opacity);
+        }
+        if (modes & DAB_BLEND_NORMAL_PAINT) {
+            if (!(modes & DAB_BLEND_ERASER)) {
+                draw_dab_pixels_BlendMode_Normal_Paint(g_mask, g_tile, r, g, b, opacity);
+            } else {
+                draw_dab_pixels_BlendMode_Normal_and_Eraser_Paint(g_mask, g_tile, r, g, b, a, opacity);
+            }
+        }
+        if (modes & DAB_BLEND_LOCK_ALPHA_PAINT) {
+            draw_dab_pixels_BlendMode_LockAlpha_Paint(g_mask, g_tile, r, g, b, opacity);
+        }
+        if (modes & DAB_BLEND_COLORIZE) {
+            draw_dab_pixels_BlendMode_Color(g_mask, g_tile, r, g, b, opacity);
+        }
+        if (modes & DAB_BLEND_POSTERIZE) {
+            draw_dab_pixels_BlendMode_Posterize(g_mask, g_tile, opacity, 8);
+        }
+    }
+    g_sink = g_tile[0];
+}
+
+/* Color sampling with the sample rates that mypaint_tiled_surface get_color uses */
+static void
+bench_get_color(Bench *bench, long iterations)
+{
+    const int sample_interval = bench->radius <= 2.0f ? 1 : (int)(bench->radius * 7);
+    const float random_sample_rate = 1.0f / (7 * bench->radius);
+    float sum = 0.0f;
+    for (long i = 0; i < iterations; i++) {
+        float sum_weight = 0.0f, sum_r = 0.0f, sum_g = 0.0f, sum_b = 0.0f, sum_a = 0.0f;
+        get_color_pixels_accumulate(g_mask, g_tile, &sum_weight, &sum_r, &sum_g, &sum_b, &sum_a,
+                                    bench->paint, sample_interval, random_sample_rate);
+        sum += sum_weight + sum_r;
+    }
+    g_sink = sum;
+}
+
+/* Queue each dab for 4 tiles, then pop all the tiles empty, like a transaction */
+static void
+bench_operation_queue(Bench *bench, long iterations)
+{
+    OperationQueue *queue = operation_queue_new();
+    OperationDataDrawDab op;
+    memset(&op, 0, sizeof(op));
+    const int batch = 1024;
+
+    for (long i = 0; i < iterations; ) {
+        const long end = i + batch < iterations ? i + batch : iterations;
+        for (; i < end; i++) {
+            op.x = (i * 37) % (16 * MYPAINT_TILE_SIZE);
+            op.y = (i * 11) % (16 * MYPAINT_TILE_SIZE);
+            const int tx = op.x / MYPAINT_TILE_SIZE;
+            const int ty = op.y / MYPAINT_TILE_SIZE;
+            const uint32_t dab = operation_queue_add_dab(queue, &op, 4);
+            if (dab == OPERATION_QUEUE_NO_DAB) {
+                continue;
+            }
+            for (int t = 0; t < 4; t++) {
+                TileIndex index = { tx + (t & 1), ty + (t >> 1) };
+                operation_queue_add(queue, index, dab);
+            }
+        }
+
+        TileIndex *tiles;
+        const int tiles_n = operation_queue_get_dirty_tiles(queue, &tiles);
+        for (int t = 0; t < tiles_n; t++) {
+            while (operation_queue_pop(queue, tiles[t], &op)) {
+                g_sink = op.x;
+            }
+            // Frees the tile queue
+            operation_queue_pop(queue, tiles[t], &op);
+        }
+        operation_queue_clear_dirty_tiles(queue);
+    }
+    operation_queue_free(queue);
+}
+
+static void
+bench_mapping(Bench *bench, long iterations)
+{
+    float sum = 0.0f;
+    for (long i = 0; i < iterations; i++) {
+        sum += mypaint_mapping_calculate(g_mapping, g_mapping_inputs[i & 255]);
+    }
+    g_sink = sum;
+}
+
+static void
+bench_rgb_to_spectral(Bench *bench, long iterations)
+{
+    float spectral[10];
+    float sum = 0.0f;
+    for (long i = 0; i < iterations; i++) {
+        const float v = (i & 255) / 255.0f;
+        rgb_to_spectral(v, 1.0f - v, 0.5f, spectral);
+        sum += spectral[i % 10];
+    }
+    g_sink = sum;
+}
+
+static void
+bench_spectral_to_rgb(Bench *bench, long iterations)
+{
+    float spectral[10];
+    float rgb[3];
+    float sum = 0.0f;
+    rgb_to_spectral(0.8f, 0.3f, 0.1f, spectral);
+    for (long i = 0; i < iterations; i++) {
+        spectral[i % 10] = 0.1f + (i & 255) / 300.0f;
+        spectral_to_rgb(spectral, rgb);
+        sum += rgb[0];
+    }
+    g_sink = sum;
+}
+
+static void
+bench_mix_colors(Bench *bench, long iterations)
+{
+    float a[4] = { 0.8f, 0.3f, 0.1f, 0.9f };
+    const float b[4] = { 0.1f, 0.4f, 0.7f, 0.6f };
+    float result[4];
+    for (long i = 0; i < iterations; i++) {
+        mix_colors(a, b, (i & 255) / 255.0f, bench->paint, result);
+        a[0] = result[0];
+    }
+    g_sink = a[0];
+}
+
+/* Prepare the shared state for a case. Runs before each repetition,
+ * so every repetition starts from the same canvas and random numbers. */
+static void
+bench_setup(Bench *bench)
+{
+    fill_tile();
+    srand(1);
+
+    if (bench->radius > 0.0f) {
+        render_mask(bench);
+        bench->pixels = count_mask_pixels(g_mask);
+    }
+
+    if (bench->inputs && !g_mapping) {
+        g_mapping = mypaint_mapping_new(MYPAINT_BRUSH_INPUTS_COUNT);
+        for (int i = 0; i < 256; i++) {
+            for (int j = 0; j < MYPAINT_BRUSH_INPUTS_COUNT; j++) {
+                g_mapping_inputs[i][j] = ((i * 7 + j * 13) % 256) / 128.0f - 0.5f;
+            }
+        }
+    }
+    if (bench->inputs) {
+        for (int input = 0; input < MYPAINT_BRUSH_INPUTS_COUNT; input++) {
+            const int n = input < bench->inputs ? bench->points : 0;
+            mypaint_mapping_set_n(g_mapping, input, n);
+            for (int p = 0; p < n; p++) {
+                const float x = -1.0f + 3.0f * p / (n - 1);
+                mypaint_mapping_set_point(g_mapping, input, p, x, (p % 2) ? 0.8f : -0.3f);
+            }
+        }
+    }
+}
+
+static double
+time_iterations(Bench *bench, long iterations)
+{
+    bench_setup(bench);
+    const double start = get_monotonic_time();
+    bench->function(bench, iterations);
+    return get_monotonic_time() - start;
+}
+
+static void
+bench_run(Bench *bench, int repetitions, double min_time)
+{
+    // Grow the iteration count until one repetition takes at least min_time
+    long iterations = 1;
+    double seconds = time_iterations(bench, iterations);
+    while (seconds < min_time && iterations < (1L << 40)) {
+        const double factor = seconds > 0.0 ? 1.2 * min_time / seconds : 100.0;
+        iterations = (long)(iterations * (factor < 100.0 ? (factor > 2.0 ? factor : 2.0) : 100.0));
+        seconds = time_iterations(bench, iterations);
+    }
+
+    bench->iterations = iterations;
+    bench->repetitions = repetitions;
+    bench->ns_per_dab[0] = seconds * 1e9 / iterations;
+    for (int r = 1; r < repetitions; r++) {
+        bench->ns_per_dab[r] = time_iterations(bench, iterations) * 1e9 / iterations;
+    }
+}
+
+static int
+compare_doubles(const void *a, const void *b)
+{
+    const double da = *(const double *)a;
+    const double db = *(const double *)b;
+    return (da > db) - (da < db);
+}
+
+static BenchStats
+bench_stats(const Bench *bench, double divisor)
+{
+    double values[MAX_REPETITIONS];
+    const int n = bench->repetitions;
+    double sum = 0.0;
+    for (int r = 0; r < n; r++) {
+        values[r] = bench->ns_per_dab[r] / divisor;
+        sum += values[r];
+    }
+    qsort(values, n, sizeof(double), compare_doubles);
+
+    BenchStats stats;
+    stats.median = (n % 2) ? values[n/2] : (values[n/2-1] + values[n/2]) / 2;
+    stats.min = values[0];
+    stats.mean = sum / n;
+    double variance = 0.0;
+    for (int r = 0; r < n; r++) {
+        variance += (values[r] - stats.mean) * (values[r] - stats.mean);
+    }
+    stats.stddev = n > 1 ? sqrt(variance / (n - 1)) : 0.0;
+    return stats;
+}
+
+static void
+write_json_stats(FILE *fp, const char *key, BenchStats stats)
+{
+    fprintf(fp, "\"%s\": {\"median\": %.4f, \"min\": %.4f, \"mean\": %.4f, \"stddev\": %.4f}",
+            key, stats.median, stats.min, stats.mean, stats.stddev);
+}
+
+static void
+write_json(FILE *fp, Bench *benches, int benches_n, int repetitions, double min_time)
+{
+    fprintf(fp, "{\n  \"tile_size\": %d,\n  \"repetitions\": %d,\n  \"min_time\": %g,\n  \"benchmarks\": [\n",
+            MYPAINT_TILE_SIZE, repetitions, min_time);
+    for (int i = 0; i < benches_n; i++) {
+        const Bench *bench = &benches[i];
+        fprintf(fp, "    {\"name\": \"%s\", \"group\": \"%s\", \"iterations\": %ld, \"pixels_per_dab\": %d, ",
+                bench->name, bench->group, bench->iterations, bench->pixels);
+        write_json_stats(fp, "ns_per_dab", bench_stats(bench, 1.0));
+        if (bench->pixels) {
+            fprintf(fp, ", ");
+            write_json_stats(fp, "ns_per_pixel", bench_stats(bench, bench->pixels));
+        }
+        fprintf(fp, "}%s\n", i < benches_n - 1 ? "," : "");
+    }
+    fprintf(fp, "  ]\n}\n");
+}
+
+static Bench *
+add_bench(Bench *benches, int *benches_n, const char *group, BenchFunction function)
+{
+    Bench *bench = &benches[(*benches_n)++];
+    memset(bench, 0, sizeof(Bench));
+    bench->group = group;
+    bench->function = function;
+    return bench;
+}
+
+static const struct {
+    const char *name;
+    uint16_t modes;
+} blend_combinations[] = {
+    { "normal", DAB_BLEND_NORMAL },
+    { "normal+eraser", DAB_BLEND_NORMAL | DAB_BLEND_ERASER },
+    { "lock_alpha", DAB_BLEND_LOCK_ALPHA },
+    { "colorize", DAB_BLEND_COLORIZE },
+    { "posterize", DAB_BLEND_POSTERIZE },
+    { "normal_paint", DAB_BLEND_NORMAL_PAINT },
+    { "normal_paint+eraser", DAB_BLEND_NORMAL_PAINT | DAB_BLEND_ERASER },
+    { "lock_alpha_paint", DAB_BLEND_LOCK_ALPHA_PAINT },
+    { "normal+lock_alpha+colorize", DAB_BLEND_NORMAL | DAB_BLEND_LOCK_ALPHA | DAB_BLEND_COLORIZE },
+    { "normal+normal_paint", DAB_BLEND_NORMAL | DAB_BLEND_NORMAL_PAINT },
+};
+
+/* All cases, returns the number of them */
+static int
+create_benches(Bench *benches)
+{
+    int n = 0;
+    const float radii[] = { 1.0f, 2.0f, 4.0f, 8.0f, 16.0f, 32.0f };
+    const float hardnesses[] = { 1.0f, 0.5f, 0.1f };
+    const float aspect_ratios[] = { 1.0f, 4.0f };
+    const float blend_radii[] = { 2.0f, 8.0f, 32.0f };
+
+    for (int r = 0; r < (int)(sizeof(radii)/sizeof(radii[0])); r++) {
+        for (int h = 0; h < (int)(sizeof(hardnesses)/sizeof(hardnesses[0])); h++) {
+            for (int a = 0; a < (int)(sizeof(aspect_ratios)/sizeof(aspect_ratios[0])); a++) {
+                Bench *bench = add_bench(benches, &n, "render_dab_mask", bench_render_dab_mask);
+                bench->radius = radii[r];
+                bench->hardness = hardnesses[h];
+                bench->aspect_ratio = aspect_ratios[a];
+                snprintf(bench->name, sizeof(bench->name), "render_dab_mask/r=%g/h=%g/a=%g",
+                         radii[r], hardnesses[h], aspect_ratios[a]);
+            }
+        }
+    }
+
+    for (int c = 0; c < (int)(sizeof(blend_combinations)/sizeof(blend_combinations[0])); c++) {
+        for (int r = 0; r < (int)(sizeof(blend_radii)/sizeof(blend_radii[0])); r++) {
+            Bench *bench = add_bench(benches, &n, "blend", bench_blend);
+            bench->radius = blend_radii[r];
+            bench->hardness = 0.5f;
+            bench->aspect_ratio = 1.0f;
+            bench->blend_modes = blend_combinations[c].modes;
+            snprintf(bench->name, sizeof(bench->name), "blend/%s/r=%g",
+                     blend_combinations[c].name, blend_radii[r]);
+        }
+    }
+
+    const float paints[] = { -1.0f, 0.0f, 0.5f, 1.0f };
+    for (int p = 0; p < (int)(sizeof(paints)/sizeof(paints[0])); p++) {
+        for (int r = 0; r < (int)(sizeof(blend_radii)/sizeof(blend_radii[0])); r++) {
+            Bench *bench = add_bench(benches, &n, "get_color", bench_get_color);
+            bench->radius = blend_radii[r];
+            bench->hardness = 0.5f;
+            bench->aspect_ratio = 1.0f;
+            bench->paint = paints[p];
+            snprintf(bench->name, sizeof(bench->name), "get_color_pixels_accumulate/%s/r=%g",
+                     paints[p] < 0.0f ? "legacy" : (paints[p] == 0.0f ? "rgb" :
+                     (paints[p] == 1.0f ? "spectral" : "mixed")), blend_radii[r]);
+        }
+    }
+
+    Bench *queue = add_bench(benches, &n, "operation_queue", bench_operation_queue);
+    snprintf(queue->name, sizeof(queue->name), "operation_queue/add+pop/4-tiles");
+
+    const int mapping_inputs[] = { 1, 2, 4 };
+    const int mapping_points[] = { 2, 4, 8 };
+    for (int i = 0; i < (int)(sizeof(mapping_inputs)/sizeof(mapping_inputs[0])); i++) {
+        for (int p = 0; p < (int)(sizeof(mapping_points)/sizeof(mapping_points[0])); p++) {
+            Bench *bench = add_bench(benches, &n, "mapping", bench_mapping);
+            bench->inputs = mapping_inputs[i];
+            bench->points = mapping_points[p];
+            snprintf(bench->name, sizeof(bench->name), "mapping_calculate/inputs=%d/points=%d",
+                     mapping_inputs[i], mapping_points[p]);
+        }
+    }
+
+    Bench *bench = add_bench(benches, &n, "spectral", bench_rgb_to_spectral);
+    snprintf(bench->name, sizeof(bench->name), "rgb_to_spectral");
+    bench = add_bench(benches, &n, "spectral", bench_spectral_to_rgb);
+    snprintf(bench->name, sizeof(bench->name), "spectral_to_rgb");
+    const float mix_paints[] = { 0.0f, 0.5f, 1.0f };
+    for (int p = 0; p < (int)(sizeof(mix_paints)/sizeof(mix_paints[0])); p++) {
+        bench = add_bench(benches, &n, "spectral", bench_mix_colors);
+        bench->paint = mix_paints[p];
+        snprintf(bench->name, sizeof(bench->name), "mix_colors/paint=%g", mix_paints[p]);
+    }
+
+    return n;
+}
+
+static void
+print_usage(const char *program)
+{
+    fprintf(stderr,
+            "Usage: %s [options] [FILTER...]\n"
+            "\n"
+            "Runs the cases whose name contains any of the FILTERs, or all of them.\n"
+            "\n"
+            "Options:\n"
+            "  --repetitions N   Timed repetitions per case (default 5, at most %d)\n"
+            "  --min-time S      Minimum duration of one repetition in seconds (default 0.05)\n"
+            "  --json FILE       Also write the results as JSON, '-' for standard output\n"
+            "  --list            List the cases without running them\n",
+            program, MAX_REPETITIONS);
+}
+
+int
+main(int argc, char *argv[])
+{
+    int repetitions = 5;
+    double min_time = 0.05;
+    const char *json_path = NULL;
+    gboolean list = FALSE;
+    const char **filters = (const char **)malloc(sizeof(char *) * argc);
+    int filters_n = 0;
+
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        const char *value = (i + 1 < argc) ? argv[i + 1] : NULL;
+        gboolean valid = TRUE;
+
+        if (strcmp(arg, "--help") == 0 || strcmp(arg, "-h") == 0) {
+            print_usage(argv[0]);
+            return 0;
+        } else if (strcmp(arg, "--list") == 0) {
+            list = TRUE;
+        } else if (strcmp(arg, "--repetitions") == 0) {
+            valid = value && sscanf(value, "%d", &repetitions) == 1 &&
+                    repetitions > 0 && repetitions <= MAX_REPETITIONS;
+            i++;
+        } else if (strcmp(arg, "--min-time") == 0) {
+            valid = value && sscanf(value, "%lf", &min_time) == 1 && min_time > 0.0;
+            i++;
+        } else if (strcmp(arg, "--json") == 0) {
+            valid = value != NULL;
+            json_path = value;
+            i++;
+        } else if (arg[0] == '-') {
+            valid = FALSE;
+        } else {
+            filters[filters_n++] = arg;
+        }
+
+        if (!valid) {
+            fprintf(stderr, "Error: Invalid argument '%s'\n", arg);
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    Bench *all = (Bench *)malloc(sizeof(Bench) * 256);
+    const int all_n = create_benches(all);
+    Bench *benches = (Bench *)malloc(sizeof(Bench) * all_n);
+    int benches_n = 0;
+    for (int i = 0; i < all_n; i++) {
+        gboolean selected = (filters_n == 0);
+        for (int f = 0; f < filters_n && !selected; f++) {
+            selected = strstr(all[i].name, filters[f]) != NULL;
+        }
+        if (selected) {
+            benches[benches_n++] = all[i];
+        }
+    }
+    free(all);
+
+    // With JSON on standard output, the table goes to standard error
+    FILE *out = (json_path && strcmp(json_path, "-") == 0) ? stderr : stdout;
+
+    if (list) {
+        for (int i = 0; i < benches_n; i++) {
+            fprintf(out, "%s\n", benches[i].name);
+        }
+    } else {
+        fprintf(out, "%-48s %12s %12s %8s %12s\n", "case", "ns/dab", "min", "+-%", "ns/pixel");
+        for (int i = 0; i < benches_n; i++) {
+            Bench *bench = &benches[i];
+            bench_run(bench, repetitions, min_time);
+
+            const BenchStats stats = bench_stats(bench, 1.0);
+            fprintf(out, "%-48s %12.2f %12.2f %8.1f", bench->name, stats.median, stats.min,
+                    stats.mean > 0.0 ? 100.0 * stats.stddev / stats.mean : 0.0);
+            if (bench->pixels) {
+                fprintf(out, " %12.3f", bench_stats(bench, bench->pixels).median);
+            }
+            fprintf(out, "\n");
+            fflush(out);
+        }
+    }
+
+    int result = 0;
+    if (json_path && !list) {
+        FILE *fp = strcmp(json_path, "-") == 0 ? stdout : fopen(json_path, "w");
+        if (!fp) {
+            fprintf(stderr, "Error: Unable to open '%s' for writing\n", json_path);
+            result = 1;
+        } else {
+            write_json(fp, benches, benches_n, repetitions, min_time);
+            if (fp != stdout) {
+                fclose(fp);
+            }
+        }
+    }
+
+    if (g_mapping) {
+        mypaint_mapping_free(g_mapping);
+    }
+    free(benches);
+    free(filters);
+    return result;
+}
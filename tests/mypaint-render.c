@@ -0,0 +1,532 @@
+/* libmypaint - The MyPaint Brush Library
+ * Copyright (C) 2012 Jon Nordby <jononor@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* mypaint-render: headless batch rendering of stroke event files
+ *
+ * Every combination of the given brushes and event files is a document,
+ * painted with the stroke player onto its own fixed size surface and
+ * written out as a binary PPM image, composited over white. Documents are
+ * rendered concurrently, one per worker thread, and each surface renders
+ * its tiles on the thread of its document.
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+#include "mypaint-brush.h"
+#include "mypaint-fixed-tiled-surface.h"
+#include "mypaint-trace.h"
+#include "mypaint-utils-stroke-player.h"
+#include "mypaint-benchmark.h"
+#include "testutils.h"
+
+typedef struct {
+    const char *brush_file;
+    const char *events_file;
+    char *output_file;
+
+    // Results, written by the worker that rendered the document
+    gboolean ok;
+    long dabs;
+    long tiles;
+    double seconds;
+    MyPaintTiledSurfaceStats stats;
+} RenderDocument;
+
+/* Surface that counts the dabs on their way to the fixed surface.
+ * Tiles are counted by the area changed callback of the fixed surface,
+ * which gets the counting surface as its user data. */
+typedef struct {
+    MyPaintSurface parent;
+    MyPaintSurface *target;
+    long dabs;
+    long tiles;
+} CountingSurface;
+
+typedef struct {
+    RenderDocument *documents;
+    int num_documents;
+    int next_document;
+    int width;
+    int height;
+    float scale;
+    gboolean transaction_per_event;
+    gboolean stats;
+#ifdef HAVE_PTHREAD
+    pthread_mutex_t lock;
+#endif
+} RenderJob;
+
+static int
+counting_draw_dab(MyPaintSurface *surface, float x, float y, float radius,
+                  float color_r, float color_g, float color_b,
+                  float opaque, float hardness, float softness, float alpha_eraser,
+                  float aspect_ratio, float angle, float lock_alpha,
+                  float colorize, float posterize, float posterize_num, float paint)
+{
+    CountingSurface *self = (CountingSurface *)surface;
+    self->dabs++;
+    return mypaint_surface_draw_dab(self->target, x, y, radius,
+                                    color_r, color_g, color_b, opaque, hardness, softness,
+                                    alpha_eraser, aspect_ratio, angle, lock_alpha,
+                                    colorize, posterize, posterize_num, paint);
+}
+
+static int
+counting_draw_dabs(MyPaintSurface *surface, const MyPaintDabs *dabs)
+{
+    CountingSurface *self = (CountingSurface *)surface;
+    self->dabs += dabs->num_dabs;
+    return mypaint_surface_draw_dabs(self->target, dabs);
+}
+
+static void
+counting_get_color(MyPaintSurface *surface, float x, float y, float radius,
+                   float *color_r, float *color_g, float *color_b, float *color_a,
+                   float paint)
+{
+    CountingSurface *self = (CountingSurface *)surface;
+    mypaint_surface_get_color(self->target, x, y, radius,
+                              color_r, color_g, color_b, color_a, paint);
+}
+
+static void
+counting_begin_atomic(MyPaintSurface *surface)
+{
+    CountingSurface *self = (CountingSurface *)surface;
+    mypaint_surface_begin_atomic(self->target);
+}
+
+static void
+counting_end_atomic(MyPaintSurface *surface, MyPaintRectangles *roi)
+{
+    CountingSurface *self = (CountingSurface *)surface;
+    mypaint_surface_end_atomic(self->target, roi);
+}
+
+static void
+counting_surface_init(CountingSurface *self, MyPaintSurface *target)
+{
+    mypaint_surface_init(&self->parent);
+    self->parent.draw_dab = counting_draw_dab;
+    self->parent.draw_dabs = counting_draw_dabs;
+    self->parent.get_color = counting_get_color;
+    self->parent.begin_atomic = counting_begin_atomic;
+    self->parent.end_atomic = counting_end_atomic;
+    self->parent.destroy = NULL;
+    self->parent.save_png = NULL;
+    self->target = target;
+    self->dabs = 0;
+    self->tiles = 0;
+}
+
+/* Called once per processed tile. Each surface belongs to a single worker
+ * and renders on its thread, so the counter needs no locking. */
+static void
+count_tile(MyPaintTiledSurface *surface, int x, int y, int w, int h, void *user_data)
+{
+    CountingSurface *counter = (CountingSurface *)user_data;
+    counter->tiles++;
+}
+
+static inline unsigned char
+fix15_to_rgb8(uint32_t v)
+{
+    if (v > (1<<15)) {
+        v = 1<<15;
+    }
+    return (v * 255 + (1<<14)) >> 15;
+}
+
+/* Write the surface as a binary PPM, composited over white.
+ * Pixels are premultiplied fix15, read through the tile requests. */
+static gboolean
+write_ppm(MyPaintFixedTiledSurface *surface, const char *path)
+{
+    MyPaintTiledSurface *tiled = (MyPaintTiledSurface *)surface;
+    const int width = mypaint_fixed_tiled_surface_get_width(surface);
+    const int height = mypaint_fixed_tiled_surface_get_height(surface);
+    const int tile_size = tiled->tile_size;
+    const int tiles_width = (width + tile_size - 1) / tile_size;
+
+    FILE *fp = fopen(path, "wb");
+    if (!fp) {
+        fprintf(stderr, "Error: Unable to open '%s' for writing\n", path);
+        return FALSE;
+    }
+    fprintf(fp, "P6\n%d %d\n255\n", width, height);
+
+    // One row of tiles at a time
+    unsigned char *row = (unsigned char *)malloc((size_t)width * 3 * tile_size);
+    gboolean ok = (row != NULL);
+
+    for (int ty = 0; ok && ty * tile_size < height; ty++) {
+        const int rows = height - ty * tile_size < tile_size ? height - ty * tile_size : tile_size;
+
+        for (int tx = 0; tx < tiles_width; tx++) {
+            MyPaintTileRequest request;
+            mypaint_tile_request_init(&request, 0, tx, ty, TRUE);
+            mypaint_tiled_surface_tile_request_start(tiled, &request);
+            const uint16_t *buffer = request.buffer;
+            const int columns = width - tx * tile_size < tile_size ? width - tx * tile_size : tile_size;
+
+            for (int y = 0; y < rows; y++) {
+                const uint16_t *src = buffer + (size_t)y * tile_size * 4;
+                unsigned char *dst = row + ((size_t)y * width + tx * tile_size) * 3;
+                for (int x = 0; x < columns; x++) {
+                    const uint32_t a = src[3] < (1<<15) ? src[3] : (1<<15);
+                    const uint32_t white = (1<<15) - a;
+                    dst[0] = fix15_to_rgb8(src[0] + white);
+                    dst[1] = fix15_to_rgb8(src[1] + white);
+                    dst[2] = fix15_to_rgb8(src[2] + white);
+                    src += 4;
+                    dst += 3;
+                }
+            }
+            mypaint_tiled_surface_tile_request_end(tiled, &request);
+        }
+        ok = fwrite(row, (size_t)width * 3, rows, fp) == (size_t)rows;
+    }
+
+    free(row);
+    if (fclose(fp) != 0) {
+        ok = FALSE;
+    }
+    if (!ok) {
+        fprintf(stderr, "Error: Unable to write '%s'\n", path);
+    }
+    return ok;
+}
+
+static void
+render_document(RenderJob *job, RenderDocument *document)
+{
+    document->ok = FALSE;
+
+    // Event files in the text or the binary format
+    MyPaintUtilsStrokePlayer *player = mypaint_utils_stroke_player_new();
+    if (!mypaint_utils_stroke_player_load_file(player, document->events_file)) {
+        mypaint_utils_stroke_player_free(player);
+        return;
+    }
+
+    char *brush_data = read_file(document->brush_file);
+    MyPaintBrush *brush = mypaint_brush_new();
+    mypaint_brush_from_defaults(brush);
+    if (!brush_data || !mypaint_brush_from_string(brush, brush_data)) {
+        fprintf(stderr, "Error: Unable to load brush '%s'\n", document->brush_file);
+        mypaint_brush_unref(brush);
+        mypaint_utils_stroke_player_free(player);
+        free(brush_data);
+        return;
+    }
+    free(brush_data);
+
+    MyPaintFixedTiledSurface *surface = mypaint_fixed_tiled_surface_new(job->width, job->height);
+    if (!surface) {
+        mypaint_brush_unref(brush);
+        mypaint_utils_stroke_player_free(player);
+        return;
+    }
+    MyPaintTiledSurface *tiled = (MyPaintTiledSurface *)surface;
+    // Documents are rendered in parallel, not the tiles within a document
+    mypaint_tiled_surface_set_num_threads(tiled, 1);
+    mypaint_tiled_surface_set_stats_timing(tiled, job->stats);
+
+    CountingSurface counter;
+    counting_surface_init(&counter, mypaint_fixed_tiled_surface_interface(surface));
+    mypaint_tiled_surface_set_area_changed_callback(tiled, count_tile, &counter);
+
+    mypaint_utils_stroke_player_set_brush(player, brush);
+    mypaint_utils_stroke_player_set_surface(player, &counter.parent);
+    mypaint_utils_stroke_player_set_scale(player, job->scale);
+    mypaint_utils_stroke_player_set_transactions_on_stroke_to(player, job->transaction_per_event);
+
+    const double start = get_time();
+    if (!job->transaction_per_event) {
+        mypaint_surface_begin_atomic(&counter.parent);
+    }
+    mypaint_utils_stroke_player_run_sync(player);
+    if (!job->transaction_per_event) {
+        mypaint_surface_end_atomic(&counter.parent, NULL);
+    }
+    document->seconds = get_time() - start;
+    document->dabs = counter.dabs;
+    document->tiles = counter.tiles;
+    mypaint_tiled_surface_get_stats(tiled, &document->stats);
+
+    document->ok = write_ppm(surface, document->output_file);
+
+    mypaint_utils_stroke_player_free(player);
+    mypaint_brush_unref(brush);
+    mypaint_surface_unref(mypaint_fixed_tiled_surface_interface(surface));
+}
+
+static int
+take_document(RenderJob *job)
+{
+#ifdef HAVE_PTHREAD
+    pthread_mutex_lock(&job->lock);
+#endif
+    const int index = job->next_document < job->num_documents ? job->next_document++ : -1;
+#ifdef HAVE_PTHREAD
+    pthread_mutex_unlock(&job->lock);
+#endif
+    return index;
+}
+
+static void
+print_stats(const MyPaintTiledSurfaceStats *stats)
+{
+    static const char *blend_names[MYPAINT_BLEND_STATS_COUNT] = {
+        "normal", "normal+eraser", "lock alpha", "normal paint",
+        "normal+eraser paint", "lock alpha paint", "colorize", "posterize"
+    };
+    fprintf(stdout, "  dabs: %llu queued, %llu culled; tiles: %llu dirtied, %llu processed; "
+            "queue peak: %.1f KiB\n",
+            (unsigned long long)stats->dabs_queued, (unsigned long long)stats->dabs_culled,
+            (unsigned long long)stats->tiles_dirtied, (unsigned long long)stats->tiles_processed,
+            stats->queue_peak_bytes / 1024.0);
+    fprintf(stdout, "  mask: %llu px, %.3f s; blend: %.3f s; tile requests: %.3f s\n",
+            (unsigned long long)stats->mask_pixels, stats->mask_time, stats->blend_time,
+            stats->tile_request_time);
+    for (int i = 0; i < MYPAINT_BLEND_STATS_COUNT; i++) {
+        if (stats->blend_pixels[i]) {
+            fprintf(stdout, "  blend %s: %llu px\n", blend_names[i],
+                    (unsigned long long)stats->blend_pixels[i]);
+        }
+    }
+    fprintf(stdout, "  get_color: %llu calls, %llu px sampled\n",
+            (unsigned long long)stats->get_color_calls, (unsigned long long)stats->get_color_pixels);
+}
+
+static void *
+render_worker(void *user_data)
+{
+    RenderJob *job = (RenderJob *)user_data;
+
+    for (int i = take_document(job); i >= 0; i = take_document(job)) {
+        RenderDocument *document = &job->documents[i];
+        render_document(job, document);
+        if (document->ok) {
+            fprintf(stdout, "%s: %ld dabs, %ld tiles, %.3f s\n",
+                    document->output_file, document->dabs, document->tiles, document->seconds);
+            if (job->stats) {
+                print_stats(&document->stats);
+            }
+        }
+    }
+    return NULL;
+}
+
+static int
+default_num_jobs(void)
+{
+#if defined(HAVE_PTHREAD) && defined(_SC_NPROCESSORS_ONLN)
+    const long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+#else
+    return 1;
+#endif
+}
+
+/* Output name from the base names of the brush and the event file */
+static char *
+output_name(const char *dir, const char *brush_file, const char *events_file)
+{
+    const char *names[2] = { brush_file, events_file };
+    int lengths[2];
+
+    for (int i = 0; i < 2; i++) {
+        const char *slash = strrchr(names[i], '/');
+        if (slash) {
+            names[i] = slash + 1;
+        }
+        const char *dot = strrchr(names[i], '.');
+        lengths[i] = dot ? (int)(dot - names[i]) : (int)strlen(names[i]);
+    }
+
+    const char *templ = "%s/%.*s-%.*s.ppm";
+    const int size = snprintf(NULL, 0, templ, dir, lengths[0], names[0], lengths[1], names[1]) + 1;
+    char *name = (char *)malloc(size);
+    snprintf(name, size, templ, dir, lengths[0], names[0], lengths[1], names[1]);
+    return name;
+}
+
+static void
+print_usage(const char *program)
+{
+    fprintf(stderr,
+            "Usage: %s --brush FILE [--brush FILE...] --events FILE [--events FILE...] [options]\n"
+            "\n"
+            "Renders every combination of brush and event file into a PPM image.\n"
+            "\n"
+            "Options:\n"
+            "  --size WxH            Canvas size in pixels (default 1000x1000)\n"
+            "  --scale F             Scale of the event coordinates (default 1.0)\n"
+            "  --jobs N              Number of documents rendered concurrently (default: number of CPUs)\n"
+            "  --output-dir DIR      Directory for the images (default .)\n"
+            "  --transaction MODE    'event' for one surface transaction per event (default),\n"
+            "                        'document' for a single one per document\n"
+            "  --stats               Print the counters and phase times of each document's surface\n"
+            "  --trace FILE          Write a Chrome trace of the rendering (needs --enable-tracing)\n",
+            program);
+}
+
+int
+main(int argc, char **argv)
+{
+    const char **brushes = (const char **)malloc(sizeof(char *) * argc);
+    const char **events = (const char **)malloc(sizeof(char *) * argc);
+    int num_brushes = 0;
+    int num_events = 0;
+
+    RenderJob job;
+    job.width = 1000;
+    job.height = 1000;
+    job.scale = 1.0;
+    job.transaction_per_event = TRUE;
+    job.stats = FALSE;
+    job.next_document = 0;
+    const char *output_dir = ".";
+    const char *trace_file = NULL;
+    int num_jobs = default_num_jobs();
+
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        const char *value = (i + 1 < argc) ? argv[i + 1] : NULL;
+        gboolean valid = (value != NULL);
+
+        if (strcmp(arg, "--help") == 0 || strcmp(arg, "-h") == 0) {
+            print_usage(argv[0]);
+            return 0;
+        } else if (strcmp(arg, "--stats") == 0) {
+            job.stats = TRUE;
+            continue;
+        } else if (strcmp(arg, "--brush") == 0) {
+            brushes[num_brushes++] = value;
+        } else if (strcmp(arg, "--events") == 0) {
+            events[num_events++] = value;
+        } else if (strcmp(arg, "--size") == 0) {
+            valid = valid && sscanf(value, "%dx%d", &job.width, &job.height) == 2 &&
+                    job.width > 0 && job.height > 0;
+        } else if (strcmp(arg, "--scale") == 0) {
+            valid = valid && sscanf(value, "%f", &job.scale) == 1 && job.scale > 0;
+        } else if (strcmp(arg, "--jobs") == 0) {
+            valid = valid && sscanf(value, "%d", &num_jobs) == 1 && num_jobs > 0;
+        } else if (strcmp(arg, "--trace") == 0) {
+            trace_file = value;
+        } else if (strcmp(arg, "--output-dir") == 0) {
+            output_dir = value;
+        } else if (strcmp(arg, "--transaction") == 0) {
+            valid = valid && (strcmp(value, "event") == 0 || strcmp(value, "document") == 0);
+            job.transaction_per_event = valid && strcmp(value, "event") == 0;
+        } else {
+            valid = FALSE;
+        }
+
+        if (!valid) {
+            fprintf(stderr, "Error: Invalid argument '%s'\n", arg);
+            print_usage(argv[0]);
+            return 1;
+        }
+        i++;
+    }
+
+    if (num_brushes == 0 || num_events == 0) {
+        print_usage(argv[0]);
+        return 1;
+    }
+    if (trace_file && !mypaint_trace_is_enabled()) {
+        fprintf(stderr, "Error: libmypaint was built without --enable-tracing\n");
+        return 1;
+    }
+
+    job.num_documents = num_brushes * num_events;
+    job.documents = (RenderDocument *)calloc(job.num_documents, sizeof(RenderDocument));
+    for (int b = 0; b < num_brushes; b++) {
+        for (int e = 0; e < num_events; e++) {
+            RenderDocument *document = &job.documents[b * num_events + e];
+            document->brush_file = brushes[b];
+            document->events_file = events[e];
+            document->output_file = output_name(output_dir, brushes[b], events[e]);
+        }
+    }
+
+#ifndef HAVE_PTHREAD
+    num_jobs = 1;
+#endif
+    if (num_jobs > job.num_documents) {
+        num_jobs = job.num_documents;
+    }
+
+    const double start = get_time();
+#ifdef HAVE_PTHREAD
+    pthread_mutex_init(&job.lock, NULL);
+    pthread_t *threads = (pthread_t *)malloc(sizeof(pthread_t) * num_jobs);
+    int num_threads = 0;
+    // The calling thread is the first worker
+    for (int i = 1; i < num_jobs; i++) {
+        if (pthread_create(&threads[num_threads], NULL, render_worker, &job) == 0) {
+            num_threads++;
+        }
+    }
+    render_worker(&job);
+    for (int i = 0; i < num_threads; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    free(threads);
+    pthread_mutex_destroy(&job.lock);
+#else
+    render_worker(&job);
+#endif
+    const double seconds = get_time() - start;
+
+    long dabs = 0;
+    long tiles = 0;
+    int failed = 0;
+    for (int i = 0; i < job.num_documents; i++) {
+        dabs += job.documents[i].dabs;
+        tiles += job.documents[i].tiles;
+        if (!job.documents[i].ok) {
+            failed++;
+        }
+        free(job.documents[i].output_file);
+    }
+
+    fprintf(stdout, "%d documents (%d failed) in %.3f s with %d jobs: "
+            "%.0f dabs/s, %.0f tiles/s, %.2f documents/s\n",
+            job.num_documents, failed, seconds, num_jobs,
+            dabs / seconds, tiles / seconds, job.num_documents / seconds);
+
+    if (trace_file && !mypaint_trace_write_json(trace_file)) {
+        failed++;
+    }
+
+    free(job.documents);
+    free(brushes);
+    free(events);
+
+    return failed ? 1 : 0;
+}
@@ -20,11 +20,13 @@
 #include <math.h>
 #include <string.h>
 
+#include "mypaint-config.h"
 #include "mypaint-utils-stroke-player.h"
 #include "mypaint-test-surface.h"
 #include "mypaint-test-surface.h"
 #include "testutils.h"
 #include "mypaint-benchmark.h"
+#include "mypaint-recording-surface.h"
 
 #ifndef LIBMYPAINT_TESTING_ABS_TOP_SRCDIR
 #define LIBMYPAINT_TESTING_ABS_TOP_SRCDIR ".."
@@ -36,7 +38,13 @@ typedef enum {
     SurfaceTransactionPerStroke
 } SurfaceTransaction;
 
-typedef struct {
+typedef enum {
+    SurfaceTestFull,        // brush engine and surface
+    SurfaceTestEngineOnly,  // brush engine, the dabs are discarded
+    SurfaceTestRasterOnly   // surface, replaying the dabs of the full test
+} SurfaceTestMode;
+
+typedef struct SurfaceTestData {
     char *test_case_id;
     MyPaintTestsSurfaceFactory factory_function;
     gpointer factory_user_data;
@@ -46,8 +54,126 @@ typedef struct {
     int iterations;
     const char *brush_file;
     SurfaceTransaction surface_transaction;
+    SurfaceTestMode mode;
+    struct SurfaceTestData *full_test; // RasterOnly: the test whose dabs to replay
+    gboolean record; // Full: record the dabs for a RasterOnly test
+    MyPaintRecordingSurface *recording; // Full: what it painted, until replayed
+    MyPaintTestsSurfaceSetThreads set_threads; // NULL if not supported
+    int num_threads; // 0 for the default of the surface
 } SurfaceTestData;
 
+static MyPaintSurface *
+create_surface(SurfaceTestData *data)
+{
+    MyPaintSurface *surface = data->factory_function(data->factory_user_data);
+    if (data->set_threads && data->num_threads > 0) {
+        data->set_threads(surface, data->num_threads);
+    }
+    return surface;
+}
+
+// A surface that discards all dabs, for timing the brush engine on its own
+
+static int
+null_surface_draw_dab(MyPaintSurface *self, float x, float y, float radius,
+                      float color_r, float color_g, float color_b, float opaque,
+                      float hardness, float softness, float alpha_eraser,
+                      float aspect_ratio, float angle, float lock_alpha,
+                      float colorize, float posterize, float posterize_num, float paint)
+{
+    return 1;
+}
+
+static int
+null_surface_draw_dabs(MyPaintSurface *self, const MyPaintDabs *dabs)
+{
+    return dabs->num_dabs;
+}
+
+static void
+null_surface_get_color(MyPaintSurface *self, float x, float y, float radius,
+                       float *color_r, float *color_g, float *color_b, float *color_a,
+                       float paint)
+{
+    *color_r = *color_g = *color_b = *color_a = 1.0f;
+}
+
+static void
+null_surface_end_atomic(MyPaintSurface *self, MyPaintRectangles *roi)
+{
+    if (roi) {
+        roi->num_rectangles = 0;
+    }
+}
+
+static void
+null_surface_destroy(MyPaintSurface *self)
+{
+    free(self);
+}
+
+static MyPaintSurface *
+null_surface_new(void)
+{
+    MyPaintSurface *self = (MyPaintSurface *)malloc(sizeof(MyPaintSurface));
+    mypaint_surface_init(self);
+    self->draw_dab = null_surface_draw_dab;
+    self->draw_dabs = null_surface_draw_dabs;
+    self->get_color = null_surface_get_color;
+    self->begin_atomic = NULL;
+    self->end_atomic = null_surface_end_atomic;
+    self->destroy = null_surface_destroy;
+    self->save_png = NULL;
+    return self;
+}
+
+// Whether two surfaces hold the same pixels, sampled on a grid.
+// Color picks with a radius above 2 sample pixels at random, so they
+// could differ even between identical surfaces.
+static gboolean
+surfaces_match(MyPaintSurface *a, MyPaintSurface *b)
+{
+    for (int y = 0; y < 1000; y += 25) {
+        for (int x = 0; x < 1000; x += 25) {
+            float ca[4], cb[4];
+            mypaint_surface_get_color(a, x, y, 2, &ca[0], &ca[1], &ca[2], &ca[3], 1.0);
+            mypaint_surface_get_color(b, x, y, 2, &cb[0], &cb[1], &cb[2], &cb[3], 1.0);
+            if (memcmp(ca, cb, sizeof(ca)) != 0) {
+                return FALSE;
+            }
+        }
+    }
+    return TRUE;
+}
+
+int
+test_surface_replay(void *user_data)
+{
+    SurfaceTestData *data = (SurfaceTestData *)user_data;
+    MyPaintRecordingSurface *recording = data->full_test->recording;
+    assert(recording);
+
+    size_t size = 0;
+    const void *dabs = mypaint_recording_surface_get_data(recording, &size);
+    MyPaintSurface *surface = create_surface(data);
+
+    mypaint_benchmark_start(data->test_case_id);
+    // Keeping the recorded atomic operations measures the same surface work as
+    // in the full test. Merging them would also paint outside of a fixed size
+    // surface with long queues per tile, which is slower and not comparable.
+    mypaint_recording_replay(dabs, size, surface, 1.0, FALSE);
+    int result = mypaint_benchmark_end();
+
+    // Per-tile order is kept, so the replay must give the same pixels
+    assert(surfaces_match(mypaint_recording_surface_interface(recording), surface));
+
+    mypaint_surface_unref(surface);
+    mypaint_surface_unref(mypaint_recording_surface_interface(recording));
+    data->full_test->recording = NULL;
+
+    return result;
+}
+
 int
 test_surface_drawing(void *user_data)
 {
@@ -60,7 +186,18 @@ test_surface_drawing(void *user_data)
     assert(event_data);
     assert(brush_data);
 
-    MyPaintSurface *surface = data->factory_function(data->factory_user_data);
+    MyPaintSurface *surface = NULL;
+    if (data->mode == SurfaceTestEngineOnly) {
+        surface = null_surface_new();
+    } else if (!data->record) {
+        surface = create_surface(data);
+    } else {
+        MyPaintSurface *target = create_surface(data);
+        data->recording = mypaint_recording_surface_new(target);
+        mypaint_surface_unref(target);
+        surface = mypaint_recording_surface_interface(data->recording);
+        mypaint_surface_ref(surface);
+    }
     MyPaintBrush *brush = mypaint_brush_new();
     mypaint_brush_from_defaults(brush);
     MyPaintUtilsStrokePlayer *player = mypaint_utils_stroke_player_new();
@@ -90,14 +227,7 @@ test_surface_drawing(void *user_data)
         }
     }
     int result = mypaint_benchmark_end();
-
-    char *png_filename = malloc(snprintf(NULL, 0, "%s.png", data->test_case_id) + 1);
-    sprintf(png_filename, "%s.png", data->test_case_id);
-
-    //mypaint_surface_save_png(surface, png_filename, 0, 0, -1, 1);
-    // FIXME: check the correctness of the outputted PNG
-
-    free(png_filename);
+    // The correctness of the output is checked by test-golden
 
     mypaint_brush_unref(brush);
     mypaint_surface_unref(surface);
@@ -109,6 +239,42 @@ test_surface_drawing(void *user_data)
     return result;
 }
 
+/* Paint the events of the case one transaction at a time, returning the
+ * latency of each event in milliseconds. Sets @events_n to their number. */
+static double *
+test_surface_latency(SurfaceTestData *data, gboolean realtime, int *events_n)
+{
+    char * brush_data = read_file(data->brush_file);
+    assert(brush_data);
+
+    MyPaintSurface *surface = create_surface(data);
+    MyPaintBrush *brush = mypaint_brush_new();
+    mypaint_brush_from_defaults(brush);
+    mypaint_brush_from_string(brush, brush_data);
+    mypaint_brush_set_base_value(brush, MYPAINT_BRUSH_SETTING_RADIUS_LOGARITHMIC, log(data->brush_size));
+
+    MyPaintUtilsStrokePlayer *player = mypaint_utils_stroke_player_new();
+    mypaint_utils_stroke_player_load_file(player, LIBMYPAINT_TESTING_ABS_TOP_SRCDIR
+                                          "/tests/events/painting30sec.dat");
+    mypaint_utils_stroke_player_set_brush(player, brush);
+    mypaint_utils_stroke_player_set_surface(player, surface);
+    mypaint_utils_stroke_player_set_scale(player, data->scale);
+
+    *events_n = mypaint_utils_stroke_player_get_num_events(player);
+    double *latencies = (double *)malloc(sizeof(double) * (*events_n + 1));
+    mypaint_utils_stroke_player_run_latency(player, realtime, latencies);
+    for (int i = 0; i < *events_n; i++) {
+        latencies[i] *= 1000;
+    }
+
+    mypaint_brush_unref(brush);
+    mypaint_surface_unref(surface);
+    mypaint_utils_stroke_player_free(player);
+    free(brush_data);
+
+    return latencies;
+}
+
 char *
 create_id(const char *templ, const char *title)
 {
@@ -117,15 +283,354 @@ create_id(const char *templ, const char *title)
     return id;
 }
 
+#define MAX_THREAD_COUNTS 16
+
+typedef struct {
+    int repetitions;
+    int threads[MAX_THREAD_COUNTS];
+    int threads_n;
+    const char *json_path;
+    const char *baseline_path;
+    double tolerance; // Relative slowdown of the median flagged as a regression
+    const char *filter;
+    gboolean latency;
+    gboolean realtime;
+} BenchmarkOptions;
+
+// Timings of one test case at one thread count
+typedef struct {
+    const char *id;
+    int num_threads;
+    double *samples; // milliseconds, one per repetition
+    double median;
+    double p95;
+    double min;
+    double mean;
+    double stddev;
+} BenchmarkResult;
+
+// Cases faster than this in the baseline are never flagged, timer noise dominates them
+static const double regression_min_ms = 1.0;
+
+static void
+print_benchmark_usage(const char *program)
+{
+    fprintf(stderr,
+            "Usage: %s [--full-benchmark] [options]\n"
+            "\n"
+            "Options:\n"
+            "  --full-benchmark     Run all brush radii, not only the smallest and largest\n"
+            "  --repetitions N      Run every case N times, reporting the median and p95\n"
+            "  --threads LIST       Comma separated rendering thread counts to sweep, e.g. 1,2,4\n"
+            "  --json FILE          Write the results as JSON\n"
+            "  --baseline FILE      Compare with the results of an earlier --json run, and\n"
+            "                       fail if a median got slower than the tolerance\n"
+            "  --tolerance PERCENT  Allowed slowdown against the baseline (default 10)\n"
+            "  --filter TEXT        Only run the cases whose id contains TEXT, e.g. 'b:01  r:2 '\n"
+            "  --latency            Measure the latency of each event instead of the total time,\n"
+            "                       replaying the events at their recorded rate\n"
+            "  --no-realtime        With --latency, replay each event as soon as the previous is done\n",
+            program);
+}
+
+static gboolean
+parse_thread_counts(const char *list, BenchmarkOptions *options)
+{
+    options->threads_n = 0;
+    const char *p = list;
+    while (*p) {
+        char *end;
+        const long n = strtol(p, &end, 10);
+        if (end == p || n < 1 || options->threads_n == MAX_THREAD_COUNTS) {
+            return FALSE;
+        }
+        options->threads[options->threads_n++] = (int)n;
+        p = (*end == ',') ? end + 1 : end;
+        if (*end && *end != ',') {
+            return FALSE;
+        }
+    }
+    return options->threads_n > 0;
+}
+
+static int
+compare_doubles(const void *a, const void *b)
+{
+    const double da = *(const double *)a;
+    const double db = *(const double *)b;
+    return (da > db) - (da < db);
+}
+
+static void
+compute_statistics(BenchmarkResult *result, int n)
+{
+    double *sorted = (double *)malloc(sizeof(double) * n);
+    memcpy(sorted, result->samples, sizeof(double) * n);
+    qsort(sorted, n, sizeof(double), compare_doubles);
+
+    double sum = 0.0;
+    for (int i = 0; i < n; i++) {
+        sum += sorted[i];
+    }
+    result->median = (n % 2) ? sorted[n/2] : (sorted[n/2-1] + sorted[n/2]) / 2;
+    // Nearest rank
+    result->p95 = sorted[(int)ceil(0.95 * n) - 1];
+    result->min = sorted[0];
+    result->mean = sum / n;
+    double variance = 0.0;
+    for (int i = 0; i < n; i++) {
+        variance += (sorted[i] - result->mean) * (sorted[i] - result->mean);
+    }
+    result->stddev = n > 1 ? sqrt(variance / (n - 1)) : 0.0;
+    free(sorted);
+}
+
+/* One result per line, so that baselines can be read back without a JSON parser */
+static gboolean
+write_benchmark_json(const char *path, const char *title, const BenchmarkOptions *options,
+                     const BenchmarkResult *results, int results_n)
+{
+    FILE *fp = fopen(path, "w");
+    if (!fp) {
+        fprintf(stderr, "Error: Unable to open '%s' for writing\n", path);
+        return FALSE;
+    }
+    fprintf(fp, "{\n  \"title\": \"%s\",\n  \"tile_size\": %d,\n  \"repetitions\": %d,\n  \"results\": [\n",
+            title, MYPAINT_TILE_SIZE, options->repetitions);
+    for (int i = 0; i < results_n; i++) {
+        const BenchmarkResult *r = &results[i];
+        fprintf(fp, "    {\"id\": \"%s\", \"threads\": %d, \"median_ms\": %.3f, \"p95_ms\": %.3f, "
+                "\"min_ms\": %.3f, \"mean_ms\": %.3f, \"stddev_ms\": %.3f, \"samples_ms\": [",
+                r->id, r->num_threads, r->median, r->p95, r->min, r->mean, r->stddev);
+        for (int j = 0; j < options->repetitions; j++) {
+            fprintf(fp, "%s%.3f", j ? ", " : "", r->samples[j]);
+        }
+        fprintf(fp, "]}%s\n", i < results_n - 1 ? "," : "");
+    }
+    fprintf(fp, "  ]\n}\n");
+    return fclose(fp) == 0;
+}
+
+/* Median of the case @id at @num_threads in a file from write_benchmark_json(), or -1 */
+static double
+baseline_median(const char *baseline, const char *id, int num_threads)
+{
+    const char *line = baseline;
+    while ((line = strstr(line, "{\"id\": \"")) != NULL) {
+        line += strlen("{\"id\": \"");
+        const size_t id_length = strlen(id);
+        int threads = 0;
+        double median = -1.0;
+        if (strncmp(line, id, id_length) == 0 &&
+                sscanf(line + id_length, "\", \"threads\": %d, \"median_ms\": %lf", &threads, &median) == 2 &&
+                threads == num_threads) {
+            return median;
+        }
+    }
+    return -1.0;
+}
+
+/* Returns the number of regressions against the baseline */
+static int
+compare_with_baseline(const char *path, const BenchmarkOptions *options,
+                      const BenchmarkResult *results, int results_n)
+{
+    char *baseline = read_file(path);
+    if (!baseline) {
+        fprintf(stderr, "Error: Unable to read baseline '%s'\n", path);
+        return 1;
+    }
+
+    int regressions = 0;
+    printf("Comparison with %s (tolerance %.1f%%):\n", path, options->tolerance * 100);
+    for (int i = 0; i < results_n; i++) {
+        const BenchmarkResult *r = &results[i];
+        const double base = baseline_median(baseline, r->id, r->num_threads);
+        if (base < 0.0) {
+            printf("%s [t:%d]: not in baseline\n", r->id, r->num_threads);
+            continue;
+        }
+        const double change = base > 0.0 ? (r->median - base) / base : 0.0;
+        const gboolean regressed = base >= regression_min_ms && change > options->tolerance;
+        regressions += regressed ? 1 : 0;
+        printf("%s [t:%d]: %.3f ms -> %.3f ms (%+.1f%%)%s\n", r->id, r->num_threads,
+               base, r->median, change * 100, regressed ? " REGRESSION" : "");
+    }
+    printf("%d regression(s)\n", regressions);
+    free(baseline);
+    return regressions;
+}
+
+/* Run all cases for each thread count and repetition. Every repetition runs
+ * the cases in order, as raster cases replay what their full case painted. */
+static int
+run_benchmark(const char *title, TestCase *test_cases, SurfaceTestData *test_data, int num_cases,
+              const BenchmarkOptions *options)
+{
+    const int sweep_n = options->threads_n ? options->threads_n : 1;
+    const int results_n = num_cases * sweep_n;
+    BenchmarkResult *results = (BenchmarkResult *)calloc(results_n, sizeof(BenchmarkResult));
+    double *samples = (double *)malloc(sizeof(double) * results_n * options->repetitions);
+
+    for (int t = 0; t < sweep_n; t++) {
+        const int num_threads = options->threads_n ? options->threads[t] : 0;
+        for (int i = 0; i < num_cases; i++) {
+            BenchmarkResult *result = &results[t * num_cases + i];
+            result->id = test_cases[i].id;
+            result->num_threads = num_threads;
+            result->samples = &samples[(t * num_cases + i) * options->repetitions];
+            test_data[i].num_threads = num_threads;
+        }
+        for (int rep = 0; rep < options->repetitions; rep++) {
+            for (int i = 0; i < num_cases; i++) {
+                test_cases[i].function(test_cases[i].user_data);
+                results[t * num_cases + i].samples[rep] = mypaint_benchmark_get_last_duration();
+            }
+        }
+        for (int i = 0; i < num_cases; i++) {
+            BenchmarkResult *r = &results[t * num_cases + i];
+            compute_statistics(r, options->repetitions);
+            printf("%s [t:%d]: median %.3f ms, p95 %.3f ms, stddev %.3f ms\n",
+                   r->id, r->num_threads, r->median, r->p95, r->stddev);
+        }
+        fflush(stdout);
+    }
+
+    int failures = 0;
+    if (options->json_path && !write_benchmark_json(options->json_path, title, options, results, results_n)) {
+        failures++;
+    }
+    if (options->baseline_path) {
+        failures += compare_with_baseline(options->baseline_path, options, results, results_n);
+    }
+
+    free(samples);
+    free(results);
+    return failures != 0;
+}
+
+/* Latency percentiles of the full cases, for each thread count */
+static int
+run_latency_benchmark(const char *title, SurfaceTestData *test_data, int num_cases,
+                      const BenchmarkOptions *options)
+{
+    FILE *fp = NULL;
+    if (options->json_path) {
+        fp = fopen(options->json_path, "w");
+        if (!fp) {
+            fprintf(stderr, "Error: Unable to open '%s' for writing\n", options->json_path);
+            return 1;
+        }
+        fprintf(fp, "{\n  \"title\": \"%s\",\n  \"tile_size\": %d,\n  \"realtime\": %s,\n  \"latencies\": [\n",
+                title, MYPAINT_TILE_SIZE, options->realtime ? "true" : "false");
+    }
+
+    const int sweep_n = options->threads_n ? options->threads_n : 1;
+    gboolean first = TRUE;
+    for (int t = 0; t < sweep_n; t++) {
+        for (int i = 0; i < num_cases; i++) {
+            SurfaceTestData *data = &test_data[i];
+            if (data->mode != SurfaceTestFull) {
+                continue;
+            }
+            data->num_threads = options->threads_n ? options->threads[t] : 0;
+
+            int n = 0;
+            double *latencies = test_surface_latency(data, options->realtime, &n);
+            if (n == 0) {
+                free(latencies);
+                continue;
+            }
+            qsort(latencies, n, sizeof(double), compare_doubles);
+            // Nearest rank
+            const double p50 = latencies[(int)ceil(0.50 * n) - 1];
+            const double p95 = latencies[(int)ceil(0.95 * n) - 1];
+            const double p99 = latencies[(int)ceil(0.99 * n) - 1];
+            const double max = latencies[n - 1];
+
+            printf("%s [t:%d]: %d events, p50 %.3f ms, p95 %.3f ms, p99 %.3f ms, max %.3f ms\n",
+                   data->test_case_id, data->num_threads, n, p50, p95, p99, max);
+            fflush(stdout);
+            if (fp) {
+                fprintf(fp, "%s    {\"id\": \"%s\", \"threads\": %d, \"events\": %d, \"p50_ms\": %.3f, "
+                        "\"p95_ms\": %.3f, \"p99_ms\": %.3f, \"max_ms\": %.3f}",
+                        first ? "" : ",\n", data->test_case_id, data->num_threads, n, p50, p95, p99, max);
+            }
+            first = FALSE;
+            free(latencies);
+        }
+    }
+
+    if (fp) {
+        fprintf(fp, "\n  ]\n}\n");
+        if (fclose(fp) != 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
 int
 mypaint_test_surface_run(int argc, char **argv,
                       MyPaintTestsSurfaceFactory surface_factory,
                       gchar *title, gpointer user_data)
+{
+    return mypaint_test_surface_run_threaded(argc, argv, surface_factory, NULL, title, user_data);
+}
+
+int
+mypaint_test_surface_run_threaded(int argc, char **argv,
+                               MyPaintTestsSurfaceFactory surface_factory,
+                               MyPaintTestsSurfaceSetThreads set_threads,
+                               gchar *title, gpointer user_data)
 {
   gboolean correctness_only = TRUE;
-  if (argc > 1 && strcmp(argv[1], "--full-benchmark") == 0) {
-    correctness_only = FALSE;
+  BenchmarkOptions options = { 1, {0}, 0, NULL, NULL, 0.10, NULL, FALSE, TRUE };
+
+  for (int i = 1; i < argc; i++) {
+    const char *arg = argv[i];
+    const char *value = (i + 1 < argc) ? argv[i + 1] : NULL;
+    gboolean valid = TRUE;
+    if (strcmp(arg, "--full-benchmark") == 0) {
+      correctness_only = FALSE;
+      continue;
+    } else if (strcmp(arg, "--latency") == 0) {
+      options.latency = TRUE;
+      continue;
+    } else if (strcmp(arg, "--no-realtime") == 0) {
+      options.realtime = FALSE;
+      continue;
+    } else if (strcmp(arg, "--repetitions") == 0) {
+      valid = value && sscanf(value, "%d", &options.repetitions) == 1 && options.repetitions > 0;
+    } else if (strcmp(arg, "--threads") == 0) {
+      valid = value && parse_thread_counts(value, &options);
+      if (valid && !set_threads) {
+        fprintf(stderr, "Warning: %s does not support setting the number of threads\n", title);
+      }
+    } else if (strcmp(arg, "--json") == 0) {
+      options.json_path = value;
+      valid = value != NULL;
+    } else if (strcmp(arg, "--baseline") == 0) {
+      options.baseline_path = value;
+      valid = value != NULL;
+    } else if (strcmp(arg, "--filter") == 0) {
+      options.filter = value;
+      valid = value != NULL;
+    } else if (strcmp(arg, "--tolerance") == 0) {
+      valid = value && sscanf(value, "%lf", &options.tolerance) == 1 && options.tolerance >= 0.0;
+      options.tolerance /= 100;
+    } else {
+      valid = FALSE;
+    }
+    if (!valid) {
+      fprintf(stderr, "Error: Invalid argument '%s'\n", arg);
+      print_benchmark_usage(argv[0]);
+      return 1;
+    }
+    i++;
   }
+  const gboolean extended = options.repetitions > 1 || options.threads_n || options.json_path ||
+                            options.baseline_path;
 
     printf("Running test: %s\n", title);
 #define BRUSH_PATH(brushname) LIBMYPAINT_TESTING_ABS_TOP_SRCDIR "/tests/brushes/" brushname ".myb"
@@ -142,11 +647,15 @@ mypaint_test_surface_run(int argc, char **argv,
     max_brush_radius[3] = 512;
 
     int num_cases = 0;
+    // Each case also runs without a surface, and replaying its dabs onto a
+    // surface, to report the brush engine and surface times separately.
+    // Correctness tests only replay the smallest radius, as replaying
+    // takes about as long as the full test.
     if (correctness_only) {
-      num_cases = num_brushes * 2;
+      num_cases = num_brushes * (2 + 2 + 1);
     } else {
       for (int i = 0; i < num_brushes; ++i) {
-        num_cases += (int)log2(max_brush_radius[i]);
+        num_cases += (int)log2(max_brush_radius[i]) * 3;
       }
     }
 
@@ -164,27 +673,50 @@ mypaint_test_surface_run(int argc, char **argv,
           continue;
         }
         const float scale = powf(2, ((int)log2(radius)-1) / 3);
-        snprintf(test_ids[case_n], max_id_length, "(b:%02d  r:%-3d s:%-3.1f)", brush, radius, scale);
         const int iterations = 1;
         SurfaceTransaction transaction = SurfaceTransactionPerStrokeTo;
-        SurfaceTestData t_data = {
-          test_ids[case_n], surface_factory, user_data, radius, scale, iterations, brush_paths[brush], transaction
-        };
-        test_data[case_n++] = t_data;
+        const char *mode_names[] = {"", " engine", " raster"};
+        const int full_case = case_n;
+        const gboolean replay = !correctness_only || radius == 2;
+        for (int mode = SurfaceTestFull; mode <= SurfaceTestRasterOnly; mode++) {
+          if (mode == SurfaceTestRasterOnly && !replay) {
+            continue;
+          }
+          snprintf(test_ids[case_n], max_id_length, "(b:%02d  r:%-3d s:%-3.1f)%s",
+                   brush, radius, scale, mode_names[mode]);
+          // The filter selects full cases, with their engine and raster cases
+          if (options.filter && !strstr(test_ids[full_case], options.filter)) {
+            break;
+          }
+          SurfaceTestData t_data = {
+            test_ids[case_n], surface_factory, user_data, radius, scale, iterations, brush_paths[brush], transaction,
+            mode, &test_data[full_case], replay, NULL, set_threads, 0
+          };
+          test_data[case_n++] = t_data;
+        }
       }
     }
 
+    num_cases = case_n;
+
     // Generate test cases
      TestCase test_cases[num_cases];
      for (int i = 0; i < num_cases; ++i) {
          TestCase t;
          t.id = test_data[i].test_case_id;
-         t.function = test_surface_drawing;
+         t.function = (test_data[i].mode == SurfaceTestRasterOnly) ? test_surface_replay
+                                                                   : test_surface_drawing;
          t.user_data = (void*)&test_data[i];
          test_cases[i] = t;
      };
 
      // Run test cases
+     if (options.latency) {
+         return run_latency_benchmark(title, test_data, num_cases, &options);
+     }
+     if (extended) {
+         return run_benchmark(title, test_cases, test_data, num_cases, &options);
+     }
      return test_cases_run(argc, argv, test_cases, TEST_CASES_NUMBER(test_cases), TEST_CASE_BENCHMARK);
 
 #undef BRUSH_PATH
@@ -8,11 +8,22 @@ G_BEGIN_DECLS
 
 typedef MyPaintSurface * (*MyPaintTestsSurfaceFactory)(gpointer user_data);
 
+/* Sets the number of rendering threads of a surface made by the factory */
+typedef void (*MyPaintTestsSurfaceSetThreads)(MyPaintSurface *surface, int num_threads);
+
 int
 mypaint_test_surface_run(int argc, char **argv,
                       MyPaintTestsSurfaceFactory surface_factory,
                       gchar *title, gpointer user_data);
 
+/* Same as mypaint_test_surface_run(), for surfaces that support the
+ * --threads sweep of the benchmark */
+int
+mypaint_test_surface_run_threaded(int argc, char **argv,
+                               MyPaintTestsSurfaceFactory surface_factory,
+                               MyPaintTestsSurfaceSetThreads set_threads,
+                               gchar *title, gpointer user_data);
+
 G_END_DECLS
 
 #endif // MYPAINTTESTSURFACE_H
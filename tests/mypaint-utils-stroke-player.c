@@ -17,10 +17,22 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
-#include <stdlib.h>
+#include <stdint.h>
+#include <limits.h>
 #include <assert.h>
 
 #include "mypaint-utils-stroke-player.h"
+#include "mypaint-benchmark.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
 
 int lines_in_string(const char *str) {
     int lines = 0;
@@ -33,8 +45,9 @@ int lines_in_string(const char *str) {
     return lines;
 }
 
+/* One event of the binary format, all mypaint_brush_stroke_to() parameters.
+ * Also the in-memory representation, so mapped files are used in place. */
 typedef struct {
-    gboolean valid;
     float time;
     float x;
     float y;
@@ -46,14 +59,32 @@ typedef struct {
     float barrel_rotation;
 } MotionEvent;
 
+#define EVENTS_NUM_FIELDS (int)(sizeof(MotionEvent) / sizeof(float))
+
+/* Binary event file: header, followed by the events in native byte order.
+ * A file written on a machine of the other endianness fails the magic check. */
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t num_fields;
+    uint32_t num_events;
+} EventsHeader;
+
+static const uint32_t events_magic = 0x4550594dU; // "MYPE"
+static const uint32_t events_version = 1;
+
 struct MyPaintUtilsStrokePlayer {
     MyPaintSurface *surface;
     MyPaintBrush *brush;
-    MotionEvent *events;
+    const MotionEvent *events;
     int current_event_index;
     int number_of_events;
     gboolean transaction_on_stroke; /* If MyPaintBrush::stroke_to should be done between MyPaintSurface::begin_atomic() end_atomic() calls.*/
     float scale;
+    // Storage behind @events: allocated, or a mapped file
+    MotionEvent *owned_events;
+    void *mapping;
+    size_t mapping_size;
 };
 
 MyPaintUtilsStrokePlayer *
@@ -68,16 +99,33 @@ mypaint_utils_stroke_player_new(void)
     self->current_event_index = 0;
     self->transaction_on_stroke = TRUE;
     self->scale = 1.0;
+    self->owned_events = NULL;
+    self->mapping = NULL;
+    self->mapping_size = 0;
 
     return self;
 }
 
+static void
+free_events(MyPaintUtilsStrokePlayer *self)
+{
+    free(self->owned_events);
+    self->owned_events = NULL;
+#ifndef _WIN32
+    if (self->mapping) {
+        munmap(self->mapping, self->mapping_size);
+    }
+#endif
+    self->mapping = NULL;
+    self->mapping_size = 0;
+    self->events = NULL;
+    self->number_of_events = 0;
+}
+
 void
 mypaint_utils_stroke_player_free(MyPaintUtilsStrokePlayer *self)
 {
-    if (self->events) {
-        free(self->events);
-    }
+    free_events(self);
     free(self);
 }
 
@@ -92,65 +140,251 @@ void mypaint_utils_stroke_player_set_surface(MyPaintUtilsStrokePlayer *self, MyP
     self->surface = surface;
 }
 
+/* Parse one line of text: time, x, y and pressure, optionally followed by
+ * either barrel_rotation alone (the original five column layout), or by
+ * xtilt and ytilt, then optionally viewzoom, viewrotation and barrel_rotation.
+ * Returns FALSE if the line has fewer than 4 or more than 9 columns. */
+static gboolean
+parse_event_line(const char *line, const char *line_end, MotionEvent *event)
+{
+    float values[EVENTS_NUM_FIELDS] = { 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 1.0, 0.0, 0.0 };
+    int columns = 0;
+    const char *p = line;
+
+    while (p < line_end) {
+        char *end;
+        const double value = strtod(p, &end);
+        // strtod() skips newlines, so stop at values on the next line
+        if (end == p || end > line_end) {
+            break;
+        }
+        if (columns == EVENTS_NUM_FIELDS) {
+            return FALSE;
+        }
+        values[columns++] = value;
+        p = end;
+    }
+    // Only trailing whitespace may remain
+    while (p < line_end && (*p == ' ' || *p == '\t' || *p == '\r')) {
+        p++;
+    }
+    if (columns < 4 || p != line_end) {
+        return FALSE;
+    }
+    if (columns == 5) {
+        // barrel_rotation is the last field of MotionEvent
+        values[EVENTS_NUM_FIELDS - 1] = values[4];
+        values[4] = 0.0;
+    }
+    memcpy(event, values, sizeof(MotionEvent));
+    return TRUE;
+}
+
 void
 mypaint_utils_stroke_player_set_source_data(MyPaintUtilsStrokePlayer *self, const char *data)
 {
-    self->number_of_events = lines_in_string(data);
-    self->events = (MotionEvent *)malloc(sizeof(MotionEvent) * self->number_of_events);
+    free_events(self);
+
+    const int lines = lines_in_string(data);
+    MotionEvent *events = (MotionEvent *)malloc(sizeof(MotionEvent) * (lines + 1));
+    int n = 0;
+
+    const char *line = data;
+    while (*line) {
+        const char *line_end = strchr(line, '\n');
+        if (!line_end) {
+            line_end = line + strlen(line);
+        }
+        if (line_end > line) {
+            if (parse_event_line(line, line_end, &events[n])) {
+                n++;
+            } else {
+                fprintf(stderr, "Error: Unable to parse line '%.*s'\n", (int)(line_end - line), line);
+            }
+        }
+        line = *line_end ? line_end + 1 : line_end;
+    }
+
+    self->owned_events = events;
+    self->events = events;
+    self->number_of_events = n;
+
+    mypaint_utils_stroke_player_reset(self);
+}
+
+static gboolean
+binary_events_are_valid(const void *data, size_t size)
+{
+    const EventsHeader *header = (const EventsHeader *)data;
+    return ((uintptr_t)data % sizeof(float)) == 0 &&
+           size >= sizeof(EventsHeader) &&
+           header->magic == events_magic &&
+           header->version == events_version &&
+           header->num_fields == EVENTS_NUM_FIELDS &&
+           header->num_events <= (size - sizeof(EventsHeader)) / sizeof(MotionEvent) &&
+           header->num_events <= INT_MAX;
+}
+
+/**
+ * mypaint_utils_stroke_player_set_source_binary:
+ *
+ * Use events in the binary format, as made by mypaint_utils_stroke_player_to_binary().
+ * The events are used in place, so @data must stay valid for as long as they are played.
+ * Returns FALSE, leaving the player without events, if @data is not a valid event file.
+ */
+gboolean
+mypaint_utils_stroke_player_set_source_binary(MyPaintUtilsStrokePlayer *self, const void *data, size_t size)
+{
+    free_events(self);
+    mypaint_utils_stroke_player_reset(self);
+
+    if (!binary_events_are_valid(data, size)) {
+        return FALSE;
+    }
+    self->events = (const MotionEvent *)((const EventsHeader *)data + 1);
+    self->number_of_events = ((const EventsHeader *)data)->num_events;
+    return TRUE;
+}
+
+/**
+ * mypaint_utils_stroke_player_load_file:
+ *
+ * Load events from a binary event file, which is mapped into memory where
+ * supported, or else from the text format.
+ */
+gboolean
+mypaint_utils_stroke_player_load_file(MyPaintUtilsStrokePlayer *self, const char *path)
+{
+#ifndef _WIN32
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        fprintf(stderr, "Error: Unable to open '%s'\n", path);
+        return FALSE;
+    }
 
-    char * data_copy = strdup(data);
+    EventsHeader header;
+    const size_t size = st.st_size;
+    if (size >= sizeof(header) && read(fd, &header, sizeof(header)) == sizeof(header) &&
+            header.magic == events_magic) {
+        void *mapping = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (mapping == MAP_FAILED) {
+            fprintf(stderr, "Error: Unable to map '%s'\n", path);
+            return FALSE;
+        }
+        if (!mypaint_utils_stroke_player_set_source_binary(self, mapping, size)) {
+            munmap(mapping, size);
+            fprintf(stderr, "Error: Invalid event file '%s'\n", path);
+            return FALSE;
+        }
+        self->mapping = mapping;
+        self->mapping_size = size;
+        return TRUE;
+    }
+    close(fd);
+#endif
 
-    assert(data_copy);
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        fprintf(stderr, "Error: Unable to open '%s'\n", path);
+        return FALSE;
+    }
+    fseek(file, 0, SEEK_END);
+    const long file_size = ftell(file);
+    rewind(file);
 
-    char * line = strtok(data_copy, "\n");;
-    for (int i=0; i<self->number_of_events; i++) {
-        MotionEvent *event = &self->events[i];
+    // Aligned for the binary format, and NUL terminated for the text format
+    const size_t words = file_size / sizeof(float) + 1;
+    float *buffer = (float *)malloc(words * sizeof(float));
+    const size_t read_size = fread(buffer, 1, file_size, file);
+    fclose(file);
+    ((char *)buffer)[read_size] = '\0';
 
-        int matches = sscanf(line, "%f %f %f %f %f",
-                             &event->time, &event->x, &event->y, &event->pressure, &event->barrel_rotation);
-        if (matches != 4) {
-            event->valid = FALSE;
-            fprintf(stderr, "Error: Unable to parse line '%s'\n", line);
+    gboolean ok = TRUE;
+    if (read_size >= sizeof(EventsHeader) && ((EventsHeader *)buffer)->magic == events_magic) {
+        ok = mypaint_utils_stroke_player_set_source_binary(self, buffer, read_size);
+        if (ok) {
+            // Keep the buffer as the storage of the events
+            self->owned_events = (MotionEvent *)buffer;
+            buffer = NULL;
         } else {
-            event->valid = TRUE;
+            fprintf(stderr, "Error: Invalid event file '%s'\n", path);
         }
-        event->xtilt = 0.0;
-        event->ytilt = 0.0;
-        event->viewzoom = 1.0;
-        event->viewrotation = 0.0;
-        event->barrel_rotation = 0.0;
+    } else {
+        mypaint_utils_stroke_player_set_source_data(self, (const char *)buffer);
+    }
+    free(buffer);
+    return ok;
+}
 
-        line = strtok(NULL, "\n");
+/**
+ * mypaint_utils_stroke_player_to_binary:
+ *
+ * Serialize the events of the player into the binary format.
+ * Returns a buffer of @size bytes, to be freed with free().
+ */
+void *
+mypaint_utils_stroke_player_to_binary(MyPaintUtilsStrokePlayer *self, size_t *size)
+{
+    const size_t events_size = sizeof(MotionEvent) * self->number_of_events;
+    EventsHeader *header = (EventsHeader *)malloc(sizeof(EventsHeader) + events_size);
+
+    header->magic = events_magic;
+    header->version = events_version;
+    header->num_fields = EVENTS_NUM_FIELDS;
+    header->num_events = self->number_of_events;
+    if (events_size) {
+        memcpy(header + 1, self->events, events_size);
     }
 
-    free(data_copy);
+    *size = sizeof(EventsHeader) + events_size;
+    return header;
+}
 
-    mypaint_utils_stroke_player_reset(self);
+int
+mypaint_utils_stroke_player_get_num_events(MyPaintUtilsStrokePlayer *self)
+{
+    return self->number_of_events;
 }
 
-gboolean
-mypaint_utils_stroke_player_iterate(MyPaintUtilsStrokePlayer *self)
+/* Convert the event at @index for mypaint_brush_stroke_to_events() */
+static void
+get_brush_event(MyPaintUtilsStrokePlayer *self, int index, MyPaintBrushEvent *brush_event)
 {
-    const MotionEvent *event = &self->events[self->current_event_index];
-    const int last_event_index = self->current_event_index-1;
+    const MotionEvent *event = &self->events[index];
     float last_event_time = 0.0;
-    if (last_event_index >= 0) {
-        const MotionEvent *last_event = &self->events[last_event_index];
-        last_event_time = last_event->time;
+    if (index > 0) {
+        last_event_time = self->events[index-1].time;
     }
     const float dtime = event->time - last_event_time;
-    const float linear = FALSE;
-    if (event->valid) {
+
+    brush_event->x = event->x*self->scale;
+    brush_event->y = event->y*self->scale;
+    brush_event->pressure = event->pressure;
+    brush_event->xtilt = event->xtilt;
+    brush_event->ytilt = event->ytilt;
+    brush_event->dtime = dtime;
+    brush_event->viewzoom = event->viewzoom;
+    brush_event->viewrotation = event->viewrotation;
+    brush_event->barrel_rotation = event->barrel_rotation;
+}
+
+gboolean
+mypaint_utils_stroke_player_iterate(MyPaintUtilsStrokePlayer *self)
+{
+    const gboolean linear = FALSE;
+    if (self->current_event_index < self->number_of_events) {
         if (self->transaction_on_stroke) {
             mypaint_surface_begin_atomic(self->surface);
         }
 
-        mypaint_brush_stroke_to(self->brush, self->surface,
-                                event->x*self->scale, event->y*self->scale,
-                                event->pressure,
-                                event->xtilt, event->ytilt, dtime,
-                                event->viewzoom, event->viewrotation,
-                                event->barrel_rotation, linear);
+        MyPaintBrushEvent brush_event;
+        get_brush_event(self, self->current_event_index, &brush_event);
+        mypaint_brush_stroke_to_events(self->brush, self->surface, &brush_event, 1, linear, NULL);
 
         if (self->transaction_on_stroke) {
             mypaint_surface_end_atomic(self->surface, NULL);
@@ -175,9 +409,77 @@ mypaint_utils_stroke_player_reset(MyPaintUtilsStrokePlayer *self)
 void
 mypaint_utils_stroke_player_run_sync(MyPaintUtilsStrokePlayer *self)
 {
-    while(mypaint_utils_stroke_player_iterate(self)) {
-        ;
+    if (self->transaction_on_stroke) {
+        while(mypaint_utils_stroke_player_iterate(self)) {
+            ;
+        }
+        return;
+    }
+
+    // Without transactions in between, the brush gets the events in batches
+    MyPaintBrushEvent batch[64];
+    int batch_n = 0;
+    for (int i = self->current_event_index; i < self->number_of_events; i++) {
+        get_brush_event(self, i, &batch[batch_n++]);
+        if (batch_n == sizeof(batch)/sizeof(batch[0]) || (batch_n && i == self->number_of_events-1)) {
+            mypaint_brush_stroke_to_events(self->brush, self->surface, batch, batch_n, FALSE, NULL);
+            batch_n = 0;
+        }
+    }
+    mypaint_utils_stroke_player_reset(self);
+}
+
+static void
+sleep_until(double deadline)
+{
+    const double remaining = deadline - get_time();
+    if (remaining <= 0.0) {
+        return;
     }
+#ifdef _WIN32
+    Sleep((DWORD)(remaining * 1000));
+#else
+    struct timespec t;
+    t.tv_sec = (time_t)remaining;
+    t.tv_nsec = (long)((remaining - t.tv_sec) * 1e9);
+    nanosleep(&t, NULL);
+#endif
+}
+
+/**
+ * mypaint_utils_stroke_player_run_latency:
+ * @latencies: (out): One latency in seconds per event,
+ *   see mypaint_utils_stroke_player_get_num_events()
+ *
+ * Play all events, each in its own surface transaction, and measure the
+ * input-to-pixel latency of each: the time from the arrival of the event
+ * until the end_atomic() after its stroke_to() returns.
+ * If @realtime, events arrive at their recorded times, so time spent waiting
+ * behind earlier events counts. Otherwise each event arrives as soon as the
+ * previous one is done.
+ */
+void
+mypaint_utils_stroke_player_run_latency(MyPaintUtilsStrokePlayer *self, gboolean realtime, double *latencies)
+{
+    const double start = get_time();
+    const float first_time = self->number_of_events ? self->events[0].time : 0.0;
+
+    for (int i = 0; i < self->number_of_events; i++) {
+        double arrival = get_time();
+        if (realtime) {
+            arrival = start + (self->events[i].time - first_time);
+            sleep_until(arrival);
+        }
+
+        MyPaintBrushEvent brush_event;
+        get_brush_event(self, i, &brush_event);
+        mypaint_surface_begin_atomic(self->surface);
+        mypaint_brush_stroke_to_events(self->brush, self->surface, &brush_event, 1, FALSE, NULL);
+        mypaint_surface_end_atomic(self->surface, NULL);
+
+        latencies[i] = get_time() - arrival;
+    }
+    mypaint_utils_stroke_player_reset(self);
 }
 
 void
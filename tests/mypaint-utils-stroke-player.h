@@ -17,6 +17,8 @@
  * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
+#include <stddef.h>
+
 #include "mypaint-brush.h"
 #include "mypaint-surface.h"
 
@@ -37,6 +39,18 @@ mypaint_utils_stroke_player_set_surface(MyPaintUtilsStrokePlayer *self, MyPaintS
 void
 mypaint_utils_stroke_player_set_source_data(MyPaintUtilsStrokePlayer *self, const char *data);
 
+gboolean
+mypaint_utils_stroke_player_set_source_binary(MyPaintUtilsStrokePlayer *self, const void *data, size_t size);
+
+gboolean
+mypaint_utils_stroke_player_load_file(MyPaintUtilsStrokePlayer *self, const char *path);
+
+void *
+mypaint_utils_stroke_player_to_binary(MyPaintUtilsStrokePlayer *self, size_t *size);
+
+int
+mypaint_utils_stroke_player_get_num_events(MyPaintUtilsStrokePlayer *self);
+
 gboolean
 mypaint_utils_stroke_player_iterate(MyPaintUtilsStrokePlayer *self);
 
@@ -46,6 +60,9 @@ mypaint_utils_stroke_player_reset(MyPaintUtilsStrokePlayer *self);
 void
 mypaint_utils_stroke_player_run_sync(MyPaintUtilsStrokePlayer *self);
 
+void
+mypaint_utils_stroke_player_run_latency(MyPaintUtilsStrokePlayer *self, gboolean realtime, double *latencies);
+
 void
 mypaint_utils_stroke_player_set_transactions_on_stroke_to(MyPaintUtilsStrokePlayer *self, gboolean value);
 
@@ -4,6 +4,7 @@
 #include "testutils.h"
 
 #include <stddef.h> // For NULL
+#include <stdlib.h>
 
 typedef struct {
     const char *cname;
@@ -247,12 +248,97 @@ test_brush_load_inputs(void *user_data)
     return passed;
 }
 
+int
+test_brush_shared_settings(void *user_data)
+{
+    char *input_json = read_file(LIBMYPAINT_TESTING_ABS_TOP_SRCDIR "/tests/brushes/impressionism.myb");
+    const MyPaintBrushSetting radius = MYPAINT_BRUSH_SETTING_RADIUS_LOGARITHMIC;
+    const MyPaintBrushSetting opaque_multiply = MYPAINT_BRUSH_SETTING_OPAQUE_MULTIPLY;
+    const MyPaintBrushInput pressure = MYPAINT_BRUSH_INPUT_PRESSURE;
+
+    MyPaintBrush *brush = mypaint_brush_new();
+    mypaint_brush_from_string(brush, input_json);
+    MyPaintBrush *other = mypaint_brush_new();
+    MyPaintBrushSettings *settings = mypaint_brush_get_settings(brush);
+    mypaint_brush_set_settings(other, settings);
+    mypaint_brush_settings_unref(settings);
+
+    int passed = 1;
+
+    // Shared settings read the same
+    passed &= expect_float(2.0, mypaint_brush_get_base_value(other, radius), "Shared base value");
+    passed &= expect_int(4, mypaint_brush_get_mapping_n(other, opaque_multiply, pressure), "Shared mapping");
+
+    // Changing one brush must not affect the other
+    mypaint_brush_set_base_value(brush, radius, 3.0);
+    mypaint_brush_set_mapping_n(other, opaque_multiply, pressure, 0);
+    passed &= expect_float(3.0, mypaint_brush_get_base_value(brush, radius), "Changed base value");
+    passed &= expect_float(2.0, mypaint_brush_get_base_value(other, radius), "Copied base value");
+    passed &= expect_int(4, mypaint_brush_get_mapping_n(brush, opaque_multiply, pressure), "Copied mapping");
+    passed &= expect_int(0, mypaint_brush_get_mapping_n(other, opaque_multiply, pressure), "Changed mapping");
+
+    mypaint_brush_unref(brush);
+    mypaint_brush_unref(other);
+    free(input_json);
+
+    return passed;
+}
+
+int
+test_brush_binary(void *user_data)
+{
+    char *input_json = read_file(LIBMYPAINT_TESTING_ABS_TOP_SRCDIR "/tests/brushes/modelling.myb");
+
+    MyPaintBrush *brush = mypaint_brush_new();
+    mypaint_brush_from_string(brush, input_json);
+    size_t size = 0;
+    void *binary = mypaint_brush_to_binary(brush, &size);
+    MyPaintBrush *loaded = mypaint_brush_new();
+
+    int passed = expect_true(mypaint_brush_from_binary(loaded, binary, size), "Load binary preset");
+
+    // Everything must survive the round trip exactly
+    for (int s=0; s<MYPAINT_BRUSH_SETTINGS_COUNT; s++) {
+        if (mypaint_brush_get_base_value(brush, s) != mypaint_brush_get_base_value(loaded, s)) {
+            passed = 0;
+        }
+        for (int i=0; i<MYPAINT_BRUSH_INPUTS_COUNT; i++) {
+            const int n = mypaint_brush_get_mapping_n(brush, s, i);
+            if (n != mypaint_brush_get_mapping_n(loaded, s, i)) {
+                passed = 0;
+                continue;
+            }
+            for (int k=0; k<n; k++) {
+                float x0, y0, x1, y1;
+                mypaint_brush_get_mapping_point(brush, s, i, k, &x0, &y0);
+                mypaint_brush_get_mapping_point(loaded, s, i, k, &x1, &y1);
+                if (x0 != x1 || y0 != y1) {
+                    passed = 0;
+                }
+            }
+        }
+    }
+    passed &= expect_true(passed, "Binary preset round trip");
+
+    // Truncated presets are rejected
+    passed &= expect_true(!mypaint_brush_from_binary(loaded, binary, size - 4), "Reject truncated preset");
+
+    mypaint_brush_unref(brush);
+    mypaint_brush_unref(loaded);
+    free(binary);
+    free(input_json);
+
+    return passed;
+}
+
 int
 main(int argc, char **argv)
 {
     TestCase test_cases[] = {
         {"/brush/persistence/load/base_values", test_brush_load_base_values, NULL},
         {"/brush/persistence/load/inputs", test_brush_load_inputs, NULL},
+        {"/brush/persistence/shared_settings", test_brush_shared_settings, NULL},
+        {"/brush/persistence/binary", test_brush_binary, NULL},
     };
 
     return test_cases_run(argc, argv, test_cases, TEST_CASES_NUMBER(test_cases), 0);
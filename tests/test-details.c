@@ -27,7 +27,7 @@ int main(int argc, char *argv[])
     uint16_t buffer[MYPAINT_TILE_SIZE*MYPAINT_TILE_SIZE+2*MYPAINT_TILE_SIZE];
     mypaint_benchmark_start("render_dab_mask");
     for (int i=0; i < iterations; i++) {
-        render_dab_mask(buffer, x, y, radius, hardness, softness, aspect_ratio, angle);
+        render_dab_mask(buffer, x, y, radius, hardness, softness, aspect_ratio, angle, 0, 0);
     }
     const int duration = mypaint_benchmark_end();
     printf("render_dab_mask: %d ms\n", duration);
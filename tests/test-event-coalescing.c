@@ -0,0 +1,152 @@
+/* Renders the recorded events with each test brush, with and without event
+ * coalescing, and checks that the results stay within the tolerance that is
+ * documented for mypaint_brush_set_event_coalescing().
+ *
+ * The recording has an event every 8 ms, so most pairs of events that do not
+ * draw a dab are merged.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "mypaint-brush.h"
+#include "mypaint-fixed-tiled-surface.h"
+#include "mypaint-utils-stroke-player.h"
+#include "testutils.h"
+
+#define SOURCE_PATH(path) LIBMYPAINT_TESTING_ABS_TOP_SRCDIR "/tests/" path
+
+#define EVENTS_PATH SOURCE_PATH("events/painting30sec.dat")
+
+// Large enough for all of the events
+#define CANVAS_WIDTH 1000
+#define CANVAS_HEIGHT 700
+
+typedef struct {
+    const char *name;
+    // Largest mean absolute difference of all channels over the canvas,
+    // in 1/255, as documented for mypaint_brush_set_event_coalescing()
+    double max_mean_difference;
+} BrushTolerance;
+
+static const BrushTolerance brushes[] = {
+    {"bulk", 0.5},
+    {"charcoal", 2.0},      // random offsets
+    {"coarse_bulk_2", 2.0}, // random offsets
+    {"impressionism", 0.5}, // tracking noise, never coalesced
+    {"modelling", 0.5},
+};
+
+/* Paint the events, returning the premultiplied fix15 RGBA pixels
+ * of the surface, row by row, or NULL on failure */
+static uint16_t *
+render(const char *brush_name, gboolean coalesce)
+{
+    char path[1024];
+    snprintf(path, sizeof(path), SOURCE_PATH("brushes/%s.myb"), brush_name);
+    char *data = read_file(path);
+    if (!data) {
+        return NULL;
+    }
+    MyPaintBrush *brush = mypaint_brush_new();
+    mypaint_brush_from_defaults(brush);
+    const gboolean loaded = mypaint_brush_from_string(brush, data);
+    free(data);
+    MyPaintUtilsStrokePlayer *player = mypaint_utils_stroke_player_new();
+    if (!loaded || !mypaint_utils_stroke_player_load_file(player, EVENTS_PATH)) {
+        fprintf(stderr, "Error: Unable to load '%s' or the events\n", path);
+        mypaint_utils_stroke_player_free(player);
+        mypaint_brush_unref(brush);
+        return NULL;
+    }
+    mypaint_brush_set_event_coalescing(brush, coalesce);
+
+    MyPaintFixedTiledSurface *surface = mypaint_fixed_tiled_surface_new(CANVAS_WIDTH, CANVAS_HEIGHT);
+    MyPaintTiledSurface *tiled = (MyPaintTiledSurface *)surface;
+    const int tile_size = tiled->tile_size;
+    // Start out transparent, the surface is not cleared on creation
+    for (int ty = 0; ty * tile_size < CANVAS_HEIGHT; ty++) {
+        for (int tx = 0; tx * tile_size < CANVAS_WIDTH; tx++) {
+            MyPaintTileRequest request;
+            mypaint_tile_request_init(&request, 0, tx, ty, FALSE);
+            mypaint_tiled_surface_tile_request_start(tiled, &request);
+            memset(request.buffer, 0, sizeof(uint16_t) * 4 * tile_size * tile_size);
+            mypaint_tiled_surface_tile_request_end(tiled, &request);
+        }
+    }
+    // Color sampling uses rand(), which must start over for each render
+    srand(0);
+    mypaint_utils_stroke_player_set_brush(player, brush);
+    mypaint_utils_stroke_player_set_surface(player, (MyPaintSurface *)surface);
+    mypaint_utils_stroke_player_run_sync(player);
+
+    // The last event may still be held back
+    mypaint_surface_begin_atomic((MyPaintSurface *)surface);
+    mypaint_brush_flush_events(brush);
+    mypaint_surface_end_atomic((MyPaintSurface *)surface, NULL);
+
+    uint16_t *pixels = (uint16_t *)malloc(sizeof(uint16_t) * 4 * CANVAS_WIDTH * CANVAS_HEIGHT);
+    for (int ty = 0; ty * tile_size < CANVAS_HEIGHT; ty++) {
+        for (int tx = 0; tx * tile_size < CANVAS_WIDTH; tx++) {
+            MyPaintTileRequest request;
+            mypaint_tile_request_init(&request, 0, tx, ty, TRUE);
+            mypaint_tiled_surface_tile_request_start(tiled, &request);
+            const int columns = CANVAS_WIDTH - tx * tile_size < tile_size
+                ? CANVAS_WIDTH - tx * tile_size : tile_size;
+            for (int y = 0; y < tile_size && ty * tile_size + y < CANVAS_HEIGHT; y++) {
+                memcpy(pixels + ((size_t)(ty * tile_size + y) * CANVAS_WIDTH + tx * tile_size) * 4,
+                       request.buffer + (size_t)y * tile_size * 4,
+                       sizeof(uint16_t) * 4 * columns);
+            }
+            mypaint_tiled_surface_tile_request_end(tiled, &request);
+        }
+    }
+
+    mypaint_surface_unref((MyPaintSurface *)surface);
+    mypaint_utils_stroke_player_free(player);
+    mypaint_brush_unref(brush);
+    return pixels;
+}
+
+int
+test_event_coalescing(void *user_data)
+{
+    int result = 1;
+    for (size_t b = 0; b < TEST_CASES_NUMBER(brushes); b++) {
+        const BrushTolerance *brush = &brushes[b];
+        uint16_t *expected = render(brush->name, FALSE);
+        uint16_t *actual = render(brush->name, TRUE);
+        if (!expected || !actual) {
+            free(expected);
+            free(actual);
+            result = 0;
+            continue;
+        }
+        const long channels = (long)CANVAS_WIDTH * CANVAS_HEIGHT * 4;
+        double total = 0.0;
+        for (long i = 0; i < channels; i++) {
+            total += abs(expected[i] - actual[i]);
+        }
+        const double mean = total / channels * 255.0 / (1 << 15);
+        if (mean > brush->max_mean_difference) {
+            fprintf(stderr, "%s: coalesced render differs by %.3f/255 on average, more than %.1f/255\n",
+                    brush->name, mean, brush->max_mean_difference);
+            result = 0;
+        }
+        free(expected);
+        free(actual);
+    }
+    return result;
+}
+
+int
+main(int argc, char **argv)
+{
+    TestCase test_cases[] = {
+        {"/brush/event_coalescing", test_event_coalescing, NULL},
+    };
+
+    return test_cases_run(argc, argv, test_cases, TEST_CASES_NUMBER(test_cases), TEST_CASE_NORMAL);
+}
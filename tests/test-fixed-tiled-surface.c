@@ -11,9 +11,16 @@ fixed_surface_factory(gpointer user_data)
     return (MyPaintSurface *)surface;
 }
 
+void
+fixed_surface_set_threads(MyPaintSurface *surface, int num_threads)
+{
+    mypaint_tiled_surface_set_num_threads((MyPaintTiledSurface *)surface, num_threads);
+}
+
 int
 main(int argc, char **argv)
 {
-    return mypaint_test_surface_run(argc, argv, fixed_surface_factory, "MyPaintFixedSurface", NULL);
+    return mypaint_test_surface_run_threaded(argc, argv, fixed_surface_factory, fixed_surface_set_threads,
+                                             "MyPaintFixedSurface", NULL);
 }
 
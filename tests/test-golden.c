@@ -0,0 +1,461 @@
+/* Golden image test: renders each test brush through the stroke player and
+ * compares the surface against the reference images in tests/golden with a
+ * per-pixel tolerance, or against stored checksums of the raw 15 bit pixels.
+ *
+ * Usage: test-golden [options] [BRUSH...]
+ *
+ *   --update               Store the images and checksums of this build as the golden ones,
+ *                          leaving the precise math images alone
+ *   --exact                Compare the checksums instead of the images, also enabled
+ *                          by setting MYPAINT_GOLDEN_EXACT=1 in the environment
+ *   --write-reference DIR  Save the rendered images to DIR
+ *   --reference-dir DIR    Compare against the images in DIR instead of tests/golden
+ *   --scale N              Pixels per side averaged into one reference pixel (default 4)
+ *   --tolerance N          Largest difference per channel, in 1/255 (default 2)
+ *   --max-pixels N         Number of pixels allowed to exceed the tolerance
+ *                          (default 0, except for brushes that amplify rounding)
+ *   --threads N            Number of tile threads of the surface (default: automatic)
+ *
+ * Reference images are 8 bit premultiplied RGBA PAM files, with each pixel the
+ * rounded mean of an N x N block of the surface, which keeps them small enough
+ * to store while still showing dabs that move or change.
+ *
+ * Checksums depend on the floating point behaviour of the compiler and libm,
+ * and are only meant to match on the platform that generated them, which is
+ * why they are opt-in. With them, any change to the pixels can be detected.
+ *
+ * Each brush is also rendered with mypaint_brush_set_precise_math() and
+ * compared against tests/golden/precise, which holds the output of the engine
+ * from before the fast math approximations were added. Those images are never
+ * updated; precise math must keep reproducing them.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "mypaint-brush.h"
+#include "mypaint-fixed-tiled-surface.h"
+#include "mypaint-utils-stroke-player.h"
+#include "testutils.h"
+
+#define SOURCE_PATH(path) LIBMYPAINT_TESTING_ABS_TOP_SRCDIR "/tests/" path
+
+#define GOLDEN_DIR SOURCE_PATH("golden")
+#define PRECISE_DIR SOURCE_PATH("golden/precise")
+#define CHECKSUMS_PATH SOURCE_PATH("golden/checksums.txt")
+#define EVENTS_PATH SOURCE_PATH("events/painting30sec.dat")
+
+// Large enough for all of the events
+#define CANVAS_WIDTH 1000
+#define CANVAS_HEIGHT 700
+
+#define DEFAULT_SCALE 4
+#define DEFAULT_TOLERANCE 2
+
+typedef struct {
+    gboolean update;
+    gboolean exact;
+    const char *write_reference_dir;
+    const char *reference_dir;
+    int scale;
+    int tolerance;
+    long max_pixels; // -1 for the default of each brush
+    int threads;
+} GoldenOptions;
+
+static GoldenOptions options = {FALSE, FALSE, NULL, GOLDEN_DIR, DEFAULT_SCALE, DEFAULT_TOLERANCE, -1, 0};
+
+typedef struct {
+    const char *name;
+    const char *precise_math_id; // test case rendering with precise math
+    // Pixels allowed to exceed the tolerance in the reference images, per 1000
+    int max_pixels_permille;
+    uint64_t checksum;
+} GoldenBrush;
+
+static GoldenBrush brushes[] = {
+    {"bulk", "bulk/precise_math", 0, 0},
+    {"charcoal", "charcoal/precise_math", 0, 0},
+    {"coarse_bulk_2", "coarse_bulk_2/precise_math", 0, 0},
+    // Smudging with tracking noise: a rounding difference in one dab moves the
+    // ones after it, so some areas differ a lot with other compiler flags
+    {"impressionism", "impressionism/precise_math", 50, 0},
+    {"modelling", "modelling/precise_math", 0, 0},
+};
+
+/* Render the events with the brush, returning the premultiplied
+ * fix15 RGBA pixels of the surface, row by row. */
+static uint16_t *
+render_brush(const char *name, gboolean precise_math)
+{
+    char brush_path[1024];
+    snprintf(brush_path, sizeof(brush_path), SOURCE_PATH("brushes/%s.myb"), name);
+    char *brush_data = read_file(brush_path);
+    if (!brush_data) {
+        return NULL;
+    }
+    MyPaintBrush *brush = mypaint_brush_new();
+    mypaint_brush_from_defaults(brush);
+    const gboolean loaded = mypaint_brush_from_string(brush, brush_data);
+    free(brush_data);
+
+    MyPaintUtilsStrokePlayer *player = mypaint_utils_stroke_player_new();
+    if (!loaded || !mypaint_utils_stroke_player_load_file(player, EVENTS_PATH)) {
+        fprintf(stderr, "Error: Unable to load '%s' or the events\n", brush_path);
+        mypaint_utils_stroke_player_free(player);
+        mypaint_brush_unref(brush);
+        return NULL;
+    }
+    mypaint_brush_set_precise_math(brush, precise_math);
+
+    MyPaintFixedTiledSurface *surface = mypaint_fixed_tiled_surface_new(CANVAS_WIDTH, CANVAS_HEIGHT);
+    MyPaintTiledSurface *tiled = (MyPaintTiledSurface *)surface;
+    mypaint_tiled_surface_set_num_threads(tiled, options.threads);
+    const int tile_size = tiled->tile_size;
+
+    // The surface starts out with all channels at 0xffff, out of the range of
+    // paint, which makes blending onto it amplify any rounding differences
+    for (int ty = 0; ty * tile_size < CANVAS_HEIGHT; ty++) {
+        for (int tx = 0; tx * tile_size < CANVAS_WIDTH; tx++) {
+            MyPaintTileRequest request;
+            mypaint_tile_request_init(&request, 0, tx, ty, FALSE);
+            mypaint_tiled_surface_tile_request_start(tiled, &request);
+            memset(request.buffer, 0, sizeof(uint16_t) * 4 * tile_size * tile_size);
+            mypaint_tiled_surface_tile_request_end(tiled, &request);
+        }
+    }
+
+    // Color sampling uses rand(), which must start over for each brush
+    srand(0);
+    mypaint_utils_stroke_player_set_brush(player, brush);
+    mypaint_utils_stroke_player_set_surface(player, mypaint_fixed_tiled_surface_interface(surface));
+    mypaint_utils_stroke_player_run_sync(player);
+
+    uint16_t *pixels = (uint16_t *)malloc(sizeof(uint16_t) * 4 * CANVAS_WIDTH * CANVAS_HEIGHT);
+    for (int ty = 0; ty * tile_size < CANVAS_HEIGHT; ty++) {
+        for (int tx = 0; tx * tile_size < CANVAS_WIDTH; tx++) {
+            MyPaintTileRequest request;
+            mypaint_tile_request_init(&request, 0, tx, ty, TRUE);
+            mypaint_tiled_surface_tile_request_start(tiled, &request);
+            for (int y = 0; y < tile_size && ty * tile_size + y < CANVAS_HEIGHT; y++) {
+                const int columns = CANVAS_WIDTH - tx * tile_size < tile_size
+                    ? CANVAS_WIDTH - tx * tile_size : tile_size;
+                memcpy(pixels + ((size_t)(ty * tile_size + y) * CANVAS_WIDTH + tx * tile_size) * 4,
+                       request.buffer + (size_t)y * tile_size * 4,
+                       sizeof(uint16_t) * 4 * columns);
+            }
+            mypaint_tiled_surface_tile_request_end(tiled, &request);
+        }
+    }
+
+    mypaint_surface_unref(mypaint_fixed_tiled_surface_interface(surface));
+    mypaint_utils_stroke_player_free(player);
+    mypaint_brush_unref(brush);
+    return pixels;
+}
+
+// FNV-1a over the little endian bytes of the channels
+static uint64_t
+pixels_checksum(const uint16_t *pixels, size_t n)
+{
+    uint64_t h = 14695981039346656037ULL;
+    for (size_t i = 0; i < n; i++) {
+        h = (h ^ (pixels[i] & 0xff)) * 1099511628211ULL;
+        h = (h ^ (pixels[i] >> 8)) * 1099511628211ULL;
+    }
+    return h;
+}
+
+static gboolean
+load_checksums(gboolean required)
+{
+    FILE *fp = fopen(CHECKSUMS_PATH, "r");
+    if (!fp) {
+        if (required) {
+            fprintf(stderr, "Error: Unable to open '%s'\n", CHECKSUMS_PATH);
+        }
+        return FALSE;
+    }
+    char line[256];
+    while (fgets(line, sizeof(line), fp)) {
+        char name[128];
+        unsigned long long checksum;
+        if (line[0] == '#' || sscanf(line, "%127s %llx", name, &checksum) != 2) {
+            continue;
+        }
+        for (size_t i = 0; i < TEST_CASES_NUMBER(brushes); i++) {
+            if (strcmp(brushes[i].name, name) == 0) {
+                brushes[i].checksum = checksum;
+            }
+        }
+    }
+    fclose(fp);
+    return TRUE;
+}
+
+static gboolean
+save_checksums(void)
+{
+    FILE *fp = fopen(CHECKSUMS_PATH, "w");
+    if (!fp) {
+        fprintf(stderr, "Error: Unable to open '%s' for writing\n", CHECKSUMS_PATH);
+        return FALSE;
+    }
+    fprintf(fp, "# FNV-1a of the fix15 RGBA pixels rendered by test-golden.\n"
+                "# Only compared with --exact or MYPAINT_GOLDEN_EXACT=1. Regenerate with: test-golden --update\n");
+    for (size_t i = 0; i < TEST_CASES_NUMBER(brushes); i++) {
+        fprintf(fp, "%s %016llx\n", brushes[i].name, (unsigned long long)brushes[i].checksum);
+    }
+    return fclose(fp) == 0;
+}
+
+static char *
+reference_path(const char *dir, const char *name)
+{
+    char *path = (char *)malloc(strlen(dir) + strlen(name) + 6);
+    sprintf(path, "%s/%s.pam", dir, name);
+    return path;
+}
+
+#define REFERENCE_WIDTH (CANVAS_WIDTH / options.scale)
+#define REFERENCE_HEIGHT (CANVAS_HEIGHT / options.scale)
+
+/* Average blocks of scale x scale pixels into 8 bit premultiplied RGBA */
+static unsigned char *
+downscale(const uint16_t *pixels)
+{
+    const int scale = options.scale;
+    unsigned char *image = (unsigned char *)malloc((size_t)REFERENCE_WIDTH * REFERENCE_HEIGHT * 4);
+    for (int y = 0; y < REFERENCE_HEIGHT; y++) {
+        for (int x = 0; x < REFERENCE_WIDTH; x++) {
+            for (int c = 0; c < 4; c++) {
+                uint64_t sum = 0;
+                for (int by = 0; by < scale; by++) {
+                    const uint16_t *row = pixels + ((size_t)(y * scale + by) * CANVAS_WIDTH + x * scale) * 4;
+                    for (int bx = 0; bx < scale; bx++) {
+                        sum += row[bx * 4 + c];
+                    }
+                }
+                const uint64_t divisor = (uint64_t)scale * scale << 15;
+                const uint64_t value = (sum * 255 + divisor / 2) / divisor;
+                image[((size_t)y * REFERENCE_WIDTH + x) * 4 + c] = (unsigned char)(value > 255 ? 255 : value);
+            }
+        }
+    }
+    return image;
+}
+
+static gboolean
+write_reference(const char *dir, const char *name, const unsigned char *image)
+{
+    char *path = reference_path(dir, name);
+    FILE *fp = fopen(path, "wb");
+    gboolean ok = (fp != NULL);
+    if (ok) {
+        fprintf(fp, "P7\nWIDTH %d\nHEIGHT %d\nDEPTH 4\nMAXVAL 255\nTUPLTYPE RGB_ALPHA\nENDHDR\n",
+                REFERENCE_WIDTH, REFERENCE_HEIGHT);
+        const size_t size = (size_t)REFERENCE_WIDTH * REFERENCE_HEIGHT * 4;
+        ok = fwrite(image, 1, size, fp) == size;
+        ok = (fclose(fp) == 0) && ok;
+    }
+    if (!ok) {
+        fprintf(stderr, "Error: Unable to write '%s'\n", path);
+    }
+    free(path);
+    return ok;
+}
+
+static unsigned char *
+read_reference(const char *dir, const char *name)
+{
+    char *path = reference_path(dir, name);
+    FILE *fp = fopen(path, "rb");
+    if (!fp) {
+        fprintf(stderr, "Error: Unable to open '%s'\n", path);
+        free(path);
+        return NULL;
+    }
+    int width = 0, height = 0;
+    const gboolean header_ok =
+        fscanf(fp, "P7 WIDTH %d HEIGHT %d DEPTH 4 MAXVAL 255 TUPLTYPE RGB_ALPHA ENDHDR", &width, &height) == 2 &&
+        fgetc(fp) == '\n' && width == REFERENCE_WIDTH && height == REFERENCE_HEIGHT;
+
+    const size_t size = (size_t)REFERENCE_WIDTH * REFERENCE_HEIGHT * 4;
+    unsigned char *image = header_ok ? (unsigned char *)malloc(size) : NULL;
+    if (image && fread(image, 1, size, fp) != size) {
+        free(image);
+        image = NULL;
+    }
+    fclose(fp);
+    if (!image) {
+        fprintf(stderr, "Error: '%s' is not a %dx%d reference image\n", path, REFERENCE_WIDTH, REFERENCE_HEIGHT);
+    }
+    free(path);
+    return image;
+}
+
+static int
+compare_reference(const char *dir, const GoldenBrush *brush, const unsigned char *image)
+{
+    unsigned char *reference = read_reference(dir, brush->name);
+    if (!reference) {
+        return 0;
+    }
+    const long pixels_n = (long)REFERENCE_WIDTH * REFERENCE_HEIGHT;
+    long differing = 0;
+    int max_difference = 0;
+    for (long i = 0; i < pixels_n; i++) {
+        gboolean differs = FALSE;
+        for (int c = 0; c < 4; c++) {
+            const int difference = abs((int)image[i*4+c] - (int)reference[i*4+c]);
+            if (difference > max_difference) max_difference = difference;
+            differs |= difference > options.tolerance;
+        }
+        differing += differs;
+    }
+    free(reference);
+
+    const long max_pixels = options.max_pixels >= 0
+        ? options.max_pixels : pixels_n * brush->max_pixels_permille / 1000;
+    if (differing > max_pixels) {
+        fprintf(stderr, "%s: %ld pixels differ by more than %d/255 (%ld allowed), the largest difference is %d\n",
+                brush->name, differing, options.tolerance, max_pixels, max_difference);
+        return 0;
+    }
+    return 1;
+}
+
+static int
+test_golden_brush(void *user_data)
+{
+    GoldenBrush *brush = (GoldenBrush *)user_data;
+    uint16_t *pixels = render_brush(brush->name, FALSE);
+    if (!pixels) {
+        return 0;
+    }
+
+    int result = 1;
+    unsigned char *image = downscale(pixels);
+    const uint64_t checksum = pixels_checksum(pixels, (size_t)CANVAS_WIDTH * CANVAS_HEIGHT * 4);
+    free(pixels);
+
+    if (options.write_reference_dir && !write_reference(options.write_reference_dir, brush->name, image)) {
+        result = 0;
+    }
+    if (options.update) {
+        brush->checksum = checksum;
+        result &= write_reference(GOLDEN_DIR, brush->name, image);
+    } else if (options.exact) {
+        if (checksum != brush->checksum) {
+            fprintf(stderr, "%s: checksum %016llx, expected %016llx\n", brush->name,
+                    (unsigned long long)checksum, (unsigned long long)brush->checksum);
+            result = 0;
+        }
+    } else {
+        result &= compare_reference(options.reference_dir, brush, image);
+    }
+    free(image);
+    return result;
+}
+
+static int
+test_precise_math(void *user_data)
+{
+    GoldenBrush *brush = (GoldenBrush *)user_data;
+    uint16_t *pixels = render_brush(brush->name, TRUE);
+    if (!pixels) {
+        return 0;
+    }
+    unsigned char *image = downscale(pixels);
+    free(pixels);
+    const int result = compare_reference(PRECISE_DIR, brush, image);
+    free(image);
+    return result;
+}
+
+static void
+add_test_cases(TestCase *test_cases, int *test_cases_n, GoldenBrush *brush)
+{
+    TestCase test_case = {(char *)brush->name, test_golden_brush, brush};
+    test_cases[(*test_cases_n)++] = test_case;
+    // The precise math images are only stored at the default scale
+    if (!options.update && options.scale == DEFAULT_SCALE) {
+        TestCase precise_case = {(char *)brush->precise_math_id, test_precise_math, brush};
+        test_cases[(*test_cases_n)++] = precise_case;
+    }
+}
+
+int
+main(int argc, char **argv)
+{
+    TestCase test_cases[2 * TEST_CASES_NUMBER(brushes)];
+    int test_cases_n = 0;
+    gboolean run_brush[TEST_CASES_NUMBER(brushes)] = {FALSE};
+    gboolean selected = FALSE;
+    const char *exact = getenv("MYPAINT_GOLDEN_EXACT");
+    options.exact = exact && strcmp(exact, "") != 0 && strcmp(exact, "0") != 0;
+
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        const char *value = (i + 1 < argc) ? argv[i + 1] : NULL;
+        gboolean valid = TRUE;
+        if (strcmp(arg, "--update") == 0) {
+            options.update = TRUE;
+            continue;
+        } else if (strcmp(arg, "--exact") == 0) {
+            options.exact = TRUE;
+            continue;
+        } else if (strcmp(arg, "--write-reference") == 0) {
+            options.write_reference_dir = value;
+        } else if (strcmp(arg, "--reference-dir") == 0) {
+            options.reference_dir = value;
+        } else if (strcmp(arg, "--scale") == 0) {
+            valid = value && sscanf(value, "%d", &options.scale) == 1 && options.scale >= 1
+                    && options.scale <= CANVAS_HEIGHT;
+        } else if (strcmp(arg, "--tolerance") == 0) {
+            valid = value && sscanf(value, "%d", &options.tolerance) == 1 && options.tolerance >= 0;
+        } else if (strcmp(arg, "--max-pixels") == 0) {
+            valid = value && sscanf(value, "%ld", &options.max_pixels) == 1 && options.max_pixels >= 0;
+        } else if (strcmp(arg, "--threads") == 0) {
+            valid = value && sscanf(value, "%d", &options.threads) == 1 && options.threads >= 0;
+        } else if (arg[0] != '-') {
+            // Only run the named brushes
+            for (size_t b = 0; b < TEST_CASES_NUMBER(brushes); b++) {
+                run_brush[b] |= strcmp(brushes[b].name, arg) == 0;
+            }
+            selected = TRUE;
+            continue;
+        } else {
+            valid = FALSE;
+        }
+        if (!valid || !value) {
+            fprintf(stderr, "Error: Invalid argument '%s'\n", arg);
+            return 1;
+        }
+        i++;
+    }
+
+    for (size_t b = 0; b < TEST_CASES_NUMBER(brushes); b++) {
+        if (run_brush[b] || !selected) {
+            add_test_cases(test_cases, &test_cases_n, &brushes[b]);
+        }
+    }
+    if (options.update && options.scale != DEFAULT_SCALE) {
+        fprintf(stderr, "Error: The golden images use a scale of %d\n", DEFAULT_SCALE);
+        return 1;
+    }
+    // When updating, the brushes that are not run keep their checksums
+    const gboolean required = options.exact && !options.update;
+    if (!load_checksums(required) && required) {
+        return 1;
+    }
+
+    const int result = test_cases_run(argc, argv, test_cases, test_cases_n, TEST_CASE_NORMAL);
+
+    if (options.update && !save_checksums()) {
+        return 1;
+    }
+    return result;
+}
@@ -0,0 +1,477 @@
+/* Renders the recorded events with each test brush in the different processing
+ * modes of MyPaintTiledSurface, and checks that the surfaces are identical to
+ * the ones from processing all tiles in end_atomic on the painting thread.
+ *
+ * Every event is painted in its own transaction, like an application would.
+ * Concurrent painting is checked with two threads painting disjoint regions,
+ * against painting the same regions one after the other.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
+#include "mypaint-brush.h"
+#include "mypaint-fixed-tiled-surface.h"
+#include "mypaint-utils-stroke-player.h"
+#include "testutils.h"
+
+#define SOURCE_PATH(path) LIBMYPAINT_TESTING_ABS_TOP_SRCDIR "/tests/" path
+
+#define EVENTS_PATH SOURCE_PATH("events/painting30sec.dat")
+
+// Large enough for all of the events
+#define CANVAS_WIDTH 1000
+#define CANVAS_HEIGHT 700
+
+#define PIXELS_SIZE (sizeof(uint16_t) * 4 * CANVAS_WIDTH * CANVAS_HEIGHT)
+
+// Threads used in all modes, so that the thread pools get exercised on any machine
+#define NUM_THREADS 3
+
+typedef struct {
+    const char *name;
+    // Configure a new surface, returning FALSE if the mode is unavailable
+    gboolean (*setup)(MyPaintTiledSurface *surface);
+    // End the transaction of an event
+    void (*end_event)(MyPaintTiledSurface *surface);
+    // Called once after the last event, returning FALSE on failure
+    gboolean (*finish)(MyPaintTiledSurface *surface);
+} SurfaceMode;
+
+static const char *brush_names[] = {
+    "bulk",
+    "charcoal",
+    "coarse_bulk_2",
+    "impressionism",
+    "modelling",
+};
+
+// Output of the reference mode for each brush, rendered when first needed
+static uint16_t *references[TEST_CASES_NUMBER(brush_names)];
+
+static gboolean
+setup_sync(MyPaintTiledSurface *surface)
+{
+    return TRUE;
+}
+
+static void
+end_event_default(MyPaintTiledSurface *surface)
+{
+    mypaint_surface_end_atomic((MyPaintSurface *)surface, NULL);
+}
+
+static const SurfaceMode sync_mode = {"sync", setup_sync, end_event_default, NULL};
+
+static void
+read_pixels(MyPaintTiledSurface *tiled, uint16_t *pixels)
+{
+    const int tile_size = tiled->tile_size;
+    for (int ty = 0; ty * tile_size < CANVAS_HEIGHT; ty++) {
+        for (int tx = 0; tx * tile_size < CANVAS_WIDTH; tx++) {
+            MyPaintTileRequest request;
+            mypaint_tile_request_init(&request, 0, tx, ty, TRUE);
+            mypaint_tiled_surface_tile_request_start(tiled, &request);
+            const int columns = CANVAS_WIDTH - tx * tile_size < tile_size
+                ? CANVAS_WIDTH - tx * tile_size : tile_size;
+            for (int y = 0; y < tile_size && ty * tile_size + y < CANVAS_HEIGHT; y++) {
+                memcpy(pixels + ((size_t)(ty * tile_size + y) * CANVAS_WIDTH + tx * tile_size) * 4,
+                       request.buffer + (size_t)y * tile_size * 4,
+                       sizeof(uint16_t) * 4 * columns);
+            }
+            mypaint_tiled_surface_tile_request_end(tiled, &request);
+        }
+    }
+}
+
+static MyPaintBrush *
+load_brush(const char *name)
+{
+    char path[1024];
+    snprintf(path, sizeof(path), SOURCE_PATH("brushes/%s.myb"), name);
+    char *data = read_file(path);
+    if (!data) {
+        return NULL;
+    }
+    MyPaintBrush *brush = mypaint_brush_new();
+    mypaint_brush_from_defaults(brush);
+    const gboolean loaded = mypaint_brush_from_string(brush, data);
+    free(data);
+    if (!loaded) {
+        fprintf(stderr, "Error: Unable to load '%s'\n", path);
+        mypaint_brush_unref(brush);
+        return NULL;
+    }
+    return brush;
+}
+
+/* Paint the events with the brush in @mode, returning the premultiplied
+ * fix15 RGBA pixels of the surface, row by row. Sets @available to FALSE
+ * and returns NULL if the mode cannot be used in this build. */
+static uint16_t *
+render(const char *brush_name, const SurfaceMode *mode, gboolean *available)
+{
+    *available = TRUE;
+    MyPaintBrush *brush = load_brush(brush_name);
+    MyPaintUtilsStrokePlayer *player = mypaint_utils_stroke_player_new();
+    if (!brush || !mypaint_utils_stroke_player_load_file(player, EVENTS_PATH)) {
+        mypaint_utils_stroke_player_free(player);
+        if (brush) {
+            mypaint_brush_unref(brush);
+        }
+        return NULL;
+    }
+
+    MyPaintFixedTiledSurface *surface = mypaint_fixed_tiled_surface_new(CANVAS_WIDTH, CANVAS_HEIGHT);
+    MyPaintTiledSurface *tiled = (MyPaintTiledSurface *)surface;
+    mypaint_tiled_surface_set_num_threads(tiled, NUM_THREADS);
+    uint16_t *pixels = NULL;
+
+    if (mode->setup(tiled)) {
+        // Color sampling uses rand(), which must start over for each render
+        srand(0);
+        // The player only calls stroke_to, the transactions are done here
+        mypaint_utils_stroke_player_set_transactions_on_stroke_to(player, FALSE);
+        mypaint_utils_stroke_player_set_brush(player, brush);
+        mypaint_utils_stroke_player_set_surface(player, (MyPaintSurface *)surface);
+        gboolean more = TRUE;
+        while (more) {
+            mypaint_surface_begin_atomic((MyPaintSurface *)surface);
+            more = mypaint_utils_stroke_player_iterate(player);
+            mode->end_event(tiled);
+        }
+        if (!mode->finish || mode->finish(tiled)) {
+            pixels = (uint16_t *)malloc(PIXELS_SIZE);
+            read_pixels(tiled, pixels);
+        }
+    } else {
+        *available = FALSE;
+    }
+
+    mypaint_surface_unref((MyPaintSurface *)surface);
+    mypaint_utils_stroke_player_free(player);
+    mypaint_brush_unref(brush);
+    return pixels;
+}
+
+static int
+compare_pixels(const char *brush_name, const char *mode_name,
+               const uint16_t *expected, const uint16_t *actual)
+{
+    long differing = 0;
+    for (long i = 0; i < (long)CANVAS_WIDTH * CANVAS_HEIGHT; i++) {
+        if (memcmp(expected + i * 4, actual + i * 4, sizeof(uint16_t) * 4) != 0) {
+            if (differing == 0) {
+                fprintf(stderr, "%s, %s: first difference at %ld,%ld\n", brush_name, mode_name,
+                        i % CANVAS_WIDTH, i / CANVAS_WIDTH);
+            }
+            differing++;
+        }
+    }
+    if (differing) {
+        fprintf(stderr, "%s, %s: %ld pixels differ from the sync rendering\n",
+                brush_name, mode_name, differing);
+    }
+    return differing == 0;
+}
+
+/* Render every brush in @mode and compare against the sync mode */
+static int
+test_mode(const SurfaceMode *mode)
+{
+    int result = 1;
+    for (size_t b = 0; b < TEST_CASES_NUMBER(brush_names); b++) {
+        gboolean available;
+        if (!references[b]) {
+            references[b] = render(brush_names[b], &sync_mode, &available);
+            if (!references[b]) {
+                return 0;
+            }
+        }
+        uint16_t *pixels = render(brush_names[b], mode, &available);
+        if (!available) {
+            fprintf(stderr, "%s mode is not available in this build, skipped\n", mode->name);
+            return 1;
+        }
+        if (!pixels) {
+            fprintf(stderr, "%s, %s: rendering failed\n", brush_names[b], mode->name);
+            result = 0;
+            continue;
+        }
+        result &= compare_pixels(brush_names[b], mode->name, references[b], pixels);
+        free(pixels);
+    }
+    return result;
+}
+
+static gboolean
+setup_async(MyPaintTiledSurface *surface)
+{
+    return mypaint_tiled_surface_set_async(surface, TRUE);
+}
+
+static const SurfaceMode async_mode = {"async", setup_async, end_event_default, NULL};
+
+static int
+test_async(void *user_data)
+{
+    return test_mode(&async_mode);
+}
+
+// Process a single tile per transaction, leaving the rest for later ones
+static void
+end_event_budgeted(MyPaintTiledSurface *surface)
+{
+    mypaint_tiled_surface_end_atomic_budgeted(surface, NULL, NULL, 0.0, 1);
+}
+
+// Upper bound for the calls needed to drain the tiles left over by the events
+#define MAX_DRAIN_CALLS 100000
+
+static gboolean
+finish_budgeted(MyPaintTiledSurface *surface)
+{
+    int remaining = 1;
+    int calls = 0;
+    while (remaining > 0 && calls < MAX_DRAIN_CALLS) {
+        mypaint_surface_begin_atomic((MyPaintSurface *)surface);
+        remaining = mypaint_tiled_surface_end_atomic_budgeted(surface, NULL, NULL, 0.0, 1);
+        calls++;
+    }
+    if (remaining > 0) {
+        fprintf(stderr, "budgeted: %d tiles still queued after %d calls\n", remaining, calls);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+static const SurfaceMode budgeted_mode = {"budgeted", setup_sync, end_event_budgeted, finish_budgeted};
+
+static int
+test_budgeted(void *user_data)
+{
+    return test_mode(&budgeted_mode);
+}
+
+/* With a limit of one byte, every batch of dabs from the brush goes
+ * over it, so the tiles are flushed while the transaction is running */
+static gboolean
+setup_capped(MyPaintTiledSurface *surface)
+{
+    mypaint_tiled_surface_set_max_queue_bytes(surface, 1);
+    return TRUE;
+}
+
+static gboolean
+setup_capped_async(MyPaintTiledSurface *surface)
+{
+    mypaint_tiled_surface_set_max_queue_bytes(surface, 1);
+    return mypaint_tiled_surface_set_async(surface, TRUE);
+}
+
+static const SurfaceMode capped_mode = {"max_queue_bytes", setup_capped, end_event_default, NULL};
+static const SurfaceMode capped_async_mode = {"async max_queue_bytes", setup_capped_async, end_event_default, NULL};
+
+static int
+test_max_queue_bytes(void *user_data)
+{
+    return test_mode(&capped_mode) & test_mode(&capped_async_mode);
+}
+
+/* Concurrent painting: each painter strokes its own half of the canvas with its
+ * own brush, in transactions of its own, and records the area reported to it. */
+
+#define PAINTER_EVENTS 400
+#define PAINTER_MARGIN 50
+
+#ifdef HAVE_PTHREAD
+/* Keeps the painters in step, so that both have queued their dabs before
+ * either ends its transaction, whatever the number of cores */
+typedef struct {
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    int waiting;
+    int generation;
+} Barrier;
+
+static void
+barrier_wait(Barrier *barrier)
+{
+    pthread_mutex_lock(&barrier->mutex);
+    const int generation = barrier->generation;
+    if (++barrier->waiting == 2) {
+        barrier->waiting = 0;
+        barrier->generation++;
+        pthread_cond_broadcast(&barrier->cond);
+    } else {
+        while (generation == barrier->generation) {
+            pthread_cond_wait(&barrier->cond, &barrier->mutex);
+        }
+    }
+    pthread_mutex_unlock(&barrier->mutex);
+}
+#endif
+
+typedef struct {
+    MyPaintBrush *brush;
+    MyPaintSurface *surface;
+    int x0; // left edge of the region painted
+    MyPaintRectangle reported;
+#ifdef HAVE_PTHREAD
+    Barrier *barrier; // NULL when painting sequentially
+#endif
+} Painter;
+
+static void *
+paint_region(void *user_data)
+{
+    Painter *painter = (Painter *)user_data;
+    const int width = CANVAS_WIDTH / 2 - 2 * PAINTER_MARGIN;
+    const int height = CANVAS_HEIGHT - 2 * PAINTER_MARGIN;
+    for (int i = 0; i < PAINTER_EVENTS; i++) {
+        const float x = painter->x0 + PAINTER_MARGIN + (i * 37) % width;
+        const float y = PAINTER_MARGIN + (i * 53) % height;
+        const float pressure = 0.3f + 0.5f * (i % 7) / 6.0f;
+        MyPaintRectangle rect;
+        MyPaintRectangles roi = {1, &rect};
+        mypaint_surface_begin_atomic(painter->surface);
+        mypaint_brush_stroke_to(painter->brush, painter->surface, x, y, pressure,
+                                0.0, 0.0, 0.02, 1.0, 0.0, 0.0, FALSE);
+#ifdef HAVE_PTHREAD
+        if (painter->barrier) {
+            barrier_wait(painter->barrier);
+        }
+#endif
+        mypaint_surface_end_atomic(painter->surface, &roi);
+        if (roi.num_rectangles > 0 && rect.width > 0) {
+            mypaint_rectangle_expand_to_include_rect(&painter->reported, &rect);
+        }
+    }
+    return NULL;
+}
+
+/* Paint both halves, one after the other or at the same time */
+static uint16_t *
+render_painters(Painter *painters, gboolean concurrent)
+{
+    MyPaintFixedTiledSurface *surface = mypaint_fixed_tiled_surface_new(CANVAS_WIDTH, CANVAS_HEIGHT);
+    MyPaintTiledSurface *tiled = (MyPaintTiledSurface *)surface;
+    mypaint_tiled_surface_set_num_threads(tiled, NUM_THREADS);
+    uint16_t *pixels = NULL;
+
+    // Charcoal does not smudge, so no rand() based color sampling is shared between threads
+    for (int p = 0; p < 2; p++) {
+        painters[p].brush = load_brush("charcoal");
+        painters[p].surface = (MyPaintSurface *)surface;
+        painters[p].x0 = p * CANVAS_WIDTH / 2;
+        memset(&painters[p].reported, 0, sizeof(MyPaintRectangle));
+#ifdef HAVE_PTHREAD
+        painters[p].barrier = NULL;
+#endif
+    }
+    if (painters[0].brush && painters[1].brush) {
+#ifdef HAVE_PTHREAD
+        if (concurrent) {
+            pthread_t threads[2];
+            Barrier barrier;
+            pthread_mutex_init(&barrier.mutex, NULL);
+            pthread_cond_init(&barrier.cond, NULL);
+            barrier.waiting = 0;
+            barrier.generation = 0;
+            mypaint_tiled_surface_set_concurrent_painting(tiled, TRUE);
+            for (int p = 0; p < 2; p++) {
+                painters[p].barrier = &barrier;
+                pthread_create(&threads[p], NULL, paint_region, &painters[p]);
+            }
+            for (int p = 0; p < 2; p++) {
+                pthread_join(threads[p], NULL);
+            }
+            pthread_mutex_destroy(&barrier.mutex);
+            pthread_cond_destroy(&barrier.cond);
+        } else
+#endif
+        {
+            paint_region(&painters[0]);
+            paint_region(&painters[1]);
+        }
+        pixels = (uint16_t *)malloc(PIXELS_SIZE);
+        read_pixels(tiled, pixels);
+    }
+
+    for (int p = 0; p < 2; p++) {
+        if (painters[p].brush) {
+            mypaint_brush_unref(painters[p].brush);
+        }
+    }
+    mypaint_surface_unref((MyPaintSurface *)surface);
+    return pixels;
+}
+
+/* Every pixel the painter changed must be in an area reported to it,
+ * even when the other painter ended a transaction in the meantime */
+static int
+check_reported(const Painter *painter, const uint16_t *pixels)
+{
+    const MyPaintRectangle *r = &painter->reported;
+    long missed = 0;
+    for (int y = 0; y < CANVAS_HEIGHT; y++) {
+        for (int x = painter->x0; x < painter->x0 + CANVAS_WIDTH / 2; x++) {
+            // The surface starts out with all channels at 0xffff
+            const gboolean painted = pixels[((size_t)y * CANVAS_WIDTH + x) * 4 + 3] != 0xffff;
+            const gboolean inside = x >= r->x && x < r->x + r->width && y >= r->y && y < r->y + r->height;
+            if (painted && !inside) {
+                missed++;
+            }
+        }
+    }
+    if (missed) {
+        fprintf(stderr, "concurrent painting: %ld painted pixels outside of the area "
+                "reported to the painter at %d\n", missed, painter->x0);
+    }
+    return missed == 0;
+}
+
+static int
+test_concurrent_painting(void *user_data)
+{
+#ifndef HAVE_PTHREAD
+    fprintf(stderr, "concurrent painting is not available in this build, skipped\n");
+    return 1;
+#endif
+    Painter painters[2];
+    uint16_t *expected = render_painters(painters, FALSE);
+    uint16_t *actual = render_painters(painters, TRUE);
+    int result = expected && actual;
+    if (result) {
+        result = compare_pixels("charcoal", "concurrent painting", expected, actual);
+        result &= check_reported(&painters[0], actual);
+        result &= check_reported(&painters[1], actual);
+    }
+    free(expected);
+    free(actual);
+    return result;
+}
+
+int
+main(int argc, char **argv)
+{
+    TestCase test_cases[] = {
+        {"/tiled_surface/async", test_async, NULL},
+        {"/tiled_surface/end_atomic_budgeted", test_budgeted, NULL},
+        {"/tiled_surface/max_queue_bytes", test_max_queue_bytes, NULL},
+        {"/tiled_surface/concurrent_painting", test_concurrent_painting, NULL},
+    };
+
+    const int result = test_cases_run(argc, argv, test_cases, TEST_CASES_NUMBER(test_cases), TEST_CASE_NORMAL);
+    for (size_t b = 0; b < TEST_CASES_NUMBER(brush_names); b++) {
+        free(references[b]);
+    }
+    return result;
+}
@@ -24,8 +24,9 @@ read_file(const char *path)
     file_size = ftell(file);
     rewind(file);
 
-    char *buffer = (char *)malloc(sizeof(char)*file_size);
+    char *buffer = (char *)malloc(sizeof(char)*(file_size + 1));
     size_t result = fread(buffer, 1, file_size, file);
+    buffer[result] = '\0';
 
     fclose(file);
 
@@ -1,9 +1,10 @@
 
 
-void render_dab_mask (uint16_t * mask,
+int render_dab_mask (uint16_t * mask,
                         float x, float y,
                         float radius,
                         float hardness,
                         float softness,
-                        float aspect_ratio, float angle
+                        float aspect_ratio, float angle,
+                        int tile_origin_x, int tile_origin_y
                         );
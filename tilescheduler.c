@@ -0,0 +1,522 @@
+/* libmypaint - The MyPaint Brush Library
+ * Copyright (C) 2026 The MyPaint Team
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <assert.h>
+
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+#include "mypaint-config.h"
+#include "tilescheduler.h"
+#include "helpers.h"
+
+typedef struct {
+    TileIndex index;
+    int cost;
+} TileJob;
+
+/* Jobs owned by one worker. The owner takes jobs from the head (heaviest),
+ * other workers steal from the tail (lightest). */
+typedef struct {
+    struct TileScheduler *scheduler;
+    int id;
+    TileJob *jobs;
+    int head;
+    int tail;
+#ifdef HAVE_PTHREAD
+    pthread_mutex_t lock;
+#endif
+} WorkerDeque;
+
+struct TileScheduler {
+    int num_threads;
+    TileJob *jobs;
+    int jobs_allocated;
+    WorkerDeque deques[MYPAINT_MAX_THREADS];
+
+    TileSchedulerFunc func;
+    void *user_data;
+
+    // Background processing, see tile_scheduler_push()
+    TileSchedulerFunc background_func;
+    void *background_data;
+    TileIndex *pending; // ring buffer
+    int pending_allocated;
+    int pending_first;
+    int pending_n;
+    int background_busy;
+
+#ifdef HAVE_PTHREAD
+    pthread_t threads[MYPAINT_MAX_THREADS];
+    pthread_mutex_t lock;
+    pthread_cond_t start_cond;
+    pthread_cond_t done_cond;
+    pthread_cond_t idle_cond;
+    unsigned int generation;
+    int workers_busy;
+    gboolean quit;
+#endif
+};
+
+#ifdef HAVE_PTHREAD
+static pthread_key_t worker_id_key;
+static pthread_once_t worker_id_key_once = PTHREAD_ONCE_INIT;
+
+static void
+create_worker_id_key(void)
+{
+    pthread_key_create(&worker_id_key, NULL);
+}
+
+static void
+set_worker_id(int id)
+{
+    pthread_once(&worker_id_key_once, create_worker_id_key);
+    // Store id+1 so that "unset" (NULL) maps to -1
+    pthread_setspecific(worker_id_key, (void *)(intptr_t)(id + 1));
+}
+
+int
+tile_scheduler_get_worker_id(void)
+{
+    pthread_once(&worker_id_key_once, create_worker_id_key);
+    return (int)(intptr_t)pthread_getspecific(worker_id_key) - 1;
+}
+#else // not HAVE_PTHREAD
+static int serial_worker_id = -1;
+
+static void
+set_worker_id(int id)
+{
+    serial_worker_id = id;
+}
+
+int
+tile_scheduler_get_worker_id(void)
+{
+    return serial_worker_id;
+}
+#endif // HAVE_PTHREAD
+
+int
+tile_scheduler_default_num_threads(void)
+{
+    long num = 1;
+#if defined(HAVE_PTHREAD) && defined(_SC_NPROCESSORS_ONLN)
+    num = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+    if (num < 1) num = 1;
+    if (num > MYPAINT_MAX_THREADS) num = MYPAINT_MAX_THREADS;
+    return (int)num;
+}
+
+static gboolean
+take_job(TileScheduler *self, int worker, TileJob *job_out)
+{
+    gboolean found = FALSE;
+    WorkerDeque *own = &self->deques[worker];
+
+#ifdef HAVE_PTHREAD
+    pthread_mutex_lock(&own->lock);
+#endif
+    if (own->head < own->tail) {
+        *job_out = own->jobs[own->head++];
+        found = TRUE;
+    }
+#ifdef HAVE_PTHREAD
+    pthread_mutex_unlock(&own->lock);
+#endif
+
+    // Steal from the other workers, starting with the next one over
+    for (int i = 1; !found && i < self->num_threads; i++) {
+        WorkerDeque *victim = &self->deques[(worker + i) % self->num_threads];
+#ifdef HAVE_PTHREAD
+        pthread_mutex_lock(&victim->lock);
+#endif
+        if (victim->head < victim->tail) {
+            *job_out = victim->jobs[--victim->tail];
+            found = TRUE;
+        }
+#ifdef HAVE_PTHREAD
+        pthread_mutex_unlock(&victim->lock);
+#endif
+    }
+    return found;
+}
+
+static void
+work_loop(TileScheduler *self, int worker)
+{
+    TileJob job;
+    while (take_job(self, worker, &job)) {
+        self->func(self->user_data, job.index);
+    }
+}
+
+/* Take the oldest pushed tile, if any. Must be called with the lock held. */
+static gboolean
+take_pending(TileScheduler *self, TileIndex *index_out)
+{
+    if (self->pending_n == 0) {
+        return FALSE;
+    }
+    *index_out = self->pending[self->pending_first];
+    self->pending_first = (self->pending_first + 1) % self->pending_allocated;
+    self->pending_n--;
+    self->background_busy++;
+    return TRUE;
+}
+
+static inline void
+lock_scheduler(TileScheduler *self)
+{
+#ifdef HAVE_PTHREAD
+    pthread_mutex_lock(&self->lock);
+#endif
+}
+
+static inline void
+unlock_scheduler(TileScheduler *self)
+{
+#ifdef HAVE_PTHREAD
+    pthread_mutex_unlock(&self->lock);
+#endif
+}
+
+/* Process one pushed tile. Called and returns with the lock held. */
+static void
+process_pending(TileScheduler *self, TileIndex index)
+{
+    unlock_scheduler(self);
+    self->background_func(self->background_data, index);
+    lock_scheduler(self);
+
+    if (--self->background_busy == 0 && self->pending_n == 0) {
+#ifdef HAVE_PTHREAD
+        pthread_cond_broadcast(&self->idle_cond);
+#endif
+    }
+}
+
+#ifdef HAVE_PTHREAD
+static void *
+worker_main(void *data)
+{
+    WorkerDeque *deque = (WorkerDeque *)data;
+    TileScheduler *self = deque->scheduler;
+    unsigned int seen_generation = 0;
+    TileIndex index;
+
+    set_worker_id(deque->id);
+
+    pthread_mutex_lock(&self->lock);
+    while (TRUE) {
+        while (!self->quit && self->generation == seen_generation && self->pending_n == 0) {
+            pthread_cond_wait(&self->start_cond, &self->lock);
+        }
+        if (self->quit) {
+            break;
+        }
+        if (self->generation != seen_generation) {
+            seen_generation = self->generation;
+            pthread_mutex_unlock(&self->lock);
+
+            work_loop(self, deque->id);
+
+            pthread_mutex_lock(&self->lock);
+            if (--self->workers_busy == 0) {
+                pthread_cond_signal(&self->done_cond);
+            }
+        } else if (take_pending(self, &index)) {
+            process_pending(self, index);
+        }
+    }
+    pthread_mutex_unlock(&self->lock);
+    return NULL;
+}
+#endif // HAVE_PTHREAD
+
+TileScheduler *
+tile_scheduler_new(int num_threads)
+{
+    TileScheduler *self = (TileScheduler *)malloc(sizeof(TileScheduler));
+    if (!self) {
+        return NULL;
+    }
+
+    if (num_threads <= 0) {
+        num_threads = tile_scheduler_default_num_threads();
+    }
+#ifdef HAVE_PTHREAD
+    if (num_threads > MYPAINT_MAX_THREADS) num_threads = MYPAINT_MAX_THREADS;
+#else
+    num_threads = 1;
+#endif
+
+    self->num_threads = 1;
+    self->jobs = NULL;
+    self->jobs_allocated = 0;
+    self->func = NULL;
+    self->user_data = NULL;
+
+    self->background_func = NULL;
+    self->background_data = NULL;
+    self->pending = NULL;
+    self->pending_allocated = 0;
+    self->pending_first = 0;
+    self->pending_n = 0;
+    self->background_busy = 0;
+
+    for (int i = 0; i < MYPAINT_MAX_THREADS; i++) {
+        WorkerDeque *deque = &self->deques[i];
+        deque->scheduler = self;
+        deque->id = i;
+        deque->jobs = NULL;
+        deque->head = deque->tail = 0;
+#ifdef HAVE_PTHREAD
+        pthread_mutex_init(&deque->lock, NULL);
+#endif
+    }
+
+#ifdef HAVE_PTHREAD
+    pthread_mutex_init(&self->lock, NULL);
+    pthread_cond_init(&self->start_cond, NULL);
+    pthread_cond_init(&self->done_cond, NULL);
+    pthread_cond_init(&self->idle_cond, NULL);
+    self->generation = 0;
+    self->workers_busy = 0;
+    self->quit = FALSE;
+
+    // Worker 0 is whichever thread calls tile_scheduler_run()
+    for (int i = 1; i < num_threads; i++) {
+        if (pthread_create(&self->threads[i], NULL, worker_main, &self->deques[i]) != 0) {
+            fprintf(stderr, "Warning: Unable to start tile worker thread, using %d threads\n", i);
+            break;
+        }
+        self->num_threads = i + 1;
+    }
+#endif
+
+    return self;
+}
+
+void
+tile_scheduler_free(TileScheduler *self)
+{
+    if (!self) {
+        return;
+    }
+    // Do not leave pushed tiles behind
+    tile_scheduler_wait(self);
+
+#ifdef HAVE_PTHREAD
+    pthread_mutex_lock(&self->lock);
+    self->quit = TRUE;
+    pthread_cond_broadcast(&self->start_cond);
+    pthread_mutex_unlock(&self->lock);
+
+    for (int i = 1; i < self->num_threads; i++) {
+        pthread_join(self->threads[i], NULL);
+    }
+    for (int i = 0; i < MYPAINT_MAX_THREADS; i++) {
+        pthread_mutex_destroy(&self->deques[i].lock);
+    }
+    pthread_cond_destroy(&self->idle_cond);
+    pthread_cond_destroy(&self->done_cond);
+    pthread_cond_destroy(&self->start_cond);
+    pthread_mutex_destroy(&self->lock);
+#endif
+    free(self->pending);
+    free(self->jobs);
+    free(self);
+}
+
+int
+tile_scheduler_get_num_threads(TileScheduler *self)
+{
+    return self->num_threads;
+}
+
+static int
+compare_jobs_by_cost(const void *a, const void *b)
+{
+    const TileJob *ja = (const TileJob *)a;
+    const TileJob *jb = (const TileJob *)b;
+    return (jb->cost > ja->cost) - (jb->cost < ja->cost);
+}
+
+static void
+run_serial(TileScheduler *self, TileIndex *tiles, int tiles_n,
+           TileSchedulerFunc func, void *user_data)
+{
+    const int previous_id = tile_scheduler_get_worker_id();
+    set_worker_id(0);
+    for (int i = 0; i < tiles_n; i++) {
+        func(user_data, tiles[i]);
+    }
+    set_worker_id(previous_id);
+}
+
+void
+tile_scheduler_run(TileScheduler *self, TileIndex *tiles, int tiles_n,
+                   TileSchedulerCostFunc cost_func, TileSchedulerFunc func,
+                   void *user_data)
+{
+    const int num_threads = MIN(self->num_threads, tiles_n);
+
+    if (num_threads <= 1) {
+        run_serial(self, tiles, tiles_n, func, user_data);
+        return;
+    }
+
+    // Each deque gets a fixed slice of the job array, large enough
+    // for its share of the round-robin distribution below.
+    const int slice = (tiles_n + num_threads - 1) / num_threads;
+    const int jobs_needed = tiles_n + slice * num_threads;
+    if (jobs_needed > self->jobs_allocated) {
+        TileJob *jobs = (TileJob *)realloc(self->jobs, jobs_needed * sizeof(TileJob));
+        if (!jobs) {
+            run_serial(self, tiles, tiles_n, func, user_data);
+            return;
+        }
+        self->jobs = jobs;
+        self->jobs_allocated = jobs_needed;
+    }
+
+    TileJob *sorted = self->jobs + slice * num_threads;
+    for (int i = 0; i < tiles_n; i++) {
+        sorted[i].index = tiles[i];
+        sorted[i].cost = cost_func ? cost_func(user_data, tiles[i]) : 0;
+    }
+    if (cost_func) {
+        qsort(sorted, tiles_n, sizeof(TileJob), compare_jobs_by_cost);
+    }
+
+    // Deal the jobs out like cards, so every worker starts on one of the
+    // heaviest tiles and the remaining work is spread evenly.
+    for (int w = 0; w < num_threads; w++) {
+        WorkerDeque *deque = &self->deques[w];
+        deque->jobs = self->jobs + w * slice;
+        deque->head = deque->tail = 0;
+    }
+    for (int i = 0; i < tiles_n; i++) {
+        WorkerDeque *deque = &self->deques[i % num_threads];
+        deque->jobs[deque->tail++] = sorted[i];
+    }
+    for (int w = num_threads; w < self->num_threads; w++) {
+        self->deques[w].head = self->deques[w].tail = 0;
+    }
+
+#ifdef HAVE_PTHREAD
+    // All pool threads are woken; those without jobs of their own
+    // will try to steal and then go back to sleep.
+    pthread_mutex_lock(&self->lock);
+    self->func = func;
+    self->user_data = user_data;
+    self->workers_busy = self->num_threads - 1;
+    self->generation++;
+    pthread_cond_broadcast(&self->start_cond);
+    pthread_mutex_unlock(&self->lock);
+#else
+    self->func = func;
+    self->user_data = user_data;
+#endif
+
+    const int previous_id = tile_scheduler_get_worker_id();
+    set_worker_id(0);
+    work_loop(self, 0);
+    set_worker_id(previous_id);
+
+#ifdef HAVE_PTHREAD
+    pthread_mutex_lock(&self->lock);
+    while (self->workers_busy > 0) {
+        pthread_cond_wait(&self->done_cond, &self->lock);
+    }
+    pthread_mutex_unlock(&self->lock);
+#endif
+}
+
+void
+tile_scheduler_set_background_func(TileScheduler *self, TileSchedulerFunc func,
+                                   void *user_data)
+{
+    lock_scheduler(self);
+    assert(self->pending_n == 0 && self->background_busy == 0);
+    self->background_func = func;
+    self->background_data = user_data;
+    unlock_scheduler(self);
+}
+
+void
+tile_scheduler_push(TileScheduler *self, TileIndex index)
+{
+    lock_scheduler(self);
+
+    if (self->pending_n == self->pending_allocated) {
+        // Grow the ring buffer, unwrapping it in the process
+        const int new_allocated = MAX(64, self->pending_allocated * 2);
+        TileIndex *new_pending = (TileIndex *)malloc(new_allocated * sizeof(TileIndex));
+        if (!new_pending) {
+            // Process it right here instead
+            unlock_scheduler(self);
+            self->background_func(self->background_data, index);
+            return;
+        }
+        for (int i = 0; i < self->pending_n; i++) {
+            new_pending[i] = self->pending[(self->pending_first + i) % self->pending_allocated];
+        }
+        free(self->pending);
+        self->pending = new_pending;
+        self->pending_allocated = new_allocated;
+        self->pending_first = 0;
+    }
+
+    const int last = (self->pending_first + self->pending_n) % self->pending_allocated;
+    self->pending[last] = index;
+    self->pending_n++;
+
+#ifdef HAVE_PTHREAD
+    pthread_cond_signal(&self->start_cond);
+#endif
+    unlock_scheduler(self);
+}
+
+void
+tile_scheduler_wait(TileScheduler *self)
+{
+    const int previous_id = tile_scheduler_get_worker_id();
+    TileIndex index;
+
+    set_worker_id(0);
+    lock_scheduler(self);
+    while (take_pending(self, &index)) {
+        process_pending(self, index);
+    }
+#ifdef HAVE_PTHREAD
+    while (self->background_busy > 0) {
+        pthread_cond_wait(&self->idle_cond, &self->lock);
+    }
+#endif
+    unlock_scheduler(self);
+    set_worker_id(previous_id);
+}
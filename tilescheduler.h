@@ -0,0 +1,79 @@
+/* libmypaint - The MyPaint Brush Library
+ * Copyright (C) 2026 The MyPaint Team
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef TILESCHEDULER_H
+#define TILESCHEDULER_H
+
+#include "tilemap.h"
+
+G_BEGIN_DECLS
+
+/* Persistent pool of worker threads processing lists of tiles.
+ *
+ * Each run distributes the tiles over per-worker deques, heaviest first,
+ * and idle workers steal from the tail of the other deques. The thread
+ * calling tile_scheduler_run() takes part as worker 0, so a scheduler
+ * with a single thread (or one built without pthreads) runs everything
+ * on the caller.
+ *
+ * Tiles can also be pushed one by one for processing in the background,
+ * with tile_scheduler_wait() acting as a fence. */
+typedef struct TileScheduler TileScheduler;
+
+typedef void (*TileSchedulerFunc) (void *user_data, TileIndex index);
+typedef int (*TileSchedulerCostFunc) (void *user_data, TileIndex index);
+
+/* Number of threads used when 0 is requested: one per online processor,
+ * capped at MYPAINT_MAX_THREADS. */
+int tile_scheduler_default_num_threads(void);
+
+TileScheduler *tile_scheduler_new(int num_threads);
+void tile_scheduler_free(TileScheduler *self);
+
+int tile_scheduler_get_num_threads(TileScheduler *self);
+
+/* Process all @tiles with @func, returning when every tile is done.
+ * @cost_func may be NULL; otherwise it gives a relative cost per tile,
+ * and the tiles are started in order of decreasing cost.
+ *
+ * Concurrency: not reentrant on the same @self instance. */
+void tile_scheduler_run(TileScheduler *self, TileIndex *tiles, int tiles_n,
+                        TileSchedulerCostFunc cost_func, TileSchedulerFunc func,
+                        void *user_data);
+
+/* Set the function used for tiles pushed with tile_scheduler_push().
+ * Must not be changed while pushed tiles are pending. */
+void tile_scheduler_set_background_func(TileScheduler *self, TileSchedulerFunc func,
+                                        void *user_data);
+
+/* Queue a tile for processing in the background by the pool threads (ids 1 and up).
+ * Tiles are started in the order they were pushed.
+ *
+ * Concurrency: may be called from any thread, but not while tile_scheduler_run()
+ * is in progress on the same @self instance. */
+void tile_scheduler_push(TileScheduler *self, TileIndex index);
+
+/* Wait until all pushed tiles have been processed. The calling thread helps
+ * out as worker 0, so this also works for a scheduler without pool threads. */
+void tile_scheduler_wait(TileScheduler *self);
+
+/* Index of the calling thread within the scheduler currently running it,
+ * or -1 when called from outside of tile_scheduler_run(). */
+int tile_scheduler_get_worker_id(void);
+
+G_END_DECLS
+
+#endif // TILESCHEDULER_H
@@ -0,0 +1,282 @@
+/* libmypaint - The MyPaint Brush Library
+ * Copyright (C) 2026 The MyPaint Team
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "mypaint-config.h"
+#include "mypaint-trace.h"
+#include "trace.h"
+#include "helpers.h"
+
+#ifdef MYPAINT_TRACING
+
+// Events kept per thread, a power of two. Older events are overwritten.
+#define TRACE_BUFFER_EVENTS (1 << 16)
+
+typedef struct {
+    const char *name;
+    double start;
+    double end;
+} TraceEvent;
+
+/* Only the thread owning a buffer writes to it, so recording needs no locks.
+ * The mutex guards the list of buffers, which is only changed when a thread
+ * records its first event or exits. Buffers of exited threads are handed
+ * to new threads, keeping their events, so the memory used is bounded by
+ * the number of threads recording at the same time. */
+typedef struct TraceBuffer {
+    TraceEvent events[TRACE_BUFFER_EVENTS];
+    uint64_t written;
+    int tid;
+    gboolean in_use;
+    struct TraceBuffer *next;
+} TraceBuffer;
+
+static TraceBuffer *trace_buffers = NULL;
+static int trace_buffers_n = 0;
+
+#ifdef HAVE_PTHREAD
+static pthread_mutex_t trace_buffers_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t trace_buffer_key;
+static pthread_once_t trace_buffer_key_once = PTHREAD_ONCE_INIT;
+#endif
+
+static void
+trace_buffers_lock(void)
+{
+#ifdef HAVE_PTHREAD
+    pthread_mutex_lock(&trace_buffers_mutex);
+#endif
+}
+
+static void
+trace_buffers_unlock(void)
+{
+#ifdef HAVE_PTHREAD
+    pthread_mutex_unlock(&trace_buffers_mutex);
+#endif
+}
+
+static TraceBuffer *
+acquire_buffer(void)
+{
+    trace_buffers_lock();
+    TraceBuffer *buffer = trace_buffers;
+    while (buffer && buffer->in_use) {
+        buffer = buffer->next;
+    }
+    if (!buffer) {
+        buffer = (TraceBuffer *)calloc(1, sizeof(TraceBuffer));
+        if (buffer) {
+            buffer->tid = ++trace_buffers_n;
+            buffer->next = trace_buffers;
+            trace_buffers = buffer;
+        }
+    }
+    if (buffer) {
+        buffer->in_use = TRUE;
+    }
+    trace_buffers_unlock();
+    return buffer;
+}
+
+#ifdef HAVE_PTHREAD
+
+static void
+release_buffer(void *buffer)
+{
+    trace_buffers_lock();
+    ((TraceBuffer *)buffer)->in_use = FALSE;
+    trace_buffers_unlock();
+}
+
+static void
+create_trace_buffer_key(void)
+{
+    pthread_key_create(&trace_buffer_key, release_buffer);
+}
+
+static TraceBuffer *
+thread_buffer(void)
+{
+    pthread_once(&trace_buffer_key_once, create_trace_buffer_key);
+    TraceBuffer *buffer = (TraceBuffer *)pthread_getspecific(trace_buffer_key);
+    if (!buffer) {
+        buffer = acquire_buffer();
+        pthread_setspecific(trace_buffer_key, buffer);
+    }
+    return buffer;
+}
+
+#else
+
+static TraceBuffer *
+thread_buffer(void)
+{
+    static TraceBuffer *buffers[MYPAINT_MAX_THREADS];
+    int thread = 0;
+#ifdef _OPENMP
+    thread = omp_get_thread_num() % MYPAINT_MAX_THREADS;
+#endif
+    if (!buffers[thread]) {
+        #pragma omp critical (mypaint_trace)
+        buffers[thread] = acquire_buffer();
+    }
+    return buffers[thread];
+}
+
+#endif
+
+// Record an event from @start until now, see TRACE_BEGIN()
+void
+trace_record(const char *name, double start)
+{
+    TraceBuffer *buffer = thread_buffer();
+    if (!buffer) {
+        return;
+    }
+    TraceEvent *event = &buffer->events[buffer->written & (TRACE_BUFFER_EVENTS - 1)];
+    event->name = name;
+    event->start = start;
+    event->end = get_monotonic_time();
+    buffer->written++;
+}
+
+static size_t
+buffer_events_n(const TraceBuffer *buffer)
+{
+    return buffer->written < TRACE_BUFFER_EVENTS ? (size_t)buffer->written : TRACE_BUFFER_EVENTS;
+}
+
+static const TraceEvent *
+buffer_event(const TraceBuffer *buffer, size_t i)
+{
+    const uint64_t first = buffer->written - buffer_events_n(buffer);
+    return &buffer->events[(first + i) & (TRACE_BUFFER_EVENTS - 1)];
+}
+
+#endif
+
+/**
+ * mypaint_trace_is_enabled:
+ *
+ * Returns: TRUE if libmypaint was built with --enable-tracing
+ */
+gboolean
+mypaint_trace_is_enabled(void)
+{
+#ifdef MYPAINT_TRACING
+    return TRUE;
+#else
+    return FALSE;
+#endif
+}
+
+/**
+ * mypaint_trace_write_json:
+ * @path: File to write the trace to
+ *
+ * Write the recorded events as Chrome trace event JSON, with one track
+ * per recording thread and the times relative to the oldest event.
+ * Call it while no thread is painting; the events are not cleared.
+ *
+ * Returns: TRUE on success, FALSE if the file could not be written
+ * or libmypaint was built without tracing.
+ */
+gboolean
+mypaint_trace_write_json(const char *path)
+{
+#ifdef MYPAINT_TRACING
+    FILE *fp = fopen(path, "w");
+    if (!fp) {
+        fprintf(stderr, "Error: Unable to open '%s' for writing\n", path);
+        return FALSE;
+    }
+
+    trace_buffers_lock();
+    double origin = 0.0;
+    gboolean have_origin = FALSE;
+    for (TraceBuffer *buffer = trace_buffers; buffer; buffer = buffer->next) {
+        // Events are stored as they end, so an enclosing event comes after the ones inside it
+        const size_t events_n = buffer_events_n(buffer);
+        for (size_t i = 0; i < events_n; i++) {
+            const double start = buffer_event(buffer, i)->start;
+            if (!have_origin || start < origin) {
+                origin = start;
+                have_origin = TRUE;
+            }
+        }
+    }
+
+    fprintf(fp, "{\"traceEvents\":[\n");
+    const char *separator = "";
+    for (TraceBuffer *buffer = trace_buffers; buffer; buffer = buffer->next) {
+        fprintf(fp, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,"
+                "\"args\":{\"name\":\"libmypaint thread %d\"}}",
+                separator, buffer->tid, buffer->tid);
+        separator = ",\n";
+        const size_t events_n = buffer_events_n(buffer);
+        for (size_t i = 0; i < events_n; i++) {
+            const TraceEvent *event = buffer_event(buffer, i);
+            fprintf(fp, ",\n{\"name\":\"%s\",\"cat\":\"libmypaint\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,"
+                    "\"ts\":%.3f,\"dur\":%.3f}",
+                    event->name, buffer->tid,
+                    (event->start - origin) * 1e6, (event->end - event->start) * 1e6);
+        }
+    }
+    fprintf(fp, "\n],\"displayTimeUnit\":\"ms\"}\n");
+    trace_buffers_unlock();
+
+    const gboolean ok = !ferror(fp);
+    if (fclose(fp) != 0 || !ok) {
+        fprintf(stderr, "Error: Unable to write '%s'\n", path);
+        return FALSE;
+    }
+    return TRUE;
+#else
+    (void)path;
+    return FALSE;
+#endif
+}
+
+/**
+ * mypaint_trace_clear:
+ *
+ * Drop all recorded events. Call it while no thread is painting.
+ */
+void
+mypaint_trace_clear(void)
+{
+#ifdef MYPAINT_TRACING
+    trace_buffers_lock();
+    for (TraceBuffer *buffer = trace_buffers; buffer; buffer = buffer->next) {
+        buffer->written = 0;
+    }
+    trace_buffers_unlock();
+#endif
+}
@@ -0,0 +1,29 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+/* Scoped trace events, see mypaint-trace.h
+ *
+ *   TRACE_BEGIN(process_tile);
+ *   ...
+ *   TRACE_END(process_tile);
+ *
+ * records an event named "process_tile" on the calling thread. Every
+ * return in between needs its own TRACE_END(). Without --enable-tracing
+ * both compile to nothing. */
+#ifdef MYPAINT_TRACING
+
+#include "helpers.h"
+
+#define TRACE_BEGIN(id) const double trace_start_##id = get_monotonic_time()
+#define TRACE_END(id) trace_record(#id, trace_start_##id)
+
+void trace_record(const char *name, double start);
+
+#else
+
+#define TRACE_BEGIN(id)
+#define TRACE_END(id)
+
+#endif
+
+#endif // TRACE_H